@@ -0,0 +1,195 @@
+/**
+ * Microbenchmark of EvaluateEffectBatch, scalar kernel against the best SIMD kernel of this CPU.
+ * Build: g++ -O2 -std=c++11 -I../ffbeast-wheel-api-lib effect_kernel_benchmark.cpp ../ffbeast-wheel-api-lib/effect_kernel.cpp
+ * Usage: effect_kernel_benchmark [wheels] [effects per wheel] [iterations]
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "effect_kernel.h"
+#include "host_clock.h"
+
+#define BENCH_MAX_WHEELS    16
+#define BENCH_MAX_EFFECTS   (BENCH_MAX_WHEELS * 256)
+
+typedef struct {
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Phase[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Elapsed[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Active[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Gain[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Magnitude[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Offset[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float RampSlope[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Center[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float DeadBand[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float PositiveCoefficient[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float NegativeCoefficient[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float Saturation[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float AttackLevel[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float AttackRate[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float FadeLevel[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float FadeRate[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float FadeEnd[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float IsSine[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float IsSquare[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float IsTriangle[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float SawtoothSign[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float IsRamp[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float IsPeriodic[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float IsCondition[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float UsesPosition[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float UsesVelocity[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float UsesAcceleration[BENCH_MAX_EFFECTS];
+    alignas(EFFECT_KERNEL_ALIGNMENT) float UsesDirection[BENCH_MAX_EFFECTS];
+    int WheelStart[BENCH_MAX_WHEELS + 1];
+} BenchStorageTypeDef;
+
+static BenchStorageTypeDef storage;
+
+static float RandomUnit(){
+    return (float)rand() / (float)RAND_MAX;
+}
+
+// Mix of every periodic and condition type with envelopes, roughly what a busy racing title keeps alive
+static void FillEffect(int i){
+    BenchStorageTypeDef *s = &storage;
+    int type = rand() % 9;
+    s->Phase[i] = RandomUnit();
+    s->Elapsed[i] = RandomUnit() * 5.0f;
+    s->Active[i] = 1.0f;
+    s->Gain[i] = 0.5f + 0.5f * RandomUnit();
+    s->Magnitude[i] = RandomUnit() * 0.3f;
+    s->Offset[i] = (RandomUnit() - 0.5f) * 0.1f;
+    s->RampSlope[i] = type == 4 ? (RandomUnit() - 0.5f) * 0.2f : 0.0f;
+    s->Center[i] = (RandomUnit() - 0.5f) * 0.1f;
+    s->DeadBand[i] = RandomUnit() * 0.02f;
+    s->PositiveCoefficient[i] = RandomUnit() * 2.0f;
+    s->NegativeCoefficient[i] = RandomUnit() * 2.0f;
+    s->Saturation[i] = RandomUnit();
+    s->AttackLevel[i] = RandomUnit();
+    s->AttackRate[i] = 1.0f + RandomUnit() * 10.0f;
+    s->FadeLevel[i] = RandomUnit();
+    s->FadeRate[i] = 1.0f + RandomUnit() * 10.0f;
+    s->FadeEnd[i] = 5.0f + RandomUnit() * 5.0f;
+    s->IsSine[i] = type == 0 ? 1.0f : 0.0f;
+    s->IsSquare[i] = type == 1 ? 1.0f : 0.0f;
+    s->IsTriangle[i] = type == 2 ? 1.0f : 0.0f;
+    s->SawtoothSign[i] = type == 3 ? 1.0f : 0.0f;
+    s->IsRamp[i] = type == 4 ? 1.0f : 0.0f;
+    s->IsPeriodic[i] = type <= 3 ? 1.0f : 0.0f;
+    s->IsCondition[i] = type >= 5 ? 1.0f : 0.0f;
+    s->UsesPosition[i] = type == 5 ? 1.0f : 0.0f;
+    s->UsesVelocity[i] = type == 6 ? 1.0f : 0.0f;
+    s->UsesAcceleration[i] = type == 7 ? 1.0f : 0.0f;
+    s->UsesDirection[i] = type == 8 ? 1.0f : 0.0f;
+}
+
+static void BindBatch(EffectBatchTypeDef *batch, int wheels){
+    BenchStorageTypeDef *s = &storage;
+    batch->Phase = s->Phase;
+    batch->Elapsed = s->Elapsed;
+    batch->Active = s->Active;
+    batch->Gain = s->Gain;
+    batch->Magnitude = s->Magnitude;
+    batch->Offset = s->Offset;
+    batch->RampSlope = s->RampSlope;
+    batch->Center = s->Center;
+    batch->DeadBand = s->DeadBand;
+    batch->PositiveCoefficient = s->PositiveCoefficient;
+    batch->NegativeCoefficient = s->NegativeCoefficient;
+    batch->Saturation = s->Saturation;
+    batch->AttackLevel = s->AttackLevel;
+    batch->AttackRate = s->AttackRate;
+    batch->FadeLevel = s->FadeLevel;
+    batch->FadeRate = s->FadeRate;
+    batch->FadeEnd = s->FadeEnd;
+    batch->IsSine = s->IsSine;
+    batch->IsSquare = s->IsSquare;
+    batch->IsTriangle = s->IsTriangle;
+    batch->SawtoothSign = s->SawtoothSign;
+    batch->IsRamp = s->IsRamp;
+    batch->IsPeriodic = s->IsPeriodic;
+    batch->IsCondition = s->IsCondition;
+    batch->UsesPosition = s->UsesPosition;
+    batch->UsesVelocity = s->UsesVelocity;
+    batch->UsesAcceleration = s->UsesAcceleration;
+    batch->UsesDirection = s->UsesDirection;
+    batch->WheelStart = s->WheelStart;
+    batch->WheelCount = wheels;
+}
+
+static double Run(EffectKernelEnum kernel, const EffectBatchTypeDef *batch, EffectWheelInputTypeDef *inputs,
+                  EffectWheelOutputTypeDef *outputs, int iterations){
+    SelectEffectKernel(kernel);
+    // Warm up caches and branch predictors before timing
+    for (int i = 0; i < iterations / 10 + 1; i++){
+        EvaluateEffectBatch(batch, inputs, outputs);
+    }
+
+    uint64_t start = HostClockNanoseconds();
+    for (int i = 0; i < iterations; i++){
+        // Inputs move every tick like they would with a live wheel, keeps the compiler from hoisting the call
+        inputs[0].Position = (float)(i & 1023) / 1024.0f - 0.5f;
+        EvaluateEffectBatch(batch, inputs, outputs);
+    }
+    uint64_t elapsed = HostClockNanoseconds() - start;
+    return (double)elapsed / iterations;
+}
+
+int main(int argc, char **argv){
+    int wheels = argc > 1 ? atoi(argv[1]) : 4;
+    int perWheel = argc > 2 ? atoi(argv[2]) : 64;
+    int iterations = argc > 3 ? atoi(argv[3]) : 200000;
+    if (wheels < 1 || wheels > BENCH_MAX_WHEELS || perWheel < 1 || iterations < 1){
+        fprintf(stderr, "usage: %s [wheels 1-%d] [effects per wheel] [iterations]\n", argv[0], BENCH_MAX_WHEELS);
+        return 1;
+    }
+    int padded = (perWheel + EFFECT_KERNEL_WIDTH - 1) / EFFECT_KERNEL_WIDTH * EFFECT_KERNEL_WIDTH;
+    if (padded * wheels > BENCH_MAX_EFFECTS){
+        fprintf(stderr, "at most %d effects in total\n", BENCH_MAX_EFFECTS);
+        return 1;
+    }
+
+    srand(1);
+    for (int w = 0; w < wheels; w++){
+        storage.WheelStart[w] = w * padded;
+        for (int i = 0; i < perWheel; i++){
+            FillEffect(w * padded + i);
+        }
+    }
+    storage.WheelStart[wheels] = wheels * padded;
+
+    EffectBatchTypeDef batch;
+    BindBatch(&batch, wheels);
+    EffectWheelInputTypeDef inputs[BENCH_MAX_WHEELS];
+    for (int w = 0; w < wheels; w++){
+        inputs[w].Position = (RandomUnit() - 0.5f) * 0.5f;
+        inputs[w].Velocity = (RandomUnit() - 0.5f) * 2.0f;
+        inputs[w].Acceleration = (RandomUnit() - 0.5f) * 20.0f;
+        inputs[w].Direction = inputs[w].Velocity > 0.0f ? 1.0f : -1.0f;
+        inputs[w].Gain = 1.0f;
+    }
+
+    EffectWheelOutputTypeDef scalarOut[BENCH_MAX_WHEELS];
+    EffectWheelOutputTypeDef simdOut[BENCH_MAX_WHEELS];
+    double scalarNs = Run(EFFECT_KERNEL_SCALAR, &batch, inputs, scalarOut, iterations);
+    EffectKernelEnum best = SelectEffectKernel(EFFECT_KERNEL_AUTO);
+    double simdNs = Run(best, &batch, inputs, simdOut, iterations);
+
+    // Both runs ended on the same inputs, outputs may only differ by summation order rounding
+    int maxDifference = 0;
+    for (int w = 0; w < wheels; w++){
+        int c = abs(scalarOut[w].ConstantForce - simdOut[w].ConstantForce);
+        int p = abs(scalarOut[w].PeriodicForce - simdOut[w].PeriodicForce);
+        maxDifference = c > maxDifference ? c : maxDifference;
+        maxDifference = p > maxDifference ? p : maxDifference;
+    }
+
+    int total = wheels * perWheel;
+    printf("wheels %d, effects %d (%d per wheel), iterations %d\n", wheels, total, perWheel, iterations);
+    printf("%-8s %10.1f ns/batch %8.2f ns/effect\n", "scalar", scalarNs, scalarNs / total);
+    printf("%-8s %10.1f ns/batch %8.2f ns/effect\n", EffectKernelName(best), simdNs, simdNs / total);
+    printf("speedup  %10.2fx\n", scalarNs / simdNs);
+    printf("max output difference %d of 10000\n", maxDifference);
+    return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ * Closed loop latency harness, measures time from a direct control write to the torque change seen in state reports.
+ * Sends alternating ConstantForce steps, stamps every write and every report with HostClockNanoseconds
+ * (QueryPerformanceCounter on Windows, CLOCK_MONOTONIC elsewhere) and reports latency percentiles,
+ * report interval histogram and dropped reports for sync writes, async writes and the coalescing sender.
+ *
+ * Hold the wheel or keep amplitude low, the wheel is driven in both directions while measuring.
+ * Build (Windows): g++ -O2 -std=c++17 -I../ffbeast-wheel-api-lib latency_harness.cpp ../ffbeast-wheel-api-lib/wheel_api.cpp
+ *     ../ffbeast-wheel-api-lib/settings_fields.cpp ../ffbeast-wheel-api-lib/coalescing_sender.cpp ../ffbeast-wheel-api-lib/hidapi.c -lsetupapi -lwinmm
+ * Build (Linux): same with hidapi_linux.c and -ludev -lpthread
+ * Usage: latency_harness [mode all|sync|async|coalescing] [steps] [amplitude] [hold ms]
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "wheel_api.h"
+#include "coalescing_sender.h"
+#include "host_clock.h"
+
+#define HARNESS_DEFAULT_STEPS       200
+#define HARNESS_REPORT_INTERVAL_NS  1000000ULL // Device sends state every USB polling interval
+#define HARNESS_DEFAULT_AMPLITUDE   1500
+#define HARNESS_DEFAULT_HOLD_MS     100
+#define HARNESS_DETECT_SHARE        0.25f // Share of expected torque swing that counts as the step being observed
+#define HARNESS_SETTLE_REPORTS      8 // Reports averaged into torque baseline before each step
+#define HARNESS_BATCH               64
+#define HARNESS_BUCKET_NS           250000ULL
+#define HARNESS_BUCKETS             16 // Last bucket also collects everything longer
+
+typedef enum {
+    MODE_SYNC = 0,
+    MODE_ASYNC,
+    MODE_COALESCING,
+    MODE_COUNT,
+} ModeEnum;
+
+static const char *ModeNames[MODE_COUNT] = {"sync", "async", "coalescing"};
+
+typedef struct {
+    std::vector<uint64_t> Latency; // Write start to first report showing the step
+    std::vector<uint64_t> WriteCall; // Time spent inside the write call
+    uint64_t Buckets[HARNESS_BUCKETS];
+    uint64_t Reports;
+    uint64_t Gaps; // Reports the device should have sent judging by interval but never arrived
+    uint64_t RingDrops;
+    uint64_t Undetected; // Steps where torque never crossed the threshold within hold time
+    uint64_t WriteFailures;
+} ModeResultTypeDef;
+
+typedef struct {
+    uint64_t LastTimestamp;
+    float Baseline; // Running mean of recent torque
+    int BaselineCount;
+} StreamTypeDef;
+
+static uint64_t Percentile(const std::vector<uint64_t> &sorted, double share){
+    if (sorted.empty()){
+        return 0;
+    }
+    size_t index = (size_t)(share * (double)(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static void PrintDistribution(const char *label, std::vector<uint64_t> samples){
+    std::sort(samples.begin(), samples.end());
+    if (samples.empty()){
+        printf("  %-12s no samples\n", label);
+        return;
+    }
+    printf("  %-12s p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us  (%zu samples)\n", label,
+           Percentile(samples, 0.5) / 1000.0, Percentile(samples, 0.99) / 1000.0,
+           Percentile(samples, 0.999) / 1000.0, samples.back() / 1000.0, samples.size());
+}
+
+// Histogram of report intervals plus gap detection, every report passes through here exactly once
+static void TrackReport(ModeResultTypeDef *result, StreamTypeDef *stream, const TimestampedStateTypeDef *sample){
+    if (stream->LastTimestamp != 0 && sample->Timestamp > stream->LastTimestamp){
+        uint64_t interval = sample->Timestamp - stream->LastTimestamp;
+        uint64_t bucket = interval / HARNESS_BUCKET_NS;
+        result->Buckets[bucket < HARNESS_BUCKETS ? bucket : HARNESS_BUCKETS - 1]++;
+        // Device reports every polling interval, a longer silence means reports were lost on the way
+        if (interval > HARNESS_REPORT_INTERVAL_NS * 3 / 2){
+            result->Gaps += (interval + HARNESS_REPORT_INTERVAL_NS / 2) / HARNESS_REPORT_INTERVAL_NS - 1;
+        }
+    }
+    stream->LastTimestamp = sample->Timestamp;
+    result->Reports++;
+}
+
+static void UpdateBaseline(StreamTypeDef *stream, float torque){
+    int n = stream->BaselineCount < HARNESS_SETTLE_REPORTS ? ++stream->BaselineCount : HARNESS_SETTLE_REPORTS;
+    stream->Baseline += (torque - stream->Baseline) / n;
+}
+
+static int Send(WheelApi *api, CoalescingSender *sender, ModeEnum mode, DirectControlTypeDef control){
+    switch (mode){
+    case MODE_SYNC:
+        return api->sendDirectControl(control);
+    case MODE_ASYNC:
+        return api->sendDirectControlAsync(control);
+    case MODE_COALESCING:
+        sender->submit(control);
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+static void RunMode(WheelApi *api, ModeEnum mode, int steps, int16_t amplitude, uint32_t holdMs, ModeResultTypeDef *result){
+    CoalescingSender sender(api);
+    if (mode == MODE_COALESCING && sender.start() < 0){
+        fprintf(stderr, "coalescing sender did not start\n");
+        return;
+    }
+
+    TimestampedStateTypeDef samples[HARNESS_BATCH];
+    StreamTypeDef stream = {};
+    // Reports from before this run are not measured
+    while (api->drainStates(samples, HARNESS_BATCH) > 0){
+    }
+    uint64_t dropsBefore = api->droppedStates();
+
+    for (int step = 0; step < steps; step++){
+        DirectControlTypeDef control = {};
+        control.ConstantForce = (step & 1) ? amplitude : (int16_t)-amplitude;
+        float direction = (step & 1) ? 1.0f : -1.0f;
+        float threshold = HARNESS_DETECT_SHARE * 2.0f * amplitude;
+        float baseline = stream.Baseline;
+
+        uint64_t writeStart = HostClockNanoseconds();
+        int sent = Send(api, &sender, mode, control);
+        uint64_t writeEnd = HostClockNanoseconds();
+        result->WriteCall.push_back(writeEnd - writeStart);
+        if (sent < 0){
+            result->WriteFailures++;
+        }
+
+        bool detected = false;
+        uint64_t deadline = writeStart + (uint64_t)holdMs * 1000000ULL;
+        while (HostClockNanoseconds() < deadline){
+            if (mode == MODE_ASYNC){
+                api->completeWrites(0);
+            }
+            int count = api->drainStates(samples, HARNESS_BATCH);
+            for (int i = 0; i < count; i++){
+                TrackReport(result, &stream, &samples[i]);
+                float torque = (float)samples[i].State.Torque;
+                if (!detected && samples[i].Timestamp >= writeStart && step > 0 &&
+                    (torque - baseline) * direction >= threshold){
+                    result->Latency.push_back(samples[i].Timestamp - writeStart);
+                    detected = true;
+                }
+                UpdateBaseline(&stream, torque);
+            }
+            if (count == 0){
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        // First step only establishes the opposite force as baseline, there is no swing to detect
+        if (!detected && step > 0){
+            result->Undetected++;
+        }
+    }
+
+    sender.stop();
+    api->completeWrites(-1);
+    DirectControlTypeDef idle = {};
+    api->sendDirectControl(idle);
+    result->RingDrops = api->droppedStates() - dropsBefore;
+}
+
+static void PrintResult(ModeEnum mode, const ModeResultTypeDef *result){
+    printf("%s\n", ModeNames[mode]);
+    PrintDistribution("latency", result->Latency);
+    PrintDistribution("write call", result->WriteCall);
+    printf("  reports %llu, missing from device %llu, dropped by ring %llu, undetected steps %llu, write failures %llu\n",
+           (unsigned long long)result->Reports, (unsigned long long)result->Gaps,
+           (unsigned long long)result->RingDrops, (unsigned long long)result->Undetected,
+           (unsigned long long)result->WriteFailures);
+
+    uint64_t peak = 1;
+    for (int i = 0; i < HARNESS_BUCKETS; i++){
+        peak = result->Buckets[i] > peak ? result->Buckets[i] : peak;
+    }
+    printf("  report interval\n");
+    for (int i = 0; i < HARNESS_BUCKETS; i++){
+        if (result->Buckets[i] == 0){
+            continue;
+        }
+        char bar[41];
+        int length = (int)(result->Buckets[i] * 40 / peak);
+        memset(bar, '#', length);
+        bar[length] = 0;
+        printf("  %s%5.2f ms %8llu %s\n", i == HARNESS_BUCKETS - 1 ? ">" : " ",
+               (double)(i * HARNESS_BUCKET_NS) / 1000000.0, (unsigned long long)result->Buckets[i], bar);
+    }
+}
+
+int main(int argc, char **argv){
+    const char *modeName = argc > 1 ? argv[1] : "all";
+    int steps = argc > 2 ? atoi(argv[2]) : HARNESS_DEFAULT_STEPS;
+    int amplitude = argc > 3 ? atoi(argv[3]) : HARNESS_DEFAULT_AMPLITUDE;
+    int holdMs = argc > 4 ? atoi(argv[4]) : HARNESS_DEFAULT_HOLD_MS;
+
+    int first = -1;
+    int last = -1;
+    if (strcmp(modeName, "all") == 0){
+        first = 0;
+        last = MODE_COUNT - 1;
+    }
+    for (int i = 0; i < MODE_COUNT; i++){
+        if (strcmp(modeName, ModeNames[i]) == 0){
+            first = last = i;
+        }
+    }
+    if (first < 0 || steps < 2 || amplitude <= 0 || amplitude > 10000 || holdMs <= 0){
+        fprintf(stderr, "usage: %s [all|sync|async|coalescing] [steps >= 2] [amplitude 1-10000] [hold ms]\n", argv[0]);
+        return 1;
+    }
+
+    WheelApi api;
+    if (api.connect() <= 0){
+        fprintf(stderr, "wheel not found\n");
+        return 1;
+    }
+    if (api.startStateReader() <= 0){
+        fprintf(stderr, "state reader did not start\n");
+        return 1;
+    }
+
+    printf("steps %d, amplitude %d, hold %d ms\n", steps, amplitude, holdMs);
+    for (int mode = first; mode <= last; mode++){
+        ModeResultTypeDef result = {};
+        RunMode(&api, (ModeEnum)mode, steps, (int16_t)amplitude, (uint32_t)holdMs, &result);
+        PrintResult((ModeEnum)mode, &result);
+    }
+
+    api.stopStateReader();
+    api.disconnect();
+    return 0;
+}
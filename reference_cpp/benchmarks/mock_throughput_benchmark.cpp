@@ -0,0 +1,222 @@
+/**
+ * Throughput of the library itself against the simulated wheel of hidapi_mock.cpp, no USB stack involved.
+ * Measures state reads, pooled views, background reader with drainStates, direct control writes and settings
+ * round trips, and checks that every value arrived where it was sent.
+ * Build: g++ -O2 -std=c++17 -I../ffbeast-wheel-api-lib mock_throughput_benchmark.cpp ../ffbeast-wheel-api-lib/wheel_api.cpp
+ *     ../ffbeast-wheel-api-lib/settings_fields.cpp ../ffbeast-wheel-api-lib/hidapi_mock.cpp -lpthread
+ * Usage: mock_throughput_benchmark [reports] [paced rate hz] [paced duration ms]
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include "wheel_api.h"
+#include "hidapi_mock.h"
+#include "host_clock.h"
+
+#define BENCH_DEFAULT_REPORTS   2000000
+#define BENCH_DEFAULT_RATE_HZ   MOCK_WHEEL_DEFAULT_RATE_HZ
+#define BENCH_DEFAULT_PACED_MS  2000
+#define BENCH_BATCH             64
+
+static int failures = 0;
+
+static void Check(bool condition, const char *what){
+    if (!condition){
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static void PrintRate(const char *label, uint64_t count, uint64_t ns){
+    printf("  %-22s %10llu in %8.1f ms  %8.1f ns each  %8.2f M/s\n", label, (unsigned long long) count, ns / 1.0e6,
+           count ? (double) ns / (double) count : 0.0, ns ? (double) count * 1000.0 / (double) ns : 0.0);
+}
+
+static void Configure(uint32_t rate, int16_t position){
+    MockWheelConfigTypeDef config;
+    MockWheelReadConfig(0, &config);
+    config.ReportRateHz = rate;
+    config.Position = position;
+    MockWheelConfigure(0, &config);
+}
+
+static void BenchReads(WheelApi *api, int reports){
+    printf("synchronous reads, unlimited report rate\n");
+    Configure(0, 1234);
+
+    DeviceStateTypeDef state;
+    uint64_t start = HostClockNanoseconds();
+    int ok = 0;
+    for (int i = 0; i < reports; i++){
+        ok += api->readState(&state) > 0;
+    }
+    PrintRate("readState", (uint64_t) ok, HostClockNanoseconds() - start);
+    Check(ok == reports && state.Position == 1234, "readState returns every report with configured position");
+
+    start = HostClockNanoseconds();
+    ok = 0;
+    for (int i = 0; i < reports; i++){
+        ok += api->pumpState(0) > 0;
+    }
+    PrintRate("pumpState", (uint64_t) ok, HostClockNanoseconds() - start);
+    TimestampedStateTypeDef samples[BENCH_BATCH];
+    while (api->drainStates(samples, BENCH_BATCH) > 0){
+    }
+
+    start = HostClockNanoseconds();
+    ok = 0;
+    StateView view;
+    for (int i = 0; i < reports; i++){
+        ok += api->readStateView(&view) > 0;
+    }
+    PrintRate("readStateView", (uint64_t) ok, HostClockNanoseconds() - start);
+    Check(view.isValid() && view.state().Position == 1234, "readStateView sees configured position");
+}
+
+static void BenchReader(WheelApi *api, uint32_t rate, uint32_t durationMs){
+    Configure(rate, -500);
+    TimestampedStateTypeDef samples[BENCH_BATCH];
+    while (api->drainStates(samples, BENCH_BATCH) > 0){
+    }
+    MockWheelCountersTypeDef before;
+    MockWheelReadCounters(0, &before);
+    WheelApiStatsTypeDef statsBefore;
+    api->readStats(&statsBefore);
+
+    if (api->startStateReader() <= 0){
+        Check(false, "state reader starts");
+        return;
+    }
+    uint64_t received = 0;
+    uint64_t start = HostClockNanoseconds();
+    uint64_t end = start + (uint64_t) durationMs * 1000000ULL;
+    bool positionOk = true;
+    while (HostClockNanoseconds() < end){
+        int count = api->drainStates(samples, BENCH_BATCH);
+        for (int i = 0; i < count; i++){
+            positionOk &= samples[i].State.Position == -500;
+        }
+        received += (uint64_t) count;
+        if (count == 0 && rate != 0){
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    api->stopStateReader();
+    uint64_t elapsed = HostClockNanoseconds() - start;
+    int count;
+    while ((count = api->drainStates(samples, BENCH_BATCH)) > 0){
+        received += (uint64_t) count;
+    }
+
+    MockWheelCountersTypeDef after;
+    MockWheelReadCounters(0, &after);
+    WheelApiStatsTypeDef statsAfter;
+    api->readStats(&statsAfter);
+    // Reader publishes faster than a consumer drains when report rate is unlimited, ring drops show by how much
+    PrintRate("published", statsAfter.StateReports - statsBefore.StateReports, elapsed);
+    PrintRate("drained", received, elapsed);
+    printf("  ring drops %llu, overwritten in device buffers %llu\n",
+           (unsigned long long) (statsAfter.DroppedStates - statsBefore.DroppedStates),
+           (unsigned long long) (after.OverwrittenReports - before.OverwrittenReports));
+    Check(positionOk, "background reader delivers configured position");
+    if (rate != 0){
+        double expected = (double) rate * (double) elapsed / 1.0e9;
+        printf("  expected %.0f reports at %u Hz, got %.1f%%\n", expected, rate, 100.0 * (double) received / expected);
+        Check(received > expected * 0.9 && received < expected * 1.1, "paced reader keeps device report rate");
+    }
+}
+
+static void BenchWrites(WheelApi *api, int count){
+    printf("direct control writes\n");
+    DirectControlTypeDef control = {};
+    uint64_t start = HostClockNanoseconds();
+    int ok = 0;
+    for (int i = 0; i < count; i++){
+        control.ConstantForce = (int16_t) (i % 20001 - 10000);
+        ok += api->sendDirectControl(control) > 0;
+    }
+    PrintRate("sendDirectControl", (uint64_t) ok, HostClockNanoseconds() - start);
+    DirectControlTypeDef received;
+    MockWheelReadControl(0, &received);
+    Check(ok == count && memcmp(&received, &control, sizeof(control)) == 0, "device holds last control sent");
+
+    // Torque of the simulated wheel follows constant force
+    Configure(0, 0);
+    control.ConstantForce = 4321;
+    api->sendDirectControl(control);
+    DeviceStateTypeDef state;
+    api->readState(&state);
+    Check(state.Torque == 4321, "reported torque follows constant force");
+    control.ConstantForce = 0;
+    api->sendDirectControl(control);
+}
+
+static void BenchSettings(WheelApi *api, int count){
+    printf("settings round trips\n");
+    uint64_t start = HostClockNanoseconds();
+    int ok = 0;
+    for (int i = 0; i < count; i++){
+        ok += api->sendUInt8SettingReport(SETTINGS_FIELD_POWER_LIMIT, 0, (uint8_t) (i % 101)) > 0;
+    }
+    PrintRate("setting writes", (uint64_t) ok, HostClockNanoseconds() - start);
+
+    start = HostClockNanoseconds();
+    DeviceSettingsTypeDef fromDevice;
+    for (int i = 0; i < count; i++){
+        ok += api->readAllSettings(&fromDevice);
+    }
+    PrintRate("readAllSettings", (uint64_t) count, HostClockNanoseconds() - start);
+
+    DeviceSettingsTypeDef stored;
+    MockWheelReadSettings(0, &stored);
+    Check(fromDevice.Hardware.PowerLimit == (count - 1) % 101, "feature report returns last written value");
+    Check(memcmp(&fromDevice, &stored, sizeof(stored)) == 0, "feature reports match device storage");
+    DeviceSettingsTypeDef cached;
+    Check(api->readCachedSettings(&cached) > 0 && memcmp(&cached, &stored, sizeof(stored)) == 0,
+          "settings cache matches device storage");
+}
+
+static void PrintStats(WheelApi *api){
+    WheelApiStatsTypeDef stats;
+    api->readStats(&stats);
+    const struct hid_op_stats *ops[3] = {&stats.Hid.read, &stats.Hid.write, &stats.Hid.get_feature};
+    const char *names[3] = {"read", "write", "get_feature"};
+    printf("hidapi calls\n");
+    for (int i = 0; i < 3; i++){
+        printf("  %-12s calls %10llu  errors %llu  mean %6.1f ns  max %8.1f us\n", names[i],
+               (unsigned long long) ops[i]->calls, (unsigned long long) ops[i]->errors,
+               ops[i]->calls ? (double) ops[i]->total_ns / (double) ops[i]->calls : 0.0, ops[i]->max_ns / 1000.0);
+    }
+}
+
+int main(int argc, char **argv){
+    int reports = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_REPORTS;
+    int rate = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_RATE_HZ;
+    int pacedMs = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_PACED_MS;
+    if (reports <= 0 || rate <= 0 || pacedMs <= 0){
+        fprintf(stderr, "usage: %s [reports] [paced rate hz] [paced duration ms]\n", argv[0]);
+        return 1;
+    }
+
+    WheelApi api;
+    if (api.connect() <= 0){
+        fprintf(stderr, "mock wheel not found, is hidapi_mock.cpp linked?\n");
+        return 1;
+    }
+
+    BenchReads(&api, reports);
+    printf("background reader, unlimited report rate\n");
+    BenchReader(&api, 0, 500);
+    printf("background reader, %d Hz\n", rate);
+    BenchReader(&api, (uint32_t) rate, (uint32_t) pacedMs);
+    BenchWrites(&api, reports);
+    BenchSettings(&api, reports / 100 > 0 ? reports / 100 : 1);
+    PrintStats(&api);
+
+    api.disconnect();
+    printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "coalescing_sender.h"
+
+static_assert(sizeof(DirectControlTypeDef) < sizeof(uint64_t), "Direct control must leave room for pending flag");
+
+static const uint64_t PENDING_FLAG = 1ULL << 63;
+
+static uint64_t PackControl(DirectControlTypeDef control) {
+    uint64_t packed = 0;
+    memcpy(&packed, &control, sizeof(DirectControlTypeDef));
+    return packed | PENDING_FLAG;
+}
+
+static DirectControlTypeDef UnpackControl(uint64_t packed) {
+    DirectControlTypeDef control;
+    memcpy(&control, &packed, sizeof(DirectControlTypeDef));
+    return control;
+}
+
+CoalescingSender::CoalescingSender(WheelApi *api) : api(api) {
+}
+
+CoalescingSender::~CoalescingSender() {
+    stop();
+}
+
+int CoalescingSender::start(){
+    if (running.load(std::memory_order_acquire)){
+        return 1;
+    }
+    running.store(true, std::memory_order_release);
+    sender = std::thread(&CoalescingSender::SenderLoop, this);
+    return 1;
+}
+
+void CoalescingSender::stop(){
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        running.store(false, std::memory_order_release);
+    }
+    wake.notify_one();
+    if (sender.joinable()){
+        sender.join();
+    }
+}
+
+void CoalescingSender::submit(DirectControlTypeDef control){
+    uint64_t previous = pending.exchange(PackControl(control), std::memory_order_acq_rel);
+    if (previous & PENDING_FLAG){
+        // Sender has not picked up previous value yet, it is awake or already notified
+        coalesced.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    {
+        // Empty critical section orders the store against a sender that is about to sleep
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wake.notify_one();
+}
+
+uint64_t CoalescingSender::sentCount() const{
+    return sent.load(std::memory_order_relaxed);
+}
+
+uint64_t CoalescingSender::coalescedCount() const{
+    return coalesced.load(std::memory_order_relaxed);
+}
+
+uint64_t CoalescingSender::failedCount() const{
+    return failed.load(std::memory_order_relaxed);
+}
+
+void CoalescingSender::SenderLoop(){
+    while (running.load(std::memory_order_acquire)){
+        uint64_t value = pending.exchange(0, std::memory_order_acq_rel);
+        if (!(value & PENDING_FLAG)){
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this]{
+                return !running.load(std::memory_order_acquire) ||
+                       (pending.load(std::memory_order_acquire) & PENDING_FLAG);
+            });
+            continue;
+        }
+        // Blocks until the endpoint took the report, values submitted meanwhile collapse into one
+        if (api->sendDirectControl(UnpackControl(value)) > 0){
+            sent.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
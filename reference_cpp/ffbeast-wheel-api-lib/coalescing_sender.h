@@ -0,0 +1,50 @@
+#ifndef COALESCING_SENDER_H
+#define COALESCING_SENDER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "wheel_api.h"
+
+/**
+ * Latest value wins sender for direct control.
+ * Holds a single pending control slot per device. Producers overwrite the slot without locking and sender thread
+ * writes only the newest value each time the endpoint accepts a report, so stale forces are never queued.
+ * While sender is running all direct control for the device must go through submit.
+ * */
+class CoalescingSender
+{
+public:
+    explicit CoalescingSender(WheelApi *api);
+    ~CoalescingSender();
+
+    int start();
+    void stop();
+
+    // Safe to call from any thread at any rate, replaces value that was not sent yet
+    void submit(DirectControlTypeDef control);
+
+    uint64_t sentCount() const; // Reports written to the device
+    uint64_t coalescedCount() const; // Values overwritten before they were sent
+    uint64_t failedCount() const; // Writes that returned an error
+
+private:
+    WheelApi *api;
+
+    // DirectControlTypeDef is 7 bytes, the 8th byte of the slot marks the slot as pending
+    std::atomic<uint64_t> pending{0};
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> failed{0};
+
+    std::thread sender;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    void SenderLoop();
+};
+
+#endif // COALESCING_SENDER_H
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <string.h>
+#include "connection_manager.h"
+
+#ifdef _WIN32
+#include <wchar.h>
+#include <wctype.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "cfgmgr32.lib")
+#endif
+#elif defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <libudev.h>
+#endif
+
+ConnectionManager::ConnectionManager(WheelApi *api) : api(api) {
+}
+
+ConnectionManager::~ConnectionManager() {
+    stop();
+}
+
+int ConnectionManager::start(ConnectionCallback callback, void *context){
+    if (worker.joinable()){
+        return 0;
+    }
+    this->callback = callback;
+    this->context = context;
+    running = true;
+    arrivalPending = !api->isConnected();
+    removalPending = false;
+    restartReader = api->isStateReaderRunning();
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        devicePath = api->getDevicePath();
+    }
+
+#ifdef _WIN32
+    CM_NOTIFY_FILTER filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.cbSize = sizeof(filter);
+    filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    // GUID_DEVINTERFACE_HID, same class hid_enumerate walks
+    filter.u.DeviceInterface.ClassGuid = { 0x4d1e55b2, 0xf16f, 0x11cf, { 0x88, 0xcb, 0x00, 0x11, 0x11, 0x00, 0x00, 0x30 } };
+    if (CM_Register_Notification(&filter, this, &ConnectionManager::OnNotification, &notification) != CR_SUCCESS){
+        running = false;
+        return 0;
+    }
+#elif defined(__linux__)
+    // Monitor is set up here, a failure is reported to the caller instead of ending the monitor thread silently
+    udevContext = udev_new();
+    if (udevContext != NULL){
+        udevMonitor = udev_monitor_new_from_netlink(udevContext, "udev");
+    }
+    if (udevMonitor == NULL || pipe(stopPipe) != 0 ||
+        udev_monitor_filter_add_match_subsystem_devtype(udevMonitor, "hidraw", NULL) < 0 ||
+        udev_monitor_enable_receiving(udevMonitor) < 0){
+        CloseMonitor();
+        running = false;
+        return 0;
+    }
+    monitor = std::thread(&ConnectionManager::MonitorLoop, this);
+#endif
+
+    worker = std::thread(&ConnectionManager::WorkerLoop, this);
+    return 1;
+}
+
+void ConnectionManager::stop(){
+#ifdef _WIN32
+    if (notification != NULL){
+        // Waits for callbacks in progress, must not be called from the callback itself
+        CM_Unregister_Notification(notification);
+        notification = NULL;
+    }
+#elif defined(__linux__)
+    if (stopPipe[1] >= 0){
+        char stop = 0;
+        (void) !write(stopPipe[1], &stop, 1);
+    }
+    if (monitor.joinable()){
+        monitor.join();
+    }
+    CloseMonitor();
+#endif
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        running = false;
+    }
+    eventSignal.notify_one();
+    if (worker.joinable()){
+        worker.join();
+    }
+}
+
+uint64_t ConnectionManager::reconnectCount() const{
+    return reconnects.load(std::memory_order_relaxed);
+}
+
+void ConnectionManager::Notify(bool arrival){
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        if (arrival){
+            arrivalPending = true;
+        } else {
+            removalPending = true;
+        }
+    }
+    eventSignal.notify_one();
+}
+
+bool ConnectionManager::IsDevicePath(const char *path){
+    std::lock_guard<std::mutex> lock(eventMutex);
+    return !devicePath.empty() && strcmp(devicePath.c_str(), path) == 0;
+}
+
+void ConnectionManager::WorkerLoop(){
+    std::unique_lock<std::mutex> lock(eventMutex);
+    while (running){
+        eventSignal.wait(lock, [this]{ return !running || arrivalPending || removalPending; });
+        bool removal = removalPending;
+        bool arrival = arrivalPending;
+        removalPending = false;
+        arrivalPending = false;
+        lock.unlock();
+        // Removal first, quick unplug and replug can deliver both at once
+        if (removal){
+            HandleRemoval();
+        }
+        if (arrival){
+            HandleArrival();
+        }
+        lock.lock();
+    }
+}
+
+void ConnectionManager::HandleRemoval(){
+    if (!api->isConnected()){
+        return;
+    }
+    restartReader = api->isStateReaderRunning();
+    if (callback != nullptr){
+        callback(context, false);
+    }
+    api->disconnect();
+}
+
+void ConnectionManager::HandleArrival(){
+    if (api->isConnected()){
+        return;
+    }
+    // Cached path is tried first, settings cache is refreshed by connect
+    if (!api->connect()){
+        return;
+    }
+    {
+        // Copy taken on this thread, connect may have replaced the path with a freshly enumerated one
+        std::lock_guard<std::mutex> lock(eventMutex);
+        devicePath = api->getDevicePath();
+    }
+    if (restartReader){
+        api->startStateReader();
+    }
+    reconnects.fetch_add(1, std::memory_order_relaxed);
+    if (callback != nullptr){
+        callback(context, true);
+    }
+}
+
+#ifdef _WIN32
+static bool ContainsNoCase(const wchar_t *haystack, const wchar_t *needle) {
+    size_t needleLength = wcslen(needle);
+    for (; *haystack; ++haystack){
+        size_t i = 0;
+        while (i < needleLength && haystack[i] && towlower(haystack[i]) == towlower(needle[i])){
+            ++i;
+        }
+        if (i == needleLength){
+            return true;
+        }
+    }
+    return false;
+}
+
+DWORD CALLBACK ConnectionManager::OnNotification(HCMNOTIFICATION notify, PVOID context, CM_NOTIFY_ACTION action,
+                                                 PCM_NOTIFY_EVENT_DATA eventData, DWORD eventDataSize){
+    (void) notify;
+    (void) eventDataSize;
+    ConnectionManager *manager = (ConnectionManager *) context;
+    const wchar_t *link = eventData->u.DeviceInterface.SymbolicLink;
+
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL){
+        wchar_t needle[32];
+        swprintf(needle, sizeof(needle) / sizeof(needle[0]), L"vid_%04x&pid_%04x&mi_%02x", USB_VID, WHEEL_PID_FS, INTERFACE_VENDOR);
+        if (ContainsNoCase(link, needle)){
+            manager->Notify(true);
+        }
+    } else if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL){
+        wchar_t path[512];
+        {
+            std::lock_guard<std::mutex> lock(manager->eventMutex);
+            swprintf(path, sizeof(path) / sizeof(path[0]), L"%hs", manager->devicePath.c_str());
+        }
+        if (path[0] != 0 && ContainsNoCase(link, path)){
+            manager->Notify(false);
+        }
+    }
+    return ERROR_SUCCESS;
+}
+#elif defined(__linux__)
+static bool IsVendorInterface(struct udev_device *device) {
+    struct udev_device *hid = udev_device_get_parent_with_subsystem_devtype(device, "hid", NULL);
+    struct udev_device *usbInterface = udev_device_get_parent_with_subsystem_devtype(device, "usb", "usb_interface");
+    if (hid == NULL || usbInterface == NULL){
+        return false;
+    }
+    // HID_ID is bus:vendor:product in hex, e.g. 0003:0000045B:000059D7
+    const char *hidId = udev_device_get_property_value(hid, "HID_ID");
+    const char *interfaceNumber = udev_device_get_sysattr_value(usbInterface, "bInterfaceNumber");
+    unsigned int bus, vendor, product;
+    if (hidId == NULL || interfaceNumber == NULL || sscanf(hidId, "%x:%x:%x", &bus, &vendor, &product) != 3){
+        return false;
+    }
+    return vendor == USB_VID && product == WHEEL_PID_FS && strtol(interfaceNumber, NULL, 16) == INTERFACE_VENDOR;
+}
+
+void ConnectionManager::MonitorLoop(){
+    struct pollfd fds[2];
+    fds[0].fd = udev_monitor_get_fd(udevMonitor);
+    fds[0].events = POLLIN;
+    fds[1].fd = stopPipe[0];
+    fds[1].events = POLLIN;
+
+    for (;;){
+        if (poll(fds, 2, -1) < 0){
+            continue;
+        }
+        if (fds[1].revents){
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)){
+            continue;
+        }
+        struct udev_device *device = udev_monitor_receive_device(udevMonitor);
+        if (device == NULL){
+            continue;
+        }
+        const char *action = udev_device_get_action(device);
+        const char *node = udev_device_get_devnode(device);
+        if (action != NULL && strcmp(action, "add") == 0 && IsVendorInterface(device)){
+            Notify(true);
+        } else if (action != NULL && strcmp(action, "remove") == 0 && node != NULL &&
+                   IsDevicePath(node)){
+            // Parents are already gone on removal, match the node of the opened device instead
+            Notify(false);
+        }
+        udev_device_unref(device);
+    }
+}
+
+void ConnectionManager::CloseMonitor(){
+    for (int i = 0; i < 2; ++i){
+        if (stopPipe[i] >= 0){
+            close(stopPipe[i]);
+            stopPipe[i] = -1;
+        }
+    }
+    if (udevMonitor != NULL){
+        udev_monitor_unref(udevMonitor);
+        udevMonitor = nullptr;
+    }
+    if (udevContext != NULL){
+        udev_unref(udevContext);
+        udevContext = nullptr;
+    }
+}
+#endif
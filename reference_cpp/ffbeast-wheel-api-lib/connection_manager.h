@@ -0,0 +1,79 @@
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "wheel_api.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <cfgmgr32.h>
+#elif defined(__linux__)
+struct udev;
+struct udev_monitor;
+#endif
+
+/**
+ * Called on manager thread right before the device is closed (connected = false)
+ * and right after it was opened again (connected = true).
+ * */
+typedef void (*ConnectionCallback)(void *context, bool connected);
+
+/**
+ * Keeps WheelApi connected across unplug and USB glitches.
+ * Subscribes to OS device interface notifications (CM_Register_Notification on Windows, udev on Linux)
+ * instead of polling. On removal of the wheel the api is disconnected, on arrival it is reconnected through
+ * the cached device path, settings cache is refreshed and background state reader is restarted if it was running.
+ * Other threads must not call into the api between callback with connected = false and connected = true.
+ * */
+class ConnectionManager
+{
+public:
+    explicit ConnectionManager(WheelApi *api);
+    ~ConnectionManager();
+
+    // Returns 1 once notifications are subscribed, 0 when already started or subscribing failed
+    int start(ConnectionCallback callback = nullptr, void *context = nullptr);
+    void stop();
+
+    uint64_t reconnectCount() const;
+
+private:
+    WheelApi *api;
+    ConnectionCallback callback = nullptr;
+    void *context = nullptr;
+
+    std::thread worker;
+    std::mutex eventMutex;
+    std::condition_variable eventSignal;
+    bool running = false;
+    bool arrivalPending = false;
+    bool removalPending = false;
+    bool restartReader = false;
+    std::string devicePath; // Path of the opened device, notification threads match removals against it
+    std::atomic<uint64_t> reconnects{0};
+
+#ifdef _WIN32
+    HCMNOTIFICATION notification = NULL;
+    static DWORD CALLBACK OnNotification(HCMNOTIFICATION notify, PVOID context, CM_NOTIFY_ACTION action,
+                                         PCM_NOTIFY_EVENT_DATA eventData, DWORD eventDataSize);
+#elif defined(__linux__)
+    std::thread monitor;
+    int stopPipe[2] = { -1, -1 };
+    struct udev *udevContext = nullptr;
+    struct udev_monitor *udevMonitor = nullptr; // Receiving before start returns, so no event is missed
+    void MonitorLoop();
+    void CloseMonitor();
+#endif
+
+    void Notify(bool arrival);
+    bool IsDevicePath(const char *path);
+    void WorkerLoop();
+    void HandleRemoval();
+    void HandleArrival();
+};
+
+#endif // CONNECTION_MANAGER_H
@@ -0,0 +1,320 @@
+#include "effect_engine.h"
+#include <math.h>
+#include "telemetry_recorder.h"
+
+#define EFFECT_COMMAND_BATCH    16
+#define EFFECT_RATE_INSTANT     1.0e9f // Envelope rate of a zero length attack or fade, reaches full level within 1 ns
+#define EFFECT_TIME_INFINITE    1.0e30f
+
+static inline float Clamp(float value, float low, float high){
+    return value < low ? low : (value > high ? high : value);
+}
+
+// Same as MotionEstimator::pump, with every report also going to the log
+static void RecordStates(WheelApi *api, TelemetryRecorder *recorder, MotionEstimator *estimator){
+    TimestampedStateTypeDef samples[MOTION_PUMP_BATCH];
+    int count;
+    while ((count = api->drainStates(samples, MOTION_PUMP_BATCH)) > 0){
+        for (int i = 0; i < count; i++){
+            recorder->recordState(&samples[i]);
+            estimator->update(&samples[i]);
+        }
+    }
+}
+
+EffectEngine::EffectEngine(WheelApi *api) : api(api){
+    batch.Phase = phase;
+    batch.Elapsed = elapsed;
+    batch.Active = active;
+    batch.Gain = effectGain;
+    batch.Magnitude = magnitude;
+    batch.Offset = offset;
+    batch.RampSlope = rampSlope;
+    batch.Center = center;
+    batch.DeadBand = deadBand;
+    batch.PositiveCoefficient = positiveCoefficient;
+    batch.NegativeCoefficient = negativeCoefficient;
+    batch.Saturation = saturation;
+    batch.AttackLevel = attackLevel;
+    batch.AttackRate = attackRate;
+    batch.FadeLevel = fadeLevel;
+    batch.FadeRate = fadeRate;
+    batch.FadeEnd = fadeEnd;
+    batch.IsSine = isSine;
+    batch.IsSquare = isSquare;
+    batch.IsTriangle = isTriangle;
+    batch.SawtoothSign = sawtoothSign;
+    batch.IsRamp = isRamp;
+    batch.IsPeriodic = isPeriodic;
+    batch.IsCondition = isCondition;
+    batch.UsesPosition = usesPosition;
+    batch.UsesVelocity = usesVelocity;
+    batch.UsesAcceleration = usesAcceleration;
+    batch.UsesDirection = usesDirection;
+    batch.WheelStart = batchBounds;
+    batch.WheelCount = 1;
+}
+
+bool EffectEngine::IsValid(const EffectParamsTypeDef *params){
+    if (params == nullptr || params->Type <= EFFECT_NONE || params->Type > EFFECT_FRICTION){
+        return false;
+    }
+    if (params->Type <= EFFECT_SAWTOOTH_DOWN && params->PeriodNs == 0){
+        return false;
+    }
+    return params->Gain >= 0.0f && params->Gain <= 1.0f;
+}
+
+bool EffectEngine::Queue(CommandTypeEnum type, int id, uint64_t startTime, const EffectParamsTypeDef *params){
+    CommandTypeDef command = {};
+    command.Type = type;
+    command.Id = id;
+    command.StartTime = startTime;
+    if (params != nullptr){
+        command.Params = *params;
+    }
+    return commands.push(command);
+}
+
+int EffectEngine::createEffect(const EffectParamsTypeDef *params){
+    if (!IsValid(params)){
+        return -1;
+    }
+    for (int id = 0; id < EFFECT_ENGINE_MAX_EFFECTS; id++){
+        if (!slotUsed[id]){
+            if (!Queue(COMMAND_UPDATE, id, 0, params)){
+                return -1;
+            }
+            slotUsed[id] = true;
+            return id;
+        }
+    }
+    return -1;
+}
+
+int EffectEngine::updateEffect(int id, const EffectParamsTypeDef *params){
+    if (id < 0 || id >= EFFECT_ENGINE_MAX_EFFECTS || !slotUsed[id]){
+        return 0;
+    }
+    if (!IsValid(params)){
+        return -1;
+    }
+    return Queue(COMMAND_UPDATE, id, 0, params) ? 1 : -1;
+}
+
+int EffectEngine::startEffect(int id, uint64_t startTime){
+    if (id < 0 || id >= EFFECT_ENGINE_MAX_EFFECTS || !slotUsed[id]){
+        return 0;
+    }
+    return Queue(COMMAND_START, id, startTime, nullptr) ? 1 : -1;
+}
+
+int EffectEngine::stopEffect(int id){
+    if (id < 0 || id >= EFFECT_ENGINE_MAX_EFFECTS || !slotUsed[id]){
+        return 0;
+    }
+    return Queue(COMMAND_STOP, id, 0, nullptr) ? 1 : -1;
+}
+
+int EffectEngine::destroyEffect(int id){
+    if (id < 0 || id >= EFFECT_ENGINE_MAX_EFFECTS || !slotUsed[id]){
+        return 0;
+    }
+    if (!Queue(COMMAND_DESTROY, id, 0, nullptr)){
+        return -1;
+    }
+    // Slot can be handed out again right away, commands are applied in order
+    slotUsed[id] = false;
+    return 1;
+}
+
+int EffectEngine::stopAll(){
+    return Queue(COMMAND_STOP_ALL, 0, 0, nullptr) ? 1 : -1;
+}
+
+void EffectEngine::setGain(float gain){
+    pendingGain.store(Clamp(gain, 0.0f, 1.0f), std::memory_order_relaxed);
+}
+
+void EffectEngine::StoreEffect(int id, const EffectParamsTypeDef *params){
+    EffectTypeEnum type = params->Type;
+    float durationSeconds = (float)params->DurationNs * 1.0e-9f;
+
+    stored[id] = true;
+    durationNs[id] = params->DurationNs;
+    periodNs[id] = params->PeriodNs;
+    phaseStart[id] = params->Phase - floorf(params->Phase);
+
+    magnitude[id] = params->Magnitude;
+    offset[id] = params->Offset;
+    rampSlope[id] = params->DurationNs > 0 ? (params->RampEnd - params->Magnitude) / durationSeconds : 0.0f;
+    center[id] = params->Center;
+    deadBand[id] = params->DeadBand;
+    positiveCoefficient[id] = params->PositiveCoefficient;
+    negativeCoefficient[id] = params->NegativeCoefficient;
+    saturation[id] = Clamp(params->Saturation, 0.0f, 1.0f);
+    effectGain[id] = params->Gain;
+
+    const EffectEnvelopeTypeDef *envelope = &params->Envelope;
+    attackLevel[id] = envelope->AttackNs > 0 ? envelope->AttackLevel : 1.0f;
+    attackRate[id] = envelope->AttackNs > 0 ? 1.0e9f / (float)envelope->AttackNs : EFFECT_RATE_INSTANT;
+    bool fades = envelope->FadeNs > 0 && params->DurationNs > 0;
+    fadeLevel[id] = fades ? envelope->FadeLevel : 1.0f;
+    fadeRate[id] = fades ? 1.0e9f / (float)envelope->FadeNs : EFFECT_RATE_INSTANT;
+    fadeEnd[id] = params->DurationNs > 0 ? durationSeconds : EFFECT_TIME_INFINITE;
+
+    isSine[id] = type == EFFECT_SINE ? 1.0f : 0.0f;
+    isSquare[id] = type == EFFECT_SQUARE ? 1.0f : 0.0f;
+    isTriangle[id] = type == EFFECT_TRIANGLE ? 1.0f : 0.0f;
+    sawtoothSign[id] = type == EFFECT_SAWTOOTH_UP ? 1.0f : (type == EFFECT_SAWTOOTH_DOWN ? -1.0f : 0.0f);
+    isRamp[id] = type == EFFECT_RAMP ? 1.0f : 0.0f;
+    isPeriodic[id] = type <= EFFECT_SAWTOOTH_DOWN ? 1.0f : 0.0f;
+    isCondition[id] = type >= EFFECT_SPRING ? 1.0f : 0.0f;
+    usesPosition[id] = type == EFFECT_SPRING ? 1.0f : 0.0f;
+    usesVelocity[id] = type == EFFECT_DAMPER ? 1.0f : 0.0f;
+    usesAcceleration[id] = type == EFFECT_INERTIA ? 1.0f : 0.0f;
+    usesDirection[id] = type == EFFECT_FRICTION ? 1.0f : 0.0f;
+
+    if (id + 1 > usedSlots){
+        usedSlots = id + 1;
+    }
+}
+
+void EffectEngine::ClearEffect(int id){
+    stored[id] = false;
+    running[id] = false;
+    active[id] = 0.0f;
+    while (usedSlots > 0 && !stored[usedSlots - 1]){
+        usedSlots--;
+    }
+}
+
+void EffectEngine::ApplyCommands(uint64_t tickTime){
+    CommandTypeDef pending[EFFECT_COMMAND_BATCH];
+    size_t count;
+    while ((count = commands.drain(pending, EFFECT_COMMAND_BATCH)) > 0){
+        for (size_t i = 0; i < count; i++){
+            const CommandTypeDef *command = &pending[i];
+            switch (command->Type){
+            case COMMAND_UPDATE:
+                // Running effect keeps its start time, so an update does not restart the waveform
+                StoreEffect(command->Id, &command->Params);
+                break;
+            case COMMAND_START:
+                running[command->Id] = stored[command->Id];
+                startTime[command->Id] = command->StartTime != 0 ? command->StartTime : tickTime;
+                break;
+            case COMMAND_STOP:
+                running[command->Id] = false;
+                break;
+            case COMMAND_DESTROY:
+                ClearEffect(command->Id);
+                break;
+            case COMMAND_STOP_ALL:
+                for (int id = 0; id < usedSlots; id++){
+                    running[id] = false;
+                }
+                break;
+            }
+        }
+    }
+    gain = pendingGain.load(std::memory_order_relaxed);
+}
+
+void EffectEngine::evaluate(uint64_t tickTime, const EffectInputTypeDef *input, DirectControlTypeDef *control){
+    ApplyCommands(tickTime);
+    // Kernel works in whole steps, slots past usedSlots are never running so they stay inactive
+    const int count = (usedSlots + EFFECT_KERNEL_WIDTH - 1) / EFFECT_KERNEL_WIDTH * EFFECT_KERNEL_WIDTH;
+
+    // Integer time math per slot, keeps phase exact no matter how long effect has been running
+    for (int i = 0; i < count; i++){
+        int64_t sinceStart = (int64_t)(tickTime - startTime[i]);
+        bool inside = running[i] && sinceStart >= 0;
+        if (inside && durationNs[i] > 0 && (uint64_t)sinceStart >= durationNs[i]){
+            // Finished effects stop by themselves and have to be started again
+            running[i] = false;
+            inside = false;
+        }
+        active[i] = inside ? 1.0f : 0.0f;
+        elapsed[i] = inside ? (float)sinceStart * 1.0e-9f : 0.0f;
+        float p = 0.0f;
+        if (inside && periodNs[i] > 0){
+            p = (float)((double)((uint64_t)sinceStart % periodNs[i]) / (double)periodNs[i]) + phaseStart[i];
+            p = p >= 1.0f ? p - 1.0f : p;
+        }
+        phase[i] = p;
+    }
+
+    EffectWheelInputTypeDef wheel;
+    wheel.Position = input->Position;
+    wheel.Velocity = input->Velocity;
+    wheel.Acceleration = input->Acceleration;
+    wheel.Direction = Clamp(input->Velocity * (1.0f / EFFECT_FRICTION_VELOCITY), -1.0f, 1.0f);
+    wheel.Gain = gain;
+    batchBounds[1] = count;
+
+    EffectWheelOutputTypeDef forces;
+    EvaluateEffectBatch(&batch, &wheel, &forces);
+
+    control->SpringForce = 0;
+    control->ConstantForce = forces.ConstantForce;
+    control->PeriodicForce = forces.PeriodicForce;
+    control->ForceDrop = 0;
+}
+
+bool EffectEngine::tick(uint64_t tickTime, DirectControlTypeDef *control){
+    MotionStateTypeDef motion;
+    if (api != nullptr && recorder != nullptr){
+        RecordStates(api, recorder, &motionEstimator);
+    } else if (api != nullptr){
+        motionEstimator.pump(api);
+    }
+    if (api == nullptr || !motionEstimator.read(&motion)){
+        // Effects still need their commands applied, otherwise queue fills up while disconnected
+        ApplyCommands(tickTime);
+        return false;
+    }
+
+    EffectInputTypeDef input;
+    input.Position = motion.Position;
+    input.Velocity = motion.Velocity;
+    input.Acceleration = motion.Acceleration;
+    uint64_t latency = predictionLatencyNs.load(std::memory_order_relaxed);
+    uint64_t horizon = 0;
+    if (latency != 0){
+        // Report age grows with scheduler phase and reader delay, so it is measured on every tick
+        uint64_t target = tickTime + latency;
+        MotionStateTypeDef predicted;
+        if (target > motion.Timestamp && target - motion.Timestamp <= EFFECT_PREDICTION_MAX_NS &&
+            motionEstimator.predict(target, &predicted)){
+            input.Position = Clamp(predicted.Position, -1.0f, 1.0f);
+            horizon = target - motion.Timestamp;
+        }
+    }
+    predictionHorizon.store(horizon, std::memory_order_relaxed);
+    evaluate(tickTime, &input, control);
+    if (recorder != nullptr){
+        recorder->recordControl(tickTime, control);
+    }
+    return true;
+}
+
+MotionEstimator *EffectEngine::getMotionEstimator(){
+    return &motionEstimator;
+}
+
+void EffectEngine::setRecorder(TelemetryRecorder *recorder){
+    this->recorder = recorder;
+}
+
+void EffectEngine::setPredictionLatency(uint64_t outputLatencyNs){
+    predictionLatencyNs.store(outputLatencyNs, std::memory_order_relaxed);
+}
+
+uint64_t EffectEngine::predictionHorizonNs() const{
+    return predictionHorizon.load(std::memory_order_relaxed);
+}
+
+bool EffectEngine::OnSchedulerTick(void *context, uint64_t tickTime, DirectControlTypeDef *control){
+    return static_cast<EffectEngine *>(context)->tick(tickTime, control);
+}
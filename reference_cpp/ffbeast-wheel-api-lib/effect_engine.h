@@ -0,0 +1,211 @@
+#ifndef EFFECT_ENGINE_H
+#define EFFECT_ENGINE_H
+
+#include <stdint.h>
+#include "effect_kernel.h"
+#include "motion_estimator.h"
+#include "spsc_ring.h"
+#include "wheel_api.h"
+
+#define EFFECT_ENGINE_MAX_EFFECTS       64 // Size of effect pool, evaluation loop always covers used slots only
+#define EFFECT_ENGINE_COMMAND_CAPACITY  128 // Pending create, update, start and stop commands from game thread
+#define EFFECT_FRICTION_VELOCITY        0.05f // Velocity in normalized units per second where friction reaches full force
+#define EFFECT_PREDICTION_MAX_NS        20000000ULL // Longest extrapolation, an older estimate is used as it is
+
+class TelemetryRecorder;
+
+typedef enum {
+    EFFECT_NONE = 0,
+    EFFECT_SINE,
+    EFFECT_SQUARE,
+    EFFECT_TRIANGLE,
+    EFFECT_SAWTOOTH_UP,
+    EFFECT_SAWTOOTH_DOWN,
+    EFFECT_RAMP,
+    EFFECT_SPRING,
+    EFFECT_DAMPER,
+    EFFECT_INERTIA,
+    EFFECT_FRICTION,
+} EffectTypeEnum;
+
+/**
+ * Magnitude envelope applied to every effect type.
+ * Levels are fractions of the effect magnitude, times are in nanoseconds. Fade only applies when effect has duration.
+ * */
+typedef struct {
+    float AttackLevel; // Level at start of effect, rises linearly to 1 over AttackNs
+    uint64_t AttackNs;
+    float FadeLevel; // Level at end of effect, reached linearly over last FadeNs of duration
+    uint64_t FadeNs;
+} EffectEnvelopeTypeDef;
+
+/**
+ * Effect description, all forces use normalized range -1 to +1 of full torque.
+ * Periodic: Magnitude, Offset, PeriodNs, Phase. Ramp: Magnitude at start and RampEnd at end of DurationNs.
+ * Conditions (spring, damper, inertia, friction): Center, DeadBand, coefficients and Saturation.
+ * Spring input is position, damper velocity per second, inertia acceleration per second squared, friction direction of motion.
+ * */
+typedef struct {
+    EffectTypeEnum Type;
+    float Gain; // 0 to 1, scales whole effect
+    uint64_t DurationNs; // 0 runs until stopped
+
+    float Magnitude;
+    float Offset;
+    float RampEnd;
+    uint64_t PeriodNs;
+    float Phase; // 0 to 1 of period
+
+    float Center;
+    float DeadBand; // Half width of zone around center (or zero motion) without force
+    float PositiveCoefficient; // Force per unit of input above dead band
+    float NegativeCoefficient; // Force per unit of input below dead band
+    float Saturation; // 0 to 1, largest absolute force of condition
+
+    EffectEnvelopeTypeDef Envelope;
+} EffectParamsTypeDef;
+
+// Wheel motion used by condition effects, normalized position range -1 to +1
+typedef struct {
+    float Position;
+    float Velocity;
+    float Acceleration;
+} EffectInputTypeDef;
+
+/**
+ * Host side effect engine. Effects live in a fixed pool stored as structure of arrays, so one tick is a single
+ * branch free pass of EvaluateEffectBatch over the used slots. Periodic effects are summed into
+ * PeriodicForce, everything else into ConstantForce.
+ *
+ * createEffect, updateEffect, startEffect, stopEffect and destroyEffect are called from one game thread.
+ * They only queue commands, evaluate applies them at the start of the next tick on the scheduler thread,
+ * so neither side ever locks. Pass OnSchedulerTick with the engine as context to ForceScheduler.
+ * */
+class EffectEngine
+{
+public:
+    explicit EffectEngine(WheelApi *api = nullptr);
+
+    // Returns effect id, -1 when pool or command queue is full or params are invalid
+    int createEffect(const EffectParamsTypeDef *params);
+    // Returns 1 when queued, 0 when id is unknown, -1 when params are invalid or command queue is full
+    int updateEffect(int id, const EffectParamsTypeDef *params);
+    // startTime is in HostClockNanoseconds units, 0 starts on next tick
+    int startEffect(int id, uint64_t startTime = 0);
+    int stopEffect(int id);
+    int destroyEffect(int id);
+    int stopAll();
+
+    // 0 to 1, applied to the summed output
+    void setGain(float gain);
+
+    // Scheduler side. Applies queued commands and writes summed forces of running effects to control.
+    void evaluate(uint64_t tickTime, const EffectInputTypeDef *input, DirectControlTypeDef *control);
+    // Feeds reports queued by the api into motion estimator and evaluates at the filtered motion.
+    // Engine becomes the consumer of drainStates. Returns false until first state arrives.
+    bool tick(uint64_t tickTime, DirectControlTypeDef *control);
+    // Estimator used by tick, for tuning and for reading the same motion from other threads
+    MotionEstimator *getMotionEstimator();
+    // Every state tick consumes and every control it produces go to recorder, nullptr stops recording.
+    // Set before the scheduler starts or while it is stopped.
+    void setRecorder(TelemetryRecorder *recorder);
+    /**
+     * Latency compensation for tick. Position dependent forces (spring, and stops built from spring dead band)
+     * are evaluated at the position the wheel will have when the force reaches the motor instead of where it was
+     * in the last report. Estimate is extrapolated from the report time over the age of the report plus
+     * outputLatencyNs, the write to torque latency measured with latency_harness. 0 disables, which is default.
+     * Velocity and acceleration inputs stay filtered, extrapolating them only amplifies noise.
+     * Safe to call from any thread.
+     * */
+    void setPredictionLatency(uint64_t outputLatencyNs);
+    // Extrapolation used by last tick, 0 when disabled or estimate was too old to extrapolate
+    uint64_t predictionHorizonNs() const;
+    // ForceCallback compatible wrapper around tick, context is the engine
+    static bool OnSchedulerTick(void *context, uint64_t tickTime, DirectControlTypeDef *control);
+
+private:
+    typedef enum {
+        COMMAND_UPDATE = 0,
+        COMMAND_START,
+        COMMAND_STOP,
+        COMMAND_DESTROY,
+        COMMAND_STOP_ALL,
+    } CommandTypeEnum;
+
+    typedef struct {
+        CommandTypeEnum Type;
+        int Id;
+        uint64_t StartTime;
+        EffectParamsTypeDef Params;
+    } CommandTypeDef;
+
+    WheelApi *api;
+
+    // Game thread side
+    bool slotUsed[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    SpscRing<CommandTypeDef, EFFECT_ENGINE_COMMAND_CAPACITY> commands;
+    std::atomic<float> pendingGain{1.0f};
+
+    // Scheduler thread side, one entry per slot
+    int usedSlots = 0; // One past highest slot that ever held an effect
+    float gain = 1.0f;
+    uint64_t startTime[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    uint64_t durationNs[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    uint64_t periodNs[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    float phaseStart[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    bool stored[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    bool running[EFFECT_ENGINE_MAX_EFFECTS] = {};
+
+    // Per tick inputs of the evaluation loop, filled from times above
+    alignas(64) float elapsed[EFFECT_ENGINE_MAX_EFFECTS] = {}; // Seconds since start
+    alignas(64) float phase[EFFECT_ENGINE_MAX_EFFECTS] = {}; // 0 to 1 of period
+    alignas(64) float active[EFFECT_ENGINE_MAX_EFFECTS] = {}; // 1 when running and inside duration
+
+    // Effect parameters
+    alignas(64) float magnitude[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float offset[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float rampSlope[EFFECT_ENGINE_MAX_EFFECTS] = {}; // Change of ramp level per second
+    alignas(64) float center[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float deadBand[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float positiveCoefficient[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float negativeCoefficient[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float saturation[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float effectGain[EFFECT_ENGINE_MAX_EFFECTS] = {};
+
+    // Envelope, times as reciprocal seconds so loop multiplies instead of divides
+    alignas(64) float attackLevel[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float attackRate[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float fadeLevel[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float fadeRate[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float fadeEnd[EFFECT_ENGINE_MAX_EFFECTS] = {}; // Duration in seconds, very large when infinite
+
+    // One hot selectors replacing a switch on type inside the loop
+    alignas(64) float isSine[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float isSquare[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float isTriangle[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float sawtoothSign[EFFECT_ENGINE_MAX_EFFECTS] = {}; // +1 up, -1 down, 0 other
+    alignas(64) float isRamp[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float isPeriodic[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float isCondition[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float usesPosition[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float usesVelocity[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float usesAcceleration[EFFECT_ENGINE_MAX_EFFECTS] = {};
+    alignas(64) float usesDirection[EFFECT_ENGINE_MAX_EFFECTS] = {};
+
+    // Points at the arrays above, evaluated as a single wheel by EvaluateEffectBatch
+    EffectBatchTypeDef batch;
+    int batchBounds[2] = {};
+
+    MotionEstimator motionEstimator;
+    TelemetryRecorder *recorder = nullptr;
+    std::atomic<uint64_t> predictionLatencyNs{0};
+    std::atomic<uint64_t> predictionHorizon{0};
+
+    static bool IsValid(const EffectParamsTypeDef *params);
+    bool Queue(CommandTypeEnum type, int id, uint64_t startTime, const EffectParamsTypeDef *params);
+    void ApplyCommands(uint64_t tickTime);
+    void StoreEffect(int id, const EffectParamsTypeDef *params);
+    void ClearEffect(int id);
+};
+
+#endif // EFFECT_ENGINE_H
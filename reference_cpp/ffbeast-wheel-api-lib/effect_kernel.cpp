@@ -0,0 +1,339 @@
+#include "effect_kernel.h"
+#include <math.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define EFFECT_KERNEL_HAS_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define EFFECT_KERNEL_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef void (*BatchFunction)(const EffectBatchTypeDef *batch, const EffectWheelInputTypeDef *inputs,
+                              EffectWheelOutputTypeDef *outputs);
+
+static inline float Clamp(float value, float low, float high){
+    return value < low ? low : (value > high ? high : value);
+}
+
+static inline int16_t SaturateForce(float value){
+    // NaN passes both comparisons of Clamp, converting it to int16 is undefined
+    if (!(value == value)){
+        value = 0.0f;
+    }
+    return (int16_t)(Clamp(value, -1.0f, 1.0f) * 10000.0f);
+}
+
+static void StoreWheel(EffectWheelOutputTypeDef *output, const EffectWheelInputTypeDef *input,
+                       float constantSum, float periodicSum){
+    output->ConstantForce = SaturateForce(constantSum * input->Gain);
+    output->PeriodicForce = SaturateForce(periodicSum * input->Gain);
+}
+
+static void EvaluateScalar(const EffectBatchTypeDef *b, const EffectWheelInputTypeDef *inputs,
+                           EffectWheelOutputTypeDef *outputs){
+    for (int w = 0; w < b->WheelCount; w++){
+        const EffectWheelInputTypeDef *in = &inputs[w];
+        float constantSum = 0.0f;
+        float periodicSum = 0.0f;
+
+        for (int i = b->WheelStart[w]; i < b->WheelStart[w + 1]; i++){
+            float p = b->Phase[i];
+            float t = b->Elapsed[i];
+
+            // Sine as corrected parabola, error below 0.1 %, same arithmetic as the vector kernels
+            float s = 2.0f * p - 1.0f;
+            float y = 4.0f * s * (1.0f - fabsf(s));
+            float sine = -(0.225f * (y * fabsf(y) - y) + y);
+            float square = p < 0.5f ? 1.0f : -1.0f;
+            float q = p + 0.25f;
+            q = q >= 1.0f ? q - 1.0f : q;
+            float triangle = 1.0f - 4.0f * fabsf(q - 0.5f);
+            float sawtooth = 2.0f * p - 1.0f;
+            float wave = b->IsSine[i] * sine + b->IsSquare[i] * square + b->IsTriangle[i] * triangle
+                       + b->SawtoothSign[i] * sawtooth;
+
+            float attack = fminf(t * b->AttackRate[i], 1.0f);
+            float fade = Clamp((b->FadeEnd[i] - t) * b->FadeRate[i], 0.0f, 1.0f);
+            float envelope = b->AttackLevel[i] + (1.0f - b->AttackLevel[i]) * attack
+                           + b->FadeLevel[i] + (1.0f - b->FadeLevel[i]) * fade - 1.0f;
+
+            float periodic = b->Offset[i] + envelope * b->Magnitude[i] * wave;
+            float ramp = envelope * (b->Magnitude[i] + b->RampSlope[i] * t);
+
+            float x = b->UsesPosition[i] * in->Position + b->UsesVelocity[i] * in->Velocity
+                    + b->UsesAcceleration[i] * in->Acceleration + b->UsesDirection[i] * in->Direction - b->Center[i];
+            float above = fmaxf(x - b->DeadBand[i], 0.0f);
+            float below = fminf(x + b->DeadBand[i], 0.0f);
+            float condition = -(b->PositiveCoefficient[i] * above + b->NegativeCoefficient[i] * below);
+            condition = envelope * Clamp(condition, -b->Saturation[i], b->Saturation[i]);
+
+            float value = b->Active[i] * b->Gain[i]
+                        * (b->IsPeriodic[i] * periodic + b->IsRamp[i] * ramp + b->IsCondition[i] * condition);
+            // Effect gone NaN (bad parameter or estimator output) is dropped instead of poisoning the whole wheel
+            value = value == value ? value : 0.0f;
+            periodicSum += b->IsPeriodic[i] * value;
+            constantSum += (1.0f - b->IsPeriodic[i]) * value;
+        }
+        StoreWheel(&outputs[w], in, constantSum, periodicSum);
+    }
+}
+
+#ifdef EFFECT_KERNEL_HAS_AVX2
+AVX2_TARGET static inline float HorizontalSum(__m256 v){
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+AVX2_TARGET static void EvaluateAvx2(const EffectBatchTypeDef *b, const EffectWheelInputTypeDef *inputs,
+                                     EffectWheelOutputTypeDef *outputs){
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 correction = _mm256_set1_ps(0.225f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    for (int w = 0; w < b->WheelCount; w++){
+        const EffectWheelInputTypeDef *in = &inputs[w];
+        const __m256 position = _mm256_set1_ps(in->Position);
+        const __m256 velocity = _mm256_set1_ps(in->Velocity);
+        const __m256 acceleration = _mm256_set1_ps(in->Acceleration);
+        const __m256 direction = _mm256_set1_ps(in->Direction);
+        __m256 constantSum = zero;
+        __m256 periodicSum = zero;
+
+        for (int i = b->WheelStart[w]; i < b->WheelStart[w + 1]; i += EFFECT_KERNEL_WIDTH){
+            __m256 p = _mm256_load_ps(b->Phase + i);
+            __m256 t = _mm256_load_ps(b->Elapsed + i);
+
+            __m256 s = _mm256_sub_ps(_mm256_mul_ps(two, p), one);
+            __m256 y = _mm256_mul_ps(_mm256_mul_ps(four, s), _mm256_sub_ps(one, _mm256_and_ps(s, absMask)));
+            y = _mm256_add_ps(_mm256_mul_ps(correction, _mm256_sub_ps(_mm256_mul_ps(y, _mm256_and_ps(y, absMask)), y)), y);
+            __m256 sine = _mm256_sub_ps(zero, y);
+            __m256 square = _mm256_blendv_ps(_mm256_sub_ps(zero, one), one, _mm256_cmp_ps(p, half, _CMP_LT_OQ));
+            __m256 q = _mm256_add_ps(p, quarter);
+            q = _mm256_blendv_ps(q, _mm256_sub_ps(q, one), _mm256_cmp_ps(q, one, _CMP_GE_OQ));
+            __m256 triangle = _mm256_sub_ps(one, _mm256_mul_ps(four, _mm256_and_ps(_mm256_sub_ps(q, half), absMask)));
+            __m256 sawtooth = _mm256_sub_ps(_mm256_mul_ps(two, p), one);
+            __m256 wave = _mm256_mul_ps(_mm256_load_ps(b->IsSine + i), sine);
+            wave = _mm256_add_ps(wave, _mm256_mul_ps(_mm256_load_ps(b->IsSquare + i), square));
+            wave = _mm256_add_ps(wave, _mm256_mul_ps(_mm256_load_ps(b->IsTriangle + i), triangle));
+            wave = _mm256_add_ps(wave, _mm256_mul_ps(_mm256_load_ps(b->SawtoothSign + i), sawtooth));
+
+            __m256 attackLevel = _mm256_load_ps(b->AttackLevel + i);
+            __m256 fadeLevel = _mm256_load_ps(b->FadeLevel + i);
+            __m256 attack = _mm256_min_ps(_mm256_mul_ps(t, _mm256_load_ps(b->AttackRate + i)), one);
+            __m256 fade = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(b->FadeEnd + i), t), _mm256_load_ps(b->FadeRate + i));
+            fade = _mm256_min_ps(_mm256_max_ps(fade, zero), one);
+            __m256 envelope = _mm256_add_ps(attackLevel, _mm256_mul_ps(_mm256_sub_ps(one, attackLevel), attack));
+            envelope = _mm256_add_ps(envelope, fadeLevel);
+            envelope = _mm256_add_ps(envelope, _mm256_mul_ps(_mm256_sub_ps(one, fadeLevel), fade));
+            envelope = _mm256_sub_ps(envelope, one);
+
+            __m256 magnitude = _mm256_load_ps(b->Magnitude + i);
+            __m256 periodic = _mm256_add_ps(_mm256_load_ps(b->Offset + i), _mm256_mul_ps(_mm256_mul_ps(envelope, magnitude), wave));
+            __m256 ramp = _mm256_mul_ps(envelope, _mm256_add_ps(magnitude, _mm256_mul_ps(_mm256_load_ps(b->RampSlope + i), t)));
+
+            __m256 x = _mm256_mul_ps(_mm256_load_ps(b->UsesPosition + i), position);
+            x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_load_ps(b->UsesVelocity + i), velocity));
+            x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_load_ps(b->UsesAcceleration + i), acceleration));
+            x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_load_ps(b->UsesDirection + i), direction));
+            x = _mm256_sub_ps(x, _mm256_load_ps(b->Center + i));
+            __m256 deadBand = _mm256_load_ps(b->DeadBand + i);
+            __m256 above = _mm256_max_ps(_mm256_sub_ps(x, deadBand), zero);
+            __m256 below = _mm256_min_ps(_mm256_add_ps(x, deadBand), zero);
+            __m256 condition = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(b->PositiveCoefficient + i), above),
+                                             _mm256_mul_ps(_mm256_load_ps(b->NegativeCoefficient + i), below));
+            condition = _mm256_sub_ps(zero, condition);
+            __m256 saturation = _mm256_load_ps(b->Saturation + i);
+            condition = _mm256_min_ps(_mm256_max_ps(condition, _mm256_sub_ps(zero, saturation)), saturation);
+            condition = _mm256_mul_ps(envelope, condition);
+
+            __m256 isPeriodic = _mm256_load_ps(b->IsPeriodic + i);
+            __m256 level = _mm256_mul_ps(isPeriodic, periodic);
+            level = _mm256_add_ps(level, _mm256_mul_ps(_mm256_load_ps(b->IsRamp + i), ramp));
+            level = _mm256_add_ps(level, _mm256_mul_ps(_mm256_load_ps(b->IsCondition + i), condition));
+            __m256 value = _mm256_mul_ps(_mm256_mul_ps(_mm256_load_ps(b->Active + i), _mm256_load_ps(b->Gain + i)), level);
+            value = _mm256_and_ps(value, _mm256_cmp_ps(value, value, _CMP_ORD_Q));
+            periodicSum = _mm256_add_ps(periodicSum, _mm256_mul_ps(isPeriodic, value));
+            constantSum = _mm256_add_ps(constantSum, _mm256_mul_ps(_mm256_sub_ps(one, isPeriodic), value));
+        }
+        StoreWheel(&outputs[w], in, HorizontalSum(constantSum), HorizontalSum(periodicSum));
+    }
+}
+
+static bool CpuHasAvx2(){
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesAvx && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // EFFECT_KERNEL_HAS_AVX2
+
+#ifdef EFFECT_KERNEL_HAS_NEON
+static void EvaluateNeon(const EffectBatchTypeDef *b, const EffectWheelInputTypeDef *inputs,
+                         EffectWheelOutputTypeDef *outputs){
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t minusOne = vdupq_n_f32(-1.0f);
+    const float32x4_t two = vdupq_n_f32(2.0f);
+    const float32x4_t four = vdupq_n_f32(4.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t quarter = vdupq_n_f32(0.25f);
+    const float32x4_t correction = vdupq_n_f32(0.225f);
+
+    for (int w = 0; w < b->WheelCount; w++){
+        const EffectWheelInputTypeDef *in = &inputs[w];
+        const float32x4_t position = vdupq_n_f32(in->Position);
+        const float32x4_t velocity = vdupq_n_f32(in->Velocity);
+        const float32x4_t acceleration = vdupq_n_f32(in->Acceleration);
+        const float32x4_t direction = vdupq_n_f32(in->Direction);
+        float32x4_t constantSum = zero;
+        float32x4_t periodicSum = zero;
+
+        // Four lanes per step, segments padded to EFFECT_KERNEL_WIDTH are a multiple of four as well
+        for (int i = b->WheelStart[w]; i < b->WheelStart[w + 1]; i += 4){
+            float32x4_t p = vld1q_f32(b->Phase + i);
+            float32x4_t t = vld1q_f32(b->Elapsed + i);
+
+            float32x4_t s = vsubq_f32(vmulq_f32(two, p), one);
+            float32x4_t y = vmulq_f32(vmulq_f32(four, s), vsubq_f32(one, vabsq_f32(s)));
+            y = vaddq_f32(vmulq_f32(correction, vsubq_f32(vmulq_f32(y, vabsq_f32(y)), y)), y);
+            float32x4_t sine = vnegq_f32(y);
+            float32x4_t square = vbslq_f32(vcltq_f32(p, half), one, minusOne);
+            float32x4_t q = vaddq_f32(p, quarter);
+            q = vbslq_f32(vcgeq_f32(q, one), vsubq_f32(q, one), q);
+            float32x4_t triangle = vsubq_f32(one, vmulq_f32(four, vabsq_f32(vsubq_f32(q, half))));
+            float32x4_t sawtooth = vsubq_f32(vmulq_f32(two, p), one);
+            float32x4_t wave = vmulq_f32(vld1q_f32(b->IsSine + i), sine);
+            wave = vaddq_f32(wave, vmulq_f32(vld1q_f32(b->IsSquare + i), square));
+            wave = vaddq_f32(wave, vmulq_f32(vld1q_f32(b->IsTriangle + i), triangle));
+            wave = vaddq_f32(wave, vmulq_f32(vld1q_f32(b->SawtoothSign + i), sawtooth));
+
+            float32x4_t attackLevel = vld1q_f32(b->AttackLevel + i);
+            float32x4_t fadeLevel = vld1q_f32(b->FadeLevel + i);
+            float32x4_t attack = vminq_f32(vmulq_f32(t, vld1q_f32(b->AttackRate + i)), one);
+            float32x4_t fade = vmulq_f32(vsubq_f32(vld1q_f32(b->FadeEnd + i), t), vld1q_f32(b->FadeRate + i));
+            fade = vminq_f32(vmaxq_f32(fade, zero), one);
+            float32x4_t envelope = vaddq_f32(attackLevel, vmulq_f32(vsubq_f32(one, attackLevel), attack));
+            envelope = vaddq_f32(envelope, fadeLevel);
+            envelope = vaddq_f32(envelope, vmulq_f32(vsubq_f32(one, fadeLevel), fade));
+            envelope = vsubq_f32(envelope, one);
+
+            float32x4_t magnitude = vld1q_f32(b->Magnitude + i);
+            float32x4_t periodic = vaddq_f32(vld1q_f32(b->Offset + i), vmulq_f32(vmulq_f32(envelope, magnitude), wave));
+            float32x4_t ramp = vmulq_f32(envelope, vaddq_f32(magnitude, vmulq_f32(vld1q_f32(b->RampSlope + i), t)));
+
+            float32x4_t x = vmulq_f32(vld1q_f32(b->UsesPosition + i), position);
+            x = vaddq_f32(x, vmulq_f32(vld1q_f32(b->UsesVelocity + i), velocity));
+            x = vaddq_f32(x, vmulq_f32(vld1q_f32(b->UsesAcceleration + i), acceleration));
+            x = vaddq_f32(x, vmulq_f32(vld1q_f32(b->UsesDirection + i), direction));
+            x = vsubq_f32(x, vld1q_f32(b->Center + i));
+            float32x4_t deadBand = vld1q_f32(b->DeadBand + i);
+            float32x4_t above = vmaxq_f32(vsubq_f32(x, deadBand), zero);
+            float32x4_t below = vminq_f32(vaddq_f32(x, deadBand), zero);
+            float32x4_t condition = vaddq_f32(vmulq_f32(vld1q_f32(b->PositiveCoefficient + i), above),
+                                              vmulq_f32(vld1q_f32(b->NegativeCoefficient + i), below));
+            condition = vnegq_f32(condition);
+            float32x4_t saturation = vld1q_f32(b->Saturation + i);
+            condition = vminq_f32(vmaxq_f32(condition, vnegq_f32(saturation)), saturation);
+            condition = vmulq_f32(envelope, condition);
+
+            float32x4_t isPeriodic = vld1q_f32(b->IsPeriodic + i);
+            float32x4_t level = vmulq_f32(isPeriodic, periodic);
+            level = vaddq_f32(level, vmulq_f32(vld1q_f32(b->IsRamp + i), ramp));
+            level = vaddq_f32(level, vmulq_f32(vld1q_f32(b->IsCondition + i), condition));
+            float32x4_t value = vmulq_f32(vmulq_f32(vld1q_f32(b->Active + i), vld1q_f32(b->Gain + i)), level);
+            value = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(value), vceqq_f32(value, value)));
+            periodicSum = vaddq_f32(periodicSum, vmulq_f32(isPeriodic, value));
+            constantSum = vaddq_f32(constantSum, vmulq_f32(vsubq_f32(one, isPeriodic), value));
+        }
+        StoreWheel(&outputs[w], in, vaddvq_f32(constantSum), vaddvq_f32(periodicSum));
+    }
+}
+#endif // EFFECT_KERNEL_HAS_NEON
+
+static std::atomic<BatchFunction> batchFunction{nullptr};
+static std::atomic<int> activeKernel{EFFECT_KERNEL_SCALAR};
+
+static EffectKernelEnum BestKernel(){
+#ifdef EFFECT_KERNEL_HAS_AVX2
+    if (CpuHasAvx2()){
+        return EFFECT_KERNEL_AVX2;
+    }
+#endif
+#ifdef EFFECT_KERNEL_HAS_NEON
+    // Advanced SIMD is mandatory on 64 bit ARM
+    return EFFECT_KERNEL_NEON;
+#endif
+    return EFFECT_KERNEL_SCALAR;
+}
+
+EffectKernelEnum SelectEffectKernel(EffectKernelEnum kernel){
+    EffectKernelEnum best = BestKernel();
+    if (kernel == EFFECT_KERNEL_AUTO || (kernel != EFFECT_KERNEL_SCALAR && kernel != best)){
+        kernel = kernel == EFFECT_KERNEL_AUTO ? best : EFFECT_KERNEL_SCALAR;
+    }
+
+    BatchFunction function = EvaluateScalar;
+#ifdef EFFECT_KERNEL_HAS_AVX2
+    if (kernel == EFFECT_KERNEL_AVX2){
+        function = EvaluateAvx2;
+    }
+#endif
+#ifdef EFFECT_KERNEL_HAS_NEON
+    if (kernel == EFFECT_KERNEL_NEON){
+        function = EvaluateNeon;
+    }
+#endif
+    activeKernel.store(kernel, std::memory_order_relaxed);
+    batchFunction.store(function, std::memory_order_release);
+    return kernel;
+}
+
+EffectKernelEnum ActiveEffectKernel(){
+    if (batchFunction.load(std::memory_order_acquire) == nullptr){
+        SelectEffectKernel(EFFECT_KERNEL_AUTO);
+    }
+    return (EffectKernelEnum)activeKernel.load(std::memory_order_relaxed);
+}
+
+const char *EffectKernelName(EffectKernelEnum kernel){
+    switch (kernel){
+    case EFFECT_KERNEL_AUTO: return "auto";
+    case EFFECT_KERNEL_SCALAR: return "scalar";
+    case EFFECT_KERNEL_AVX2: return "avx2";
+    case EFFECT_KERNEL_NEON: return "neon";
+    }
+    return "unknown";
+}
+
+void EvaluateEffectBatch(const EffectBatchTypeDef *batch, const EffectWheelInputTypeDef *inputs,
+                         EffectWheelOutputTypeDef *outputs){
+    BatchFunction function = batchFunction.load(std::memory_order_acquire);
+    if (function == nullptr){
+        SelectEffectKernel(EFFECT_KERNEL_AUTO);
+        function = batchFunction.load(std::memory_order_acquire);
+    }
+    function(batch, inputs, outputs);
+}
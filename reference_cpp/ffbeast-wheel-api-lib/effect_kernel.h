@@ -0,0 +1,86 @@
+#ifndef EFFECT_KERNEL_H
+#define EFFECT_KERNEL_H
+
+#include <stdint.h>
+
+#define EFFECT_KERNEL_WIDTH     8 // Lanes per step, every wheel segment is padded to a multiple of this
+#define EFFECT_KERNEL_ALIGNMENT 32 // Required alignment of every array in the batch
+
+typedef enum {
+    EFFECT_KERNEL_AUTO = 0, // Best kernel supported by the CPU, picked once at first use
+    EFFECT_KERNEL_SCALAR,
+    EFFECT_KERNEL_AVX2,
+    EFFECT_KERNEL_NEON,
+} EffectKernelEnum;
+
+/**
+ * Effects of several wheels as structure of arrays, values as prepared by EffectEngine.
+ * Effects of wheel w occupy [WheelStart[w], WheelStart[w + 1]), every boundary is a multiple of EFFECT_KERNEL_WIDTH
+ * and padding lanes have Active set to 0. Selectors are 1 or 0 (SawtoothSign +1, -1 or 0) and replace a switch on type.
+ * */
+typedef struct {
+    const float *Phase; // 0 to 1 of period
+    const float *Elapsed; // Seconds since start
+    const float *Active;
+    const float *Gain;
+
+    const float *Magnitude;
+    const float *Offset;
+    const float *RampSlope;
+    const float *Center;
+    const float *DeadBand;
+    const float *PositiveCoefficient;
+    const float *NegativeCoefficient;
+    const float *Saturation;
+
+    const float *AttackLevel;
+    const float *AttackRate;
+    const float *FadeLevel;
+    const float *FadeRate;
+    const float *FadeEnd;
+
+    const float *IsSine;
+    const float *IsSquare;
+    const float *IsTriangle;
+    const float *SawtoothSign;
+    const float *IsRamp;
+    const float *IsPeriodic;
+    const float *IsCondition;
+    const float *UsesPosition;
+    const float *UsesVelocity;
+    const float *UsesAcceleration;
+    const float *UsesDirection;
+
+    const int *WheelStart; // WheelCount + 1 entries
+    int WheelCount;
+} EffectBatchTypeDef;
+
+// Motion and output gain of one wheel, Direction is signed motion -1 to +1 used by friction
+typedef struct {
+    float Position;
+    float Velocity;
+    float Acceleration;
+    float Direction;
+    float Gain;
+} EffectWheelInputTypeDef;
+
+// Summed forces of one wheel in DirectControlTypeDef units, saturated to -10000 to +10000
+typedef struct {
+    int16_t ConstantForce;
+    int16_t PeriodicForce;
+} EffectWheelOutputTypeDef;
+
+/**
+ * Evaluates every effect of every wheel in one pass, inputs and outputs hold WheelCount entries.
+ * Periodic effects go to PeriodicForce, ramps and conditions to ConstantForce.
+ * An effect evaluating to NaN adds nothing, a NaN wheel gain outputs 0, same in every kernel.
+ * */
+void EvaluateEffectBatch(const EffectBatchTypeDef *batch, const EffectWheelInputTypeDef *inputs,
+                         EffectWheelOutputTypeDef *outputs);
+
+// Forces a kernel, returns the kernel now in use. Unsupported choices fall back to scalar.
+EffectKernelEnum SelectEffectKernel(EffectKernelEnum kernel);
+EffectKernelEnum ActiveEffectKernel();
+const char *EffectKernelName(EffectKernelEnum kernel);
+
+#endif // EFFECT_KERNEL_H
@@ -0,0 +1,267 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include "wheel_api.h"
+
+#define FIXED_POINT_ONE         10000 // Raw value of 1.0, scale of every force, position and torque the device uses
+#define FIXED_POINT_PERCENT     100 // Raw units in one percent, scale of ForceDrop
+#define FIXED_FORCE_MAX         10000 // Largest magnitude of a direct control force channel
+#define FIXED_FORCE_DROP_MAX    100
+
+/**
+ * Signed number in 1/10000 units held in 32 bits, so values of reports are used as they are and never go through
+ * float. Every operation saturates at the int32 limits instead of wrapping and rounds half away from zero, results
+ * depend on integer arithmetic only and are bit identical on every host, compiler and optimization level.
+ * Values beyond +-1 are legal (gains, coefficients), device range is applied when converting to a report.
+ * Everything is constexpr, so effect tables and constants can be built at compile time.
+ * */
+class FixedPoint
+{
+public:
+    constexpr FixedPoint() : raw(0){
+    }
+
+    static constexpr FixedPoint fromRaw(int32_t raw){
+        return FixedPoint(raw);
+    }
+
+    static constexpr FixedPoint fromInt(int32_t value){
+        return FixedPoint(Saturate((int64_t) value * FIXED_POINT_ONE));
+    }
+
+    static constexpr FixedPoint fromPercent(int32_t percent){
+        return FixedPoint(Saturate((int64_t) percent * FIXED_POINT_PERCENT));
+    }
+
+    // numerator / denominator rounded to nearest unit, 0 denominator saturates towards sign of numerator
+    static constexpr FixedPoint ratio(int64_t numerator, int64_t denominator){
+        return denominator == 0 ? FixedPoint(numerator == 0 ? 0 : (numerator > 0 ? INT32_MAX : INT32_MIN))
+                                : FixedPoint(Saturate(RoundedDivide(Saturate64(numerator, FIXED_POINT_ONE), denominator)));
+    }
+
+    // For setup code and constants, keep it out of the per sample path
+    static constexpr FixedPoint fromFloat(double value){
+        return FixedPoint(value * FIXED_POINT_ONE >= 2147483647.0 ? INT32_MAX
+                        : value * FIXED_POINT_ONE <= -2147483648.0 ? INT32_MIN
+                        : (int32_t) (value >= 0 ? value * FIXED_POINT_ONE + 0.5 : value * FIXED_POINT_ONE - 0.5));
+    }
+
+    constexpr int32_t value() const{
+        return raw;
+    }
+
+    constexpr double toDouble() const{
+        return (double) raw / FIXED_POINT_ONE;
+    }
+
+    // Raw value saturated to direct control force range -10000 to +10000
+    constexpr int16_t toForce() const{
+        return (int16_t) (raw > FIXED_FORCE_MAX ? FIXED_FORCE_MAX : (raw < -FIXED_FORCE_MAX ? -FIXED_FORCE_MAX : raw));
+    }
+
+    // Fraction as whole percent, rounded
+    constexpr int32_t toPercent() const{
+        return (int32_t) RoundedDivide(raw, FIXED_POINT_PERCENT);
+    }
+
+    // Fraction 0 to 1 as ForceDrop percent 0 to 100
+    constexpr uint8_t toForceDrop() const{
+        return (uint8_t) (toPercent() > FIXED_FORCE_DROP_MAX ? FIXED_FORCE_DROP_MAX : (toPercent() < 0 ? 0 : toPercent()));
+    }
+
+    constexpr FixedPoint operator+(FixedPoint other) const{
+        return FixedPoint(Saturate((int64_t) raw + other.raw));
+    }
+
+    constexpr FixedPoint operator-(FixedPoint other) const{
+        return FixedPoint(Saturate((int64_t) raw - other.raw));
+    }
+
+    constexpr FixedPoint operator-() const{
+        return FixedPoint(Saturate(-(int64_t) raw));
+    }
+
+    constexpr FixedPoint operator*(FixedPoint other) const{
+        return FixedPoint(Saturate(RoundedDivide((int64_t) raw * other.raw, FIXED_POINT_ONE)));
+    }
+
+    // Scaling by a plain integer, no rounding involved
+    constexpr FixedPoint operator*(int32_t factor) const{
+        return FixedPoint(Saturate((int64_t) raw * factor));
+    }
+
+    constexpr FixedPoint operator/(FixedPoint other) const{
+        return ratio(raw, other.raw);
+    }
+
+    FixedPoint &operator+=(FixedPoint other){
+        return *this = *this + other;
+    }
+
+    FixedPoint &operator-=(FixedPoint other){
+        return *this = *this - other;
+    }
+
+    FixedPoint &operator*=(FixedPoint other){
+        return *this = *this * other;
+    }
+
+    constexpr bool operator==(FixedPoint other) const{
+        return raw == other.raw;
+    }
+
+    constexpr bool operator!=(FixedPoint other) const{
+        return raw != other.raw;
+    }
+
+    constexpr bool operator<(FixedPoint other) const{
+        return raw < other.raw;
+    }
+
+    constexpr bool operator<=(FixedPoint other) const{
+        return raw <= other.raw;
+    }
+
+    constexpr bool operator>(FixedPoint other) const{
+        return raw > other.raw;
+    }
+
+    constexpr bool operator>=(FixedPoint other) const{
+        return raw >= other.raw;
+    }
+
+private:
+    constexpr explicit FixedPoint(int32_t raw) : raw(raw){
+    }
+
+    static constexpr int32_t Saturate(int64_t value){
+        return value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : (int32_t) value);
+    }
+
+    // value * factor without overflow, numerators of ratio can be any int64
+    static constexpr int64_t Saturate64(int64_t value, int64_t factor){
+        return value > INT64_MAX / factor ? INT64_MAX / 2 : (value < INT64_MIN / factor ? INT64_MIN / 2 : value * factor);
+    }
+
+    // Truncating division after moving half a divisor away from zero, operands stay far from int64 limits
+    static constexpr int64_t RoundedDivide(int64_t numerator, int64_t denominator){
+        return ((numerator < 0) != (denominator < 0) ? numerator - denominator / 2 : numerator + denominator / 2) / denominator;
+    }
+
+    int32_t raw;
+};
+
+/**
+ * Effect math in device units, same shapes as the float effect kernel. Phase is 0 to 1 of period,
+ * waveforms return -1 to +1, times are nanoseconds as everywhere else on host side.
+ * */
+
+static constexpr FixedPoint FIXED_ZERO = FixedPoint();
+static constexpr FixedPoint FIXED_HALF = FixedPoint::fromRaw(FIXED_POINT_ONE / 2);
+static constexpr FixedPoint FIXED_ONE = FixedPoint::fromRaw(FIXED_POINT_ONE);
+
+inline constexpr FixedPoint FixedMin(FixedPoint a, FixedPoint b){
+    return a < b ? a : b;
+}
+
+inline constexpr FixedPoint FixedMax(FixedPoint a, FixedPoint b){
+    return a > b ? a : b;
+}
+
+inline constexpr FixedPoint FixedClamp(FixedPoint value, FixedPoint low, FixedPoint high){
+    return value < low ? low : (value > high ? high : value);
+}
+
+inline constexpr FixedPoint FixedAbs(FixedPoint value){
+    return value < FIXED_ZERO ? -value : value;
+}
+
+// Position of the whole period elapsed, exact for periods up to days
+inline constexpr FixedPoint FixedPhase(uint64_t elapsedNs, uint64_t periodNs){
+    return periodNs == 0 ? FIXED_ZERO
+                         : FixedPoint::fromRaw((int32_t) ((elapsedNs % periodNs) * FIXED_POINT_ONE / periodNs));
+}
+
+inline constexpr FixedPoint FixedSquare(FixedPoint phase){
+    return phase < FIXED_HALF ? FIXED_ONE : -FIXED_ONE;
+}
+
+inline constexpr FixedPoint FixedSawtooth(FixedPoint phase){
+    return phase * 2 - FIXED_ONE;
+}
+
+inline constexpr FixedPoint FixedTriangleShifted(FixedPoint q){
+    return FIXED_ONE - FixedAbs(q - FIXED_HALF) * 4;
+}
+
+// Starts at 0 rising, same phase as sine
+inline constexpr FixedPoint FixedTriangle(FixedPoint phase){
+    return FixedTriangleShifted(phase + FixedPoint::fromRaw(FIXED_POINT_ONE / 4) >= FIXED_ONE
+                                ? phase - FixedPoint::fromRaw(FIXED_POINT_ONE * 3 / 4)
+                                : phase + FixedPoint::fromRaw(FIXED_POINT_ONE / 4));
+}
+
+inline constexpr FixedPoint FixedSineParabola(FixedPoint y){
+    return -(FixedPoint::fromRaw(2250) * (y * FixedAbs(y) - y) + y);
+}
+
+inline constexpr FixedPoint FixedSineOfSawtooth(FixedPoint s){
+    return FixedSineParabola(s * 4 * (FIXED_ONE - FixedAbs(s)));
+}
+
+// Same corrected parabola as the float kernels, within 0.12 % of sine including rounding
+inline constexpr FixedPoint FixedSine(FixedPoint phase){
+    return FixedSineOfSawtooth(FixedSawtooth(phase));
+}
+
+// Level going from start to end over duration, end after that
+inline constexpr FixedPoint FixedRamp(FixedPoint start, FixedPoint end, uint64_t elapsedNs, uint64_t durationNs){
+    return elapsedNs >= durationNs ? end : start + (end - start) * FixedPoint::ratio((int64_t) elapsedNs, (int64_t) durationNs);
+}
+
+/**
+ * Attack and fade of an effect, 1 outside both. Fade applies only when duration is not 0, zero length attack or fade
+ * is a step like in EffectEngine.
+ * */
+inline constexpr FixedPoint FixedEnvelope(uint64_t elapsedNs, uint64_t durationNs, FixedPoint attackLevel, uint64_t attackNs,
+                                          FixedPoint fadeLevel, uint64_t fadeNs){
+    return attackLevel + (FIXED_ONE - attackLevel) * (elapsedNs >= attackNs ? FIXED_ONE
+                                                      : FixedPoint::ratio((int64_t) elapsedNs, (int64_t) attackNs))
+         + fadeLevel + (FIXED_ONE - fadeLevel) * (durationNs == 0 || elapsedNs + fadeNs <= durationNs ? FIXED_ONE
+                                                  : elapsedNs >= durationNs ? FIXED_ZERO
+                                                  : FixedPoint::ratio((int64_t) (durationNs - elapsedNs), (int64_t) fadeNs))
+         - FIXED_ONE;
+}
+
+inline constexpr FixedPoint FixedConditionOffset(FixedPoint x, FixedPoint deadBand, FixedPoint positiveCoefficient,
+                                                 FixedPoint negativeCoefficient, FixedPoint saturation){
+    return FixedClamp(-(positiveCoefficient * FixedMax(x - deadBand, FIXED_ZERO) + negativeCoefficient * FixedMin(x + deadBand, FIXED_ZERO)),
+                      -saturation, saturation);
+}
+
+/**
+ * Spring, damper, inertia or friction force for input (position, velocity ...) around center. No force inside dead
+ * band, coefficient per unit of input beyond it, magnitude bounded by saturation, force opposes the input.
+ * */
+inline constexpr FixedPoint FixedCondition(FixedPoint input, FixedPoint center, FixedPoint deadBand,
+                                           FixedPoint positiveCoefficient, FixedPoint negativeCoefficient,
+                                           FixedPoint saturation){
+    return FixedConditionOffset(input - center, deadBand, positiveCoefficient, negativeCoefficient, saturation);
+}
+
+inline constexpr FixedPoint FixedPosition(const DeviceStateTypeDef &state){
+    return FixedPoint::fromRaw(state.Position);
+}
+
+inline constexpr FixedPoint FixedTorque(const DeviceStateTypeDef &state){
+    return FixedPoint::fromRaw(state.Torque);
+}
+
+// Report with every channel saturated to device range, forceDrop is a fraction 0 to 1
+inline constexpr DirectControlTypeDef FixedDirectControl(FixedPoint spring, FixedPoint constant, FixedPoint periodic,
+                                                         FixedPoint forceDrop = FIXED_ZERO){
+    return DirectControlTypeDef{spring.toForce(), constant.toForce(), periodic.toForce(), forceDrop.toForceDrop()};
+}
+
+#endif // FIXED_POINT_H
@@ -0,0 +1,169 @@
+#include "force_scheduler.h"
+#include "host_clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+static void UpdateMax(std::atomic<uint64_t> &target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+#ifdef _WIN32
+static void WaitUntil(HANDLE timer, uint64_t deadline) {
+    uint64_t now = HostClockNanoseconds();
+    if (timer != NULL && deadline > now + SCHEDULER_SPIN_MARGIN_NS) {
+        LARGE_INTEGER due;
+        // Negative value is relative time in 100 ns units
+        due.QuadPart = -(LONGLONG) ((deadline - now - SCHEDULER_SPIN_MARGIN_NS) / 100);
+        if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(timer, INFINITE);
+        }
+    }
+    while (HostClockNanoseconds() < deadline) {
+        YieldProcessor();
+    }
+}
+#else
+static void WaitUntil(uint64_t deadline) {
+    uint64_t now = HostClockNanoseconds();
+    if (deadline > now + SCHEDULER_SPIN_MARGIN_NS) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - SCHEDULER_SPIN_MARGIN_NS));
+    }
+    while (HostClockNanoseconds() < deadline) {
+        std::this_thread::yield();
+    }
+}
+#endif
+
+ForceScheduler::ForceScheduler(WheelApi *api, ForceCallback callback, void *context)
+    : api(api), callback(callback), context(context) {
+}
+
+ForceScheduler::~ForceScheduler() {
+    stop();
+}
+
+int ForceScheduler::start(uint32_t rateHz){
+    if (rateHz == 0 || callback == nullptr){
+        return 0;
+    }
+    uint64_t period = 1000000000ULL / rateHz;
+    if (period % USB_POLLING_INTERVAL_NS != 0){
+        // Ticks would drift against device interval
+        return 0;
+    }
+    if (running.load(std::memory_order_acquire)){
+        // Same as the other workers, running keeps its rate
+        return 1;
+    }
+    if (!api->claimAsyncWrites()){
+        // Another sender reaps the async queue, completions of the scheduler would get mixed up with its own
+        return 0;
+    }
+    periodNs = period;
+    running.store(true, std::memory_order_release);
+    worker = std::thread(&ForceScheduler::SchedulerLoop, this);
+#ifdef _WIN32
+    SetThreadPriority((HANDLE) worker.native_handle(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+    return 1;
+}
+
+void ForceScheduler::stop(){
+    running.store(false, std::memory_order_release);
+    if (worker.joinable()){
+        worker.join();
+        api->releaseAsyncWrites();
+    }
+}
+
+bool ForceScheduler::isRunning() const{
+    return running.load(std::memory_order_acquire);
+}
+
+void ForceScheduler::readStats(ForceSchedulerStatsTypeDef *destination) const{
+    destination->Ticks = ticks.load(std::memory_order_relaxed);
+    destination->Overruns = overruns.load(std::memory_order_relaxed);
+    destination->SkippedTicks = skippedTicks.load(std::memory_order_relaxed);
+    destination->SendFailures = sendFailures.load(std::memory_order_relaxed);
+    destination->MaxLatenessNs = maxLatenessNs.load(std::memory_order_relaxed);
+    destination->TotalLatenessNs = totalLatenessNs.load(std::memory_order_relaxed);
+    destination->MaxCallbackNs = maxCallbackNs.load(std::memory_order_relaxed);
+}
+
+void ForceScheduler::resetStats(){
+    ticks.store(0, std::memory_order_relaxed);
+    overruns.store(0, std::memory_order_relaxed);
+    skippedTicks.store(0, std::memory_order_relaxed);
+    sendFailures.store(0, std::memory_order_relaxed);
+    maxLatenessNs.store(0, std::memory_order_relaxed);
+    totalLatenessNs.store(0, std::memory_order_relaxed);
+    maxCallbackNs.store(0, std::memory_order_relaxed);
+}
+
+void ForceScheduler::SchedulerLoop(){
+#ifdef _WIN32
+    HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (timer == NULL) {
+        // High resolution timers need Windows 10 1803, plain timer plus longer spin still keeps the rate
+        timer = CreateWaitableTimerW(NULL, FALSE, NULL);
+    }
+#endif
+
+    uint64_t now = HostClockNanoseconds();
+    uint64_t deadline = now + periodNs;
+    TimestampedStateTypeDef lastState;
+    if (api->isStateReaderRunning() && api->readStateSnapshot(&lastState) && lastState.Timestamp <= now){
+        // Keep phase of device reports, first tick is the next interval boundary after now
+        deadline = lastState.Timestamp + ((now - lastState.Timestamp) / periodNs + 1) * periodNs;
+    }
+
+    while (running.load(std::memory_order_acquire)){
+#ifdef _WIN32
+        WaitUntil(timer, deadline);
+#else
+        WaitUntil(deadline);
+#endif
+        uint64_t tickStart = HostClockNanoseconds();
+        uint64_t lateness = tickStart - deadline;
+
+        DirectControlTypeDef control = {};
+        if (callback(context, deadline, &control)){
+            // 0 means nothing was written, e.g. no handle while disconnected
+            if (api->sendDirectControlAsync(control) <= 0){
+                sendFailures.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            // Still collect completions of earlier ticks
+            api->completeWrites(0);
+        }
+        uint64_t tickEnd = HostClockNanoseconds();
+
+        ticks.fetch_add(1, std::memory_order_relaxed);
+        totalLatenessNs.fetch_add(lateness, std::memory_order_relaxed);
+        UpdateMax(maxLatenessNs, lateness);
+        UpdateMax(maxCallbackNs, tickEnd - tickStart);
+
+        deadline += periodNs;
+        if (tickEnd > deadline){
+            // Missed at least one deadline, drop them instead of bursting to catch up
+            uint64_t missed = (tickEnd - deadline) / periodNs + 1;
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            skippedTicks.fetch_add(missed, std::memory_order_relaxed);
+            deadline += missed * periodNs;
+        }
+    }
+
+    api->completeWrites(-1);
+#ifdef _WIN32
+    if (timer != NULL) {
+        CloseHandle(timer);
+    }
+#endif
+}
@@ -0,0 +1,70 @@
+#ifndef FORCE_SCHEDULER_H
+#define FORCE_SCHEDULER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "wheel_api.h"
+
+#define USB_POLLING_INTERVAL_NS     1000000ULL // Full speed interrupt endpoint is polled every 1 ms
+#define SCHEDULER_SPIN_MARGIN_NS    200000ULL // Final part of every wait is spun to hide timer granularity
+
+/**
+ * Called once per scheduler tick on the scheduler thread.
+ * Fill control and return true to send it, return false to skip sending for this tick.
+ * tickTime is the ideal start of the tick in HostClockNanoseconds units.
+ * */
+typedef bool (*ForceCallback)(void *context, uint64_t tickTime, DirectControlTypeDef *control);
+
+typedef struct {
+    uint64_t Ticks; // Callbacks invoked
+    uint64_t Overruns; // Ticks that were still running when the next deadline passed
+    uint64_t SkippedTicks; // Deadlines dropped to get back on schedule after overrun
+    uint64_t SendFailures; // Ticks where write could not be queued, disconnected device included
+    uint64_t MaxLatenessNs; // Largest delay between deadline and tick start
+    uint64_t TotalLatenessNs; // Divide by Ticks to get average delay
+    uint64_t MaxCallbackNs; // Longest time spent in callback
+} ForceSchedulerStatsTypeDef;
+
+/**
+ * Drives direct control output at a fixed rate from a dedicated high priority thread.
+ * Rate must divide USB polling interval evenly (1000, 500, 250 Hz ...). When background state reader of the api is
+ * running, tick phase is anchored to arrival of the newest state report, so output is aligned to device interval.
+ * Writes are queued with sendDirectControlAsync, scheduler thread must be only writer of direct control. The async
+ * queue of the api is claimed while running, start returns 0 when another sender holds it.
+ * */
+class ForceScheduler
+{
+public:
+    ForceScheduler(WheelApi *api, ForceCallback callback, void *context);
+    ~ForceScheduler();
+
+    // Returns 1 when started or already running (rate is then left unchanged), 0 on invalid rate or claim failure
+    int start(uint32_t rateHz);
+    void stop();
+    bool isRunning() const;
+
+    void readStats(ForceSchedulerStatsTypeDef *destination) const;
+    void resetStats();
+
+private:
+    WheelApi *api;
+    ForceCallback callback;
+    void *context;
+    uint64_t periodNs = 0;
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> overruns{0};
+    std::atomic<uint64_t> skippedTicks{0};
+    std::atomic<uint64_t> sendFailures{0};
+    std::atomic<uint64_t> maxLatenessNs{0};
+    std::atomic<uint64_t> totalLatenessNs{0};
+    std::atomic<uint64_t> maxCallbackNs{0};
+
+    void SchedulerLoop();
+};
+
+#endif // FORCE_SCHEDULER_H
@@ -140,6 +140,21 @@ static struct hid_api_version api_version = {
 	static BOOLEAN initialized = FALSE;
 #endif /* HIDAPI_USE_DDK */
 
+struct hid_write_slot {
+	OVERLAPPED ol;
+	unsigned char *buf;
+	BOOL pending;
+	hid_write_callback callback;
+	void *context;
+};
+
+/* Event handles with the low bit set keep overlapped operations from
+   queueing a packet once the device handle is attached to a hid_iocp.
+   All internal events are tagged, only hid_iocp_submit_*() requests reach
+   the completion port. The tag is dropped again when the event is closed. */
+#define NO_IOCP_EVENT(ev) ((HANDLE) ((ULONG_PTR) (ev) | 1))
+#define UNTAGGED_EVENT(ev) ((HANDLE) ((ULONG_PTR) (ev) & ~(ULONG_PTR) 1))
+
 struct hid_device_ {
 		HANDLE device_handle;
 		BOOL blocking;
@@ -147,50 +162,158 @@ struct hid_device_ {
 		size_t input_report_length;
 		USHORT feature_report_length;
 		unsigned char *feature_buf;
+		unsigned char *write_buf;
 		void *last_error_str;
 		DWORD last_error_num;
 		BOOL read_pending;
 		char *read_buf;
 		OVERLAPPED ol;
 		OVERLAPPED write_ol;			  
+		struct hid_write_slot write_slots[HID_WRITE_SLOTS];
+		unsigned int write_head; /* Next slot to be submitted */
+		unsigned int write_tail; /* Oldest slot still in flight */
+		OVERLAPPED feature_ol[HID_FEATURE_SLOTS];
+		HANDLE sync_event; /* Used by the synchronous feature and input report calls */
+		struct hid_device_stats stats;
 };
 
 static hid_device *new_hid_device()
 {
+	int i;
 	hid_device *dev = (hid_device*) calloc(1, sizeof(hid_device));
+	if (!dev)
+		return NULL;
 	dev->device_handle = INVALID_HANDLE_VALUE;
 	dev->blocking = TRUE;
 	dev->output_report_length = 0;
 	dev->input_report_length = 0;
 	dev->feature_report_length = 0;
 	dev->feature_buf = NULL;
+	dev->write_buf = NULL;
 	dev->last_error_str = NULL;
 	dev->last_error_num = 0;
 	dev->read_pending = FALSE;
 	dev->read_buf = NULL;
 	memset(&dev->ol, 0, sizeof(dev->ol));
-	dev->ol.hEvent = CreateEvent(NULL, FALSE, FALSE /*initial state f=nonsignaled*/, NULL);
+	/* Manual reset, so hid_wait_any() can wait on it without consuming the
+	   completion. Every read resets it before ReadFile() is issued. */
+	dev->ol.hEvent = NO_IOCP_EVENT(CreateEvent(NULL, TRUE, FALSE /*initial state f=nonsignaled*/, NULL));
 	memset(&dev->write_ol, 0, sizeof(dev->write_ol));
-	dev->write_ol.hEvent = CreateEvent(NULL, FALSE, FALSE /*inital state f=nonsignaled*/, NULL);											  
+	dev->write_ol.hEvent = NO_IOCP_EVENT(CreateEvent(NULL, FALSE, FALSE /*inital state f=nonsignaled*/, NULL));											  
+	for (i = 0; i < HID_WRITE_SLOTS; i++) {
+		memset(&dev->write_slots[i], 0, sizeof(dev->write_slots[i]));
+		/* Manual reset, so completion can be checked without consuming the signal. */
+		dev->write_slots[i].ol.hEvent = NO_IOCP_EVENT(CreateEvent(NULL, TRUE, FALSE /*inital state f=nonsignaled*/, NULL));
+	}
+	dev->write_head = 0;
+	dev->write_tail = 0;
+	for (i = 0; i < HID_FEATURE_SLOTS; i++) {
+		memset(&dev->feature_ol[i], 0, sizeof(dev->feature_ol[i]));
+		dev->feature_ol[i].hEvent = NO_IOCP_EVENT(CreateEvent(NULL, TRUE, FALSE /*inital state f=nonsignaled*/, NULL));
+	}
+	dev->sync_event = NO_IOCP_EVENT(CreateEvent(NULL, TRUE, FALSE /*inital state f=nonsignaled*/, NULL));
 
 	return dev;
 }
 
+static int reap_write_slots(hid_device *dev, DWORD milliseconds, BOOL all);
+
 static void free_hid_device(hid_device *dev)
 {
-	CloseHandle(dev->ol.hEvent);
-	CloseHandle(dev->write_ol.hEvent);							   
+	int i;
+
+	/* Writes which are still queued, from any thread, are cancelled by
+	   hid_close(), wait until the driver is done with the slot buffers
+	   before freeing them. */
+	reap_write_slots(dev, INFINITE, TRUE);
+	for (i = 0; i < HID_WRITE_SLOTS; i++) {
+		CloseHandle(UNTAGGED_EVENT(dev->write_slots[i].ol.hEvent));
+		free(dev->write_slots[i].buf);
+	}
+	for (i = 0; i < HID_FEATURE_SLOTS; i++)
+		CloseHandle(UNTAGGED_EVENT(dev->feature_ol[i].hEvent));
+	CloseHandle(UNTAGGED_EVENT(dev->sync_event));
+	CloseHandle(UNTAGGED_EVENT(dev->ol.hEvent));
+	CloseHandle(UNTAGGED_EVENT(dev->write_ol.hEvent));							   
 	CloseHandle(dev->device_handle);
 	LocalFree(dev->last_error_str);
 	free(dev->feature_buf);
+	free(dev->write_buf);
 	free(dev->read_buf);
 	free(dev);
 }
 
+/* Call counters. Updates are relaxed interlocked operations, so
+   hid_get_stats() can run on any thread while calls are counted. The
+   structure holds nothing but unsigned long long counters. */
+static volatile LONGLONG stats_frequency = 0;
+
+static void stats_add(unsigned long long *counter, unsigned long long value)
+{
+	InterlockedExchangeAdd64((volatile LONGLONG *) counter, (LONGLONG) value);
+}
+
+static void stats_max(unsigned long long *counter, unsigned long long value)
+{
+	LONGLONG seen = InterlockedCompareExchange64((volatile LONGLONG *) counter, 0, 0);
+	while ((unsigned long long) seen < value) {
+		LONGLONG previous = InterlockedCompareExchange64((volatile LONGLONG *) counter, (LONGLONG) value, seen);
+		if (previous == seen)
+			break;
+		seen = previous;
+	}
+}
+
+static LONGLONG stats_clock(void)
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+/* Counter frequency is fixed at boot. Any thread may be first to ask, the
+   value is published with an interlocked exchange so none reads it torn. */
+static LONGLONG stats_clock_frequency(void)
+{
+	LONGLONG frequency = InterlockedCompareExchange64(&stats_frequency, 0, 0);
+	if (frequency == 0) {
+		LARGE_INTEGER queried;
+		QueryPerformanceFrequency(&queried);
+		frequency = queried.QuadPart;
+		InterlockedCompareExchange64(&stats_frequency, frequency, 0);
+	}
+	return frequency;
+}
+
+static int record_op(struct hid_op_stats *op, LONGLONG start, int result)
+{
+	LONGLONG ticks = stats_clock() - start;
+	LONGLONG frequency = stats_clock_frequency();
+	unsigned long long ns, us;
+	int bucket = 0;
+
+	ns = (unsigned long long) (ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency);
+
+	stats_add(&op->calls, 1);
+	if (result < 0)
+		stats_add(&op->errors, 1);
+	else if (result == 0)
+		stats_add(&op->timeouts, 1);
+	else
+		stats_add(&op->bytes, (unsigned long long) result);
+	stats_add(&op->total_ns, ns);
+	stats_max(&op->max_ns, ns);
+	for (us = ns / 1000; us > 1 && bucket < HID_STATS_BUCKETS - 1; us >>= 1)
+		bucket++;
+	stats_add(&op->histogram[bucket], 1);
+	return result;
+}
+
 static void register_error(hid_device *dev, const char *op)
 {
 	WCHAR *ptr, *msg;
 	(void)op; // unreferenced  param
+	stats_add(&dev->stats.registered_errors, 1);
 	FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER |
 		FORMAT_MESSAGE_FROM_SYSTEM |
 		FORMAT_MESSAGE_IGNORE_INSERTS,
@@ -303,7 +426,22 @@ int HID_API_EXPORT hid_exit(void)
 	return 0;
 }
 
-struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+/* Checks the device interface path for the VID/PID (and interface) of a
+   USB HID device before anything is opened. USB paths look like
+   \\?\hid#vid_045b&pid_59d7&mi_00#... but the case is not guaranteed. */
+static BOOL path_matches(const char *path, const char *needle)
+{
+	char lowered[512];
+	size_t i;
+
+	for (i = 0; path[i] && i < sizeof(lowered) - 1; i++)
+		lowered[i] = (path[i] >= 'A' && path[i] <= 'Z')? (char) (path[i] - 'A' + 'a'): path[i];
+	lowered[i] = '\0';
+
+	return strstr(lowered, needle) != NULL;
+}
+
+static struct hid_device_info *enumerate_devices(unsigned short vendor_id, unsigned short product_id, const char *path_filter)
 {
 	BOOL res;
 	struct hid_device_info *root = NULL; /* return object */
@@ -378,6 +516,10 @@ struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned shor
 			goto cont;
 		}
 
+		/* Skip everything that can not match without opening it. */
+		if (path_filter && !path_matches(device_interface_detail_data->DevicePath, path_filter))
+			goto cont;
+
 		/* Make sure this device is of Setup Class "HIDClass" and has a
 		   driver bound to it. */
 		for (i = 0; ; i++) {
@@ -566,6 +708,23 @@ cont:
 
 }
 
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+	return enumerate_devices(vendor_id, product_id, NULL);
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate_usb_interface(unsigned short vendor_id, unsigned short product_id, int interface_number)
+{
+	char path_filter[32];
+
+	if (interface_number >= 0)
+		sprintf(path_filter, "vid_%04x&pid_%04x&mi_%02x", vendor_id, product_id, interface_number);
+	else
+		sprintf(path_filter, "vid_%04x&pid_%04x", vendor_id, product_id);
+
+	return enumerate_devices(vendor_id, product_id, path_filter);
+}
+
 void  HID_API_EXPORT HID_API_CALL hid_free_enumeration(struct hid_device_info *devs)
 {
 	/* TODO: Merge this with the Linux version. This function is platform-independent. */
@@ -623,12 +782,15 @@ HID_API_EXPORT hid_device * HID_API_CALL hid_open_path(const char *path)
 	PHIDP_PREPARSED_DATA pp_data = NULL;
 	BOOLEAN res;
 	NTSTATUS nt_res;
+	int i;
 
 	if (hid_init() < 0) {
 		return NULL;
 	}
 
 	dev = new_hid_device();
+	if (!dev)
+		return NULL;
 
 	/* Open a handle to the device */
 	dev->device_handle = open_device(path, TRUE);
@@ -674,6 +836,23 @@ HID_API_EXPORT hid_device * HID_API_CALL hid_open_path(const char *path)
 	HidD_FreePreparsedData(pp_data);
 
 	dev->read_buf = (char*) malloc(dev->input_report_length);
+	/* Padded output reports are built in this buffer, so hid_write()
+	   never touches the heap. */
+	dev->write_buf = (unsigned char*) malloc(dev->output_report_length);
+	if (!dev->read_buf || !dev->write_buf) {
+		/* Buffers allocated so far are released by free_hid_device(). */
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		register_error(dev, "malloc");
+		goto err;
+	}
+	for (i = 0; i < HID_WRITE_SLOTS; i++) {
+		dev->write_slots[i].buf = (unsigned char*) malloc(dev->output_report_length);
+		if (!dev->write_slots[i].buf) {
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			register_error(dev, "malloc");
+			goto err;
+		}
+	}
 
 	return dev;
 
@@ -686,6 +865,7 @@ err:
 
 int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length)
 {
+	LONGLONG start = stats_clock();
 	DWORD bytes_written = 0;
 	int function_result = -1;
 	BOOL res;
@@ -698,14 +878,14 @@ int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *
 	   one for the report number) bytes even if the data is a report
 	   which is shorter than that. Windows gives us this value in
 	   caps.OutputReportByteLength. If a user passes in fewer bytes than this,
-	   create a temporary buffer which is the proper size. */
+	   use the preallocated buffer which is the proper size. */
 	if (length >= dev->output_report_length) {
 		/* The user passed the right number of bytes. Use the buffer as-is. */
 		buf = (unsigned char *) data;
 	} else {
-		/* Create a temporary buffer and copy the user's data
-		   into it, padding the rest with zeros. */
-		buf = (unsigned char *) malloc(dev->output_report_length);
+		/* Copy the user's data into the device write buffer,
+		   padding the rest with zeros. */
+		buf = dev->write_buf;
 		memcpy(buf, data, length);
 		memset(buf + length, 0, dev->output_report_length - length);
 		length = dev->output_report_length;
@@ -730,6 +910,7 @@ int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *
 		if (res != WAIT_OBJECT_0) {
 			/* There was a Timeout. */
 			register_error(dev, "WriteFile/WaitForSingleObject Timeout");
+			stats_add(&dev->stats.write.timeouts, 1);
 			goto end_of_function;
 		}
 
@@ -746,35 +927,129 @@ int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *
 	}
 
 end_of_function:
-	if (buf != data)
-		free(buf);
+	return record_op(&dev->stats.write, start, function_result);
+}
+
+/* Completes queued writes in submission order. Waits up to milliseconds
+   for the oldest one, and for every one of them if all is set. Callbacks of
+   completed writes are invoked from here. Returns the number of writes
+   which are still in flight. */
+static int reap_write_slots(hid_device *dev, DWORD milliseconds, BOOL all)
+{
+	DWORD wait_ms = milliseconds;
+
+	while (dev->write_tail != dev->write_head) {
+		struct hid_write_slot *slot = &dev->write_slots[dev->write_tail % HID_WRITE_SLOTS];
+		DWORD bytes_written = 0;
+		int result = -1;
+
+		if (WaitForSingleObject(slot->ol.hEvent, wait_ms) != WAIT_OBJECT_0)
+			break;
+
+		if (GetOverlappedResult(dev->device_handle, &slot->ol, &bytes_written, FALSE/*wait*/)) {
+			result = bytes_written;
+		}
+		else {
+			/* The call was counted when queued, only the error is left */
+			register_error(dev, "WriteFile");
+			stats_add(&dev->stats.write.errors, 1);
+		}
+
+		slot->pending = FALSE;
+		dev->write_tail++;
+		if (slot->callback)
+			slot->callback(slot->context, result);
+
+		/* Only the oldest write is waited for, the others are just polled. */
+		if (!all)
+			wait_ms = 0;
+	}
 
-	return function_result;
+	return (int) (dev->write_head - dev->write_tail);
 }
 
+static int write_async(hid_device *dev, const unsigned char *data, size_t length, hid_write_callback callback, void *context)
+{
+	struct hid_write_slot *slot;
+	BOOL res;
 
-int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+	/* Collect whatever has completed meanwhile. If every slot is still in
+	   flight, wait for the oldest one as long as hid_write() would. */
+	reap_write_slots(dev, 0, FALSE);
+	if (dev->write_head - dev->write_tail >= HID_WRITE_SLOTS) {
+		reap_write_slots(dev, 1000, FALSE);
+		if (dev->write_head - dev->write_tail >= HID_WRITE_SLOTS) {
+			register_error(dev, "WriteFile/WaitForSingleObject Timeout");
+			stats_add(&dev->stats.write.timeouts, 1);
+			return -1;
+		}
+	}
+
+	slot = &dev->write_slots[dev->write_head % HID_WRITE_SLOTS];
+
+	/* Slot buffers are always OutputReportByteLength long, see hid_write()
+	   for why Windows needs the full length. */
+	if (length > dev->output_report_length)
+		length = dev->output_report_length;
+	memcpy(slot->buf, data, length);
+	memset(slot->buf + length, 0, dev->output_report_length - length);
+
+	slot->callback = callback;
+	slot->context = context;
+	ResetEvent(slot->ol.hEvent);
+
+	res = WriteFile(dev->device_handle, slot->buf, (DWORD) dev->output_report_length, NULL, &slot->ol);
+	if (!res && GetLastError() != ERROR_IO_PENDING) {
+		/* WriteFile() failed. Nothing was queued. */
+		register_error(dev, "WriteFile");
+		return -1;
+	}
+
+	/* A write which completed right away still signals the event and is
+	   reported through the callback like every other one. */
+	slot->pending = TRUE;
+	dev->write_head++;
+
+	return (int) length;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write_async(hid_device *dev, const unsigned char *data, size_t length, hid_write_callback callback, void *context)
+{
+	LONGLONG start = stats_clock();
+	return record_op(&dev->stats.write, start, write_async(dev, data, length, callback, context));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write_complete(hid_device *dev, int milliseconds)
+{
+	return reap_write_slots(dev, (milliseconds < 0)? INFINITE: (DWORD) milliseconds, TRUE);
+}
+
+/* Drives the overlapped read of dev->read_buf. Starts it if needed and
+   waits up to milliseconds for it. Returns 1 with the byte count once the
+   read completed, 0 while it is still running and -1 on error. */
+static int complete_read(hid_device *dev, int milliseconds, DWORD *bytes_read)
 {
-	DWORD bytes_read = 0;
-	size_t copy_len = 0;
 	BOOL res = FALSE;
 	BOOL overlapped = FALSE;
 
 	/* Copy the handle for convenience. */
 	HANDLE ev = dev->ol.hEvent;
 
+	*bytes_read = 0;
+
 	if (!dev->read_pending) {
 		/* Start an Overlapped I/O read. */
 		dev->read_pending = TRUE;
 		memset(dev->read_buf, 0, dev->input_report_length);
 		ResetEvent(ev);
-		res = ReadFile(dev->device_handle, dev->read_buf, (DWORD) dev->input_report_length, &bytes_read, &dev->ol);
+		res = ReadFile(dev->device_handle, dev->read_buf, (DWORD) dev->input_report_length, bytes_read, &dev->ol);
 		
 		if (!res) {
 			if (GetLastError() != ERROR_IO_PENDING) {
 				/* ReadFile() has failed.
-				   Clean up and return error. */
-				CancelIo(dev->device_handle);
+				   Clean up and return error. Only the read is
+				   cancelled, writes of other threads stay queued. */
+				CancelIoEx(dev->device_handle, &dev->ol);
 				dev->read_pending = FALSE;
 				goto end_of_function;
 			}
@@ -799,12 +1074,30 @@ int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char
 		/* Either WaitForSingleObject() told us that ReadFile has completed, or
 		   we are in non-blocking mode. Get the number of bytes read. The actual
 		   data has been copied to the data[] array which was passed to ReadFile(). */
-		res = GetOverlappedResult(dev->device_handle, &dev->ol, &bytes_read, TRUE/*wait*/);
+		res = GetOverlappedResult(dev->device_handle, &dev->ol, bytes_read, TRUE/*wait*/);
 	}
 	/* Set pending back to false, even if GetOverlappedResult() returned error. */
 	dev->read_pending = FALSE;
 
-	if (res && bytes_read > 0) {
+end_of_function:
+	if (!res) {
+		register_error(dev, "GetOverlappedResult");
+		return -1;
+	}
+
+	return 1;
+}
+
+static int read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+	DWORD bytes_read = 0;
+	size_t copy_len = 0;
+	int res = complete_read(dev, milliseconds, &bytes_read);
+
+	if (res <= 0)
+		return res;
+
+	if (bytes_read > 0) {
 		if (dev->read_buf[0] == 0x0) {
 			/* If report numbers aren't being used, but Windows sticks a report
 			   number (0x0) on the beginning of the report anyway. To make this
@@ -821,13 +1114,86 @@ int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char
 		}
 	}
 	
-end_of_function:
-	if (!res) {
-		register_error(dev, "GetOverlappedResult");
+	return (int) copy_len;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+	LONGLONG start = stats_clock();
+	return record_op(&dev->stats.read, start, read_timeout(dev, data, length, milliseconds));
+}
+
+static int read_timeout_swap(hid_device *dev, unsigned char **buffer, size_t buffer_size, int milliseconds)
+{
+	DWORD bytes_read = 0;
+	unsigned char *filled;
+	int res;
+
+	/* Caller buffer becomes the next read buffer, it has to hold a full report. */
+	if (buffer_size < dev->input_report_length)
 		return -1;
+
+	res = complete_read(dev, milliseconds, &bytes_read);
+	if (res <= 0)
+		return res;
+
+	filled = (unsigned char *) dev->read_buf;
+	dev->read_buf = (char *) *buffer;
+	*buffer = filled;
+
+	return (int) bytes_read;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout_swap(hid_device *dev, unsigned char **buffer, size_t buffer_size, int milliseconds)
+{
+	LONGLONG start = stats_clock();
+	return record_op(&dev->stats.read, start, read_timeout_swap(dev, buffer, buffer_size, milliseconds));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_wait_any(hid_device **devs, int count, int milliseconds)
+{
+	HANDLE events[MAXIMUM_WAIT_OBJECTS];
+	DWORD res;
+	int i;
+
+	if (count <= 0 || count > MAXIMUM_WAIT_OBJECTS)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		/* Without a pending read there is nothing to wait for, the next
+		   hid_read_timeout() on this device starts one right away. */
+		if (!devs[i]->read_pending)
+			return i;
+		events[i] = devs[i]->ol.hEvent;
 	}
-	
-	return (int) copy_len;
+
+	res = WaitForMultipleObjects((DWORD) count, events, FALSE, (milliseconds >= 0)? (DWORD) milliseconds: INFINITE);
+	if (res < WAIT_OBJECT_0 + (DWORD) count)
+		return (int) (res - WAIT_OBJECT_0);
+
+	return -1;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_read_wait_handle(hid_device *dev, hid_wait_handle *handle)
+{
+	if (!dev->read_pending) {
+		/* Start the read the event tracks. A ReadFile() which completes
+		   right away signals the event as well, the next read_timeout()
+		   collects the report through GetOverlappedResult(). */
+		dev->read_pending = TRUE;
+		memset(dev->read_buf, 0, dev->input_report_length);
+		ResetEvent(dev->ol.hEvent);
+		if (!ReadFile(dev->device_handle, dev->read_buf, (DWORD) dev->input_report_length, NULL, &dev->ol) &&
+		    GetLastError() != ERROR_IO_PENDING) {
+			register_error(dev, "ReadFile");
+			CancelIoEx(dev->device_handle, &dev->ol);
+			dev->read_pending = FALSE;
+			return -1;
+		}
+	}
+
+	*handle = UNTAGGED_EVENT(dev->ol.hEvent);
+	return 0;
 }
 
 int HID_API_EXPORT HID_API_CALL hid_read(hid_device *dev, unsigned char *data, size_t length)
@@ -841,6 +1207,15 @@ int HID_API_EXPORT HID_API_CALL hid_set_nonblocking(hid_device *dev, int nonbloc
 	return 0; /* Success */
 }
 
+int HID_API_EXPORT HID_API_CALL hid_set_num_input_buffers(hid_device *dev, int count)
+{
+	if (count <= 0 || !HidD_SetNumInputBuffers(dev->device_handle, (ULONG) count)) {
+		register_error(dev, "HidD_SetNumInputBuffers");
+		return -1;
+	}
+	return 0;
+}
+
 int HID_API_EXPORT HID_API_CALL hid_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
 {
 	BOOL res = FALSE;
@@ -875,7 +1250,7 @@ int HID_API_EXPORT HID_API_CALL hid_send_feature_report(hid_device *dev, const u
 }
 
 
-int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+static int get_feature_report(hid_device *dev, unsigned char *data, size_t length)
 {
 	BOOL res;
 #if 0
@@ -890,6 +1265,7 @@ int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned
 
 	OVERLAPPED ol;
 	memset(&ol, 0, sizeof(ol));
+	ol.hEvent = dev->sync_event;
 
 	res = DeviceIoControl(dev->device_handle,
 		IOCTL_HID_GET_FEATURE,
@@ -923,6 +1299,72 @@ int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned
 #endif
 }
 
+int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+	LONGLONG start = stats_clock();
+	return record_op(&dev->stats.get_feature, start, get_feature_report(dev, data, length));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_feature_reports(hid_device *dev, unsigned char **data, const size_t *length, int *results, size_t count)
+{
+	LONGLONG start = stats_clock();
+	int bytes = 0;
+	BOOL res;
+	BOOL issued[HID_FEATURE_SLOTS];
+	DWORD bytes_returned;
+	size_t i;
+	int succeeded = 0;
+
+	if (count == 0 || count > HID_FEATURE_SLOTS)
+		return -1;
+
+	/* Queue every request first. */
+	for (i = 0; i < count; i++) {
+		OVERLAPPED *ol = &dev->feature_ol[i];
+		HANDLE ev = ol->hEvent;
+
+		memset(ol, 0, sizeof(*ol));
+		ol->hEvent = ev;
+		ResetEvent(ev);
+		results[i] = -1;
+		issued[i] = TRUE;
+
+		res = DeviceIoControl(dev->device_handle,
+			IOCTL_HID_GET_FEATURE,
+			data[i], (DWORD) length[i],
+			data[i], (DWORD) length[i],
+			&bytes_returned, ol);
+
+		if (!res && GetLastError() != ERROR_IO_PENDING) {
+			/* DeviceIoControl() failed. The others still proceed. */
+			register_error(dev, "Send Feature Report DeviceIoControl");
+			issued[i] = FALSE;
+		}
+	}
+
+	/* Then collect them in order. */
+	for (i = 0; i < count; i++) {
+		if (!issued[i])
+			continue;
+
+		res = GetOverlappedResult(dev->device_handle, &dev->feature_ol[i], &bytes_returned, TRUE/*wait*/);
+		if (!res) {
+			/* The operation failed. */
+			register_error(dev, "Send Feature Report GetOverLappedResult");
+			continue;
+		}
+
+		/* bytes_returned does not include the first byte which contains the
+		   report ID, see hid_get_feature_report(). */
+		results[i] = bytes_returned + 1;
+		bytes += results[i];
+		succeeded++;
+	}
+
+	/* The whole batch counts as one call, failed when nothing came back. */
+	record_op(&dev->stats.get_feature, start, succeeded > 0 ? bytes : -1);
+	return succeeded;
+}
 
 int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned char *data, size_t length)
 {
@@ -939,6 +1381,7 @@ int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned c
 
 	OVERLAPPED ol;
 	memset(&ol, 0, sizeof(ol));
+	ol.hEvent = dev->sync_event;
 
 	res = DeviceIoControl(dev->device_handle,
 		IOCTL_HID_GET_INPUT_REPORT,
@@ -972,11 +1415,272 @@ int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned c
 #endif
 }
 
+struct hid_iocp_op {
+	OVERLAPPED ol; /* Must stay first, completions are mapped back by address */
+	hid_device *dev;
+	int type;
+	unsigned char *data; /* Caller buffer */
+	size_t length;
+	unsigned char *buf; /* Transfer buffer for reads and writes */
+	size_t buf_size;
+	void *context;
+	struct hid_iocp_op *next_free;
+};
+
+struct hid_iocp_ {
+	HANDLE port;
+	CRITICAL_SECTION lock;
+	struct hid_iocp_op ops[HID_IOCP_OPS];
+	struct hid_iocp_op *free_ops;
+	volatile LONG in_flight;
+};
+
+static struct hid_iocp_op *acquire_iocp_op(hid_iocp *iocp, hid_device *dev, int type, size_t buf_size)
+{
+	struct hid_iocp_op *op;
+
+	EnterCriticalSection(&iocp->lock);
+	op = iocp->free_ops;
+	if (op)
+		iocp->free_ops = op->next_free;
+	LeaveCriticalSection(&iocp->lock);
+
+	/* Every request slot is in flight */
+	if (!op)
+		return NULL;
+
+	if (op->buf_size < buf_size) {
+		unsigned char *buf = (unsigned char *) realloc(op->buf, buf_size);
+		if (!buf) {
+			EnterCriticalSection(&iocp->lock);
+			op->next_free = iocp->free_ops;
+			iocp->free_ops = op;
+			LeaveCriticalSection(&iocp->lock);
+			return NULL;
+		}
+		op->buf = buf;
+		op->buf_size = buf_size;
+	}
+
+	memset(&op->ol, 0, sizeof(op->ol));
+	op->dev = dev;
+	op->type = type;
+	return op;
+}
+
+static void release_iocp_op(hid_iocp *iocp, struct hid_iocp_op *op)
+{
+	EnterCriticalSection(&iocp->lock);
+	op->next_free = iocp->free_ops;
+	iocp->free_ops = op;
+	LeaveCriticalSection(&iocp->lock);
+}
+
+/* Checks the result of a request issued against the completion port. A
+   request which completed right away still queues its packet, so it is
+   counted as in flight either way. */
+static int issue_iocp_op(hid_iocp *iocp, struct hid_iocp_op *op, BOOL res, const char *what)
+{
+	if (!res && GetLastError() != ERROR_IO_PENDING) {
+		register_error(op->dev, what);
+		release_iocp_op(iocp, op);
+		return -1;
+	}
+	InterlockedIncrement(&iocp->in_flight);
+	return 0;
+}
+
+HID_API_EXPORT hid_iocp * HID_API_CALL hid_iocp_create(void)
+{
+	int i;
+	hid_iocp *iocp = (hid_iocp*) calloc(1, sizeof(hid_iocp));
+
+	if (!iocp)
+		return NULL;
+
+	iocp->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	if (!iocp->port) {
+		free(iocp);
+		return NULL;
+	}
+
+	InitializeCriticalSection(&iocp->lock);
+	for (i = HID_IOCP_OPS - 1; i >= 0; i--) {
+		iocp->ops[i].next_free = iocp->free_ops;
+		iocp->free_ops = &iocp->ops[i];
+	}
+	iocp->in_flight = 0;
+
+	return iocp;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_iocp_destroy(hid_iocp *iocp)
+{
+	OVERLAPPED_ENTRY entries[HID_IOCP_OPS];
+	ULONG removed;
+	int i;
+
+	if (!iocp)
+		return;
+
+	/* hid_close() cancels outstanding requests, their packets still arrive
+	   and the driver may touch the transfer buffers until they do. */
+	while (iocp->in_flight > 0) {
+		if (!GetQueuedCompletionStatusEx(iocp->port, entries, HID_IOCP_OPS, &removed, INFINITE, FALSE))
+			break;
+		for (i = 0; i < (int) removed; i++) {
+			if (entries[i].lpOverlapped)
+				InterlockedDecrement(&iocp->in_flight);
+		}
+	}
+
+	CloseHandle(iocp->port);
+	DeleteCriticalSection(&iocp->lock);
+	for (i = 0; i < HID_IOCP_OPS; i++)
+		free(iocp->ops[i].buf);
+	free(iocp);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_attach(hid_iocp *iocp, hid_device *dev)
+{
+	if (CreateIoCompletionPort(dev->device_handle, iocp->port, (ULONG_PTR) dev, 0) == NULL) {
+		register_error(dev, "CreateIoCompletionPort");
+		return -1;
+	}
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_read(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context)
+{
+	struct hid_iocp_op *op = acquire_iocp_op(iocp, dev, HID_IOCP_READ, dev->input_report_length);
+	BOOL res;
+
+	if (!op)
+		return -1;
+	op->data = data;
+	op->length = length;
+	op->context = context;
+
+	res = ReadFile(dev->device_handle, op->buf, (DWORD) dev->input_report_length, NULL, &op->ol);
+	return issue_iocp_op(iocp, op, res, "ReadFile");
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_write(hid_iocp *iocp, hid_device *dev, const unsigned char *data, size_t length, void *context)
+{
+	struct hid_iocp_op *op = acquire_iocp_op(iocp, dev, HID_IOCP_WRITE, dev->output_report_length);
+	BOOL res;
+
+	if (!op)
+		return -1;
+
+	/* Same padding rules as hid_write(), the data is copied so the caller
+	   may reuse it right away. */
+	if (length > dev->output_report_length)
+		length = dev->output_report_length;
+	memcpy(op->buf, data, length);
+	memset(op->buf + length, 0, dev->output_report_length - length);
+	op->data = NULL;
+	op->length = length;
+	op->context = context;
+
+	res = WriteFile(dev->device_handle, op->buf, (DWORD) dev->output_report_length, NULL, &op->ol);
+	return issue_iocp_op(iocp, op, res, "WriteFile");
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_get_feature(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context)
+{
+	struct hid_iocp_op *op = acquire_iocp_op(iocp, dev, HID_IOCP_GET_FEATURE, 0);
+	BOOL res;
+
+	if (!op)
+		return -1;
+	op->data = data;
+	op->length = length;
+	op->context = context;
+
+	res = DeviceIoControl(dev->device_handle,
+		IOCTL_HID_GET_FEATURE,
+		data, (DWORD) length,
+		data, (DWORD) length,
+		NULL, &op->ol);
+	return issue_iocp_op(iocp, op, res, "Send Feature Report DeviceIoControl");
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_wait(hid_iocp *iocp, struct hid_iocp_completion *completions, size_t count, int milliseconds)
+{
+	OVERLAPPED_ENTRY entries[HID_IOCP_OPS];
+	ULONG removed = 0;
+	ULONG i;
+	int filled = 0;
+
+	if (count > HID_IOCP_OPS)
+		count = HID_IOCP_OPS;
+	if (count == 0)
+		return 0;
+
+	if (!GetQueuedCompletionStatusEx(iocp->port, entries, (ULONG) count, &removed,
+			(milliseconds >= 0)? (DWORD) milliseconds: INFINITE, FALSE)) {
+		/* WAIT_TIMEOUT lands here as well */
+		return (GetLastError() == WAIT_TIMEOUT)? 0: -1;
+	}
+
+	for (i = 0; i < removed; i++) {
+		struct hid_iocp_op *op = (struct hid_iocp_op *) entries[i].lpOverlapped;
+		struct hid_iocp_completion *c = &completions[filled];
+		DWORD bytes = entries[i].dwNumberOfBytesTransferred;
+
+		/* HidD_* calls on an attached handle may queue packets without
+		   an OVERLAPPED, there is nothing to report for them. */
+		if (!op)
+			continue;
+		InterlockedDecrement(&iocp->in_flight);
+
+		c->dev = op->dev;
+		c->type = op->type;
+		c->data = op->data;
+		c->context = op->context;
+		c->result = -1;
+
+		/* Internal holds the NTSTATUS of the request, 0 is success */
+		if (op->ol.Internal == 0) {
+			if (op->type == HID_IOCP_READ) {
+				size_t copy_len = 0;
+				if (bytes > 0 && op->buf[0] == 0x0) {
+					/* Strip the report number Windows adds, see hid_read_timeout() */
+					bytes--;
+					copy_len = op->length > bytes ? bytes : op->length;
+					memcpy(op->data, op->buf + 1, copy_len);
+				}
+				else {
+					copy_len = op->length > bytes ? bytes : op->length;
+					memcpy(op->data, op->buf, copy_len);
+				}
+				c->result = (int) copy_len;
+			}
+			else if (op->type == HID_IOCP_WRITE) {
+				c->result = (int) bytes;
+			}
+			else {
+				/* Report ID byte is not counted, see hid_get_feature_report() */
+				c->result = (int) bytes + 1;
+			}
+		}
+
+		release_iocp_op(iocp, op);
+		filled++;
+	}
+
+	return filled;
+}
+
 void HID_API_EXPORT HID_API_CALL hid_close(hid_device *dev)
 {
 	if (!dev)
 		return;
-	CancelIo(dev->device_handle);
+	/* CancelIo() would only cancel requests issued by this thread, async
+	   writes of sender threads and hid_iocp requests would stay pending
+	   and free_hid_device() could wait for them forever. */
+	CancelIoEx(dev->device_handle, NULL);
 	free_hid_device(dev);
 }
 
@@ -1033,6 +1737,32 @@ int HID_API_EXPORT_CALL HID_API_CALL hid_get_indexed_string(hid_device *dev, int
 }
 
 
+int HID_API_EXPORT HID_API_CALL hid_get_stats(hid_device *dev, struct hid_device_stats *stats)
+{
+	unsigned long long *source, *destination;
+	size_t i;
+
+	if (!dev || !stats)
+		return -1;
+	source = (unsigned long long *) &dev->stats;
+	destination = (unsigned long long *) stats;
+	/* Compare exchange of 0 with 0 is the 64 bit atomic load available
+	   on every Windows target, 32 bit x86 included. */
+	for (i = 0; i < sizeof(*stats) / sizeof(unsigned long long); i++)
+		destination[i] = (unsigned long long) InterlockedCompareExchange64((volatile LONGLONG *) &source[i], 0, 0);
+	return 0;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_reset_stats(hid_device *dev)
+{
+	size_t i;
+
+	if (dev) {
+		for (i = 0; i < sizeof(dev->stats) / sizeof(unsigned long long); i++)
+			InterlockedExchange64((volatile LONGLONG *) &((unsigned long long *) &dev->stats)[i], 0);
+	}
+}
+
 HID_API_EXPORT const wchar_t * HID_API_CALL  hid_error(hid_device *dev)
 {
 	if (dev) {
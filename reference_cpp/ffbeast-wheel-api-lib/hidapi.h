@@ -66,6 +66,45 @@
 */
 #define HID_API_VERSION_STR HID_API_TO_VERSION_STR(HID_API_VERSION_MAJOR, HID_API_VERSION_MINOR, HID_API_VERSION_PATCH)
 
+/** @brief Number of Output reports which can be queued by
+	hid_write_async() at the same time.
+
+	@ingroup API
+*/
+#define HID_WRITE_SLOTS 4
+
+/** @brief Maximum number of Feature reports which can be requested
+	by a single hid_get_feature_reports() call.
+
+	@ingroup API
+*/
+#define HID_FEATURE_SLOTS 8
+
+/** @brief Maximum number of requests which can be in flight on a
+	single hid_iocp at the same time.
+
+	@ingroup API
+*/
+#define HID_IOCP_OPS 64
+
+/** @brief Request types reported in struct hid_iocp_completion.
+
+	@ingroup API
+*/
+#define HID_IOCP_READ 1
+#define HID_IOCP_WRITE 2
+#define HID_IOCP_GET_FEATURE 3
+
+/** @brief Number of latency buckets in struct hid_op_stats.
+
+	Bucket 0 counts calls shorter than 2 microseconds, bucket i calls
+	which took 2^i up to 2^(i+1) microseconds, the last bucket also
+	everything longer.
+
+	@ingroup API
+*/
+#define HID_STATS_BUCKETS 24
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -78,6 +117,59 @@ extern "C" {
 		struct hid_device_;
 		typedef struct hid_device_ hid_device; /**< opaque hidapi structure */
 
+		struct hid_iocp_;
+		typedef struct hid_iocp_ hid_iocp; /**< opaque completion port structure */
+
+#ifdef _WIN32
+		typedef void *hid_wait_handle; /**< HANDLE of an event, see hid_get_read_wait_handle() */
+#else
+		typedef int hid_wait_handle; /**< file descriptor, see hid_get_read_wait_handle() */
+#endif
+
+		/** Result of a request submitted through hid_iocp_submit_*() */
+		struct hid_iocp_completion {
+			/** Device the request was issued on */
+			hid_device *dev;
+			/** One of HID_IOCP_READ, HID_IOCP_WRITE, HID_IOCP_GET_FEATURE */
+			int type;
+			/** Same value the synchronous call would return, -1 on error */
+			int result;
+			/** Caller buffer of the request, NULL for writes */
+			unsigned char *data;
+			/** Pointer passed on submit */
+			void *context;
+		};
+
+		/** Counters of one kind of call, see hid_get_stats() */
+		struct hid_op_stats {
+			/** Calls made */
+			unsigned long long calls;
+			/** Calls which returned -1 */
+			unsigned long long errors;
+			/** Reads which returned 0, writes which gave up waiting (also counted as errors) */
+			unsigned long long timeouts;
+			/** Bytes transferred by successful calls */
+			unsigned long long bytes;
+			/** Sum and maximum of time spent inside the calls */
+			unsigned long long total_ns;
+			unsigned long long max_ns;
+			/** Log2 histogram of call duration, see HID_STATS_BUCKETS */
+			unsigned long long histogram[HID_STATS_BUCKETS];
+		};
+
+		/** Counters of one device since it was opened or last reset */
+		struct hid_device_stats {
+			/** hid_write() and hid_write_async(). Async writes count when
+			    queued, a failure reported on completion adds an error. */
+			struct hid_op_stats write;
+			/** hid_read(), hid_read_timeout() and hid_read_timeout_swap() */
+			struct hid_op_stats read;
+			/** hid_get_feature_report(), every hid_get_feature_reports() batch counts once */
+			struct hid_op_stats get_feature;
+			/** Errors recorded for hid_error(), by any function */
+			unsigned long long registered_errors;
+		};
+
 		/** hidapi info structure */
 		struct hid_device_info {
 			/** Platform-specific device path */
@@ -168,6 +260,26 @@ extern "C" {
 		*/
 		struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id);
 
+		/** @brief Enumerate one interface of a USB HID device quickly.
+
+			Works like hid_enumerate(), but device interface paths which
+			do not contain the VID, PID and interface number of
+			a USB device are skipped before the device is opened and
+			queried. With many HID devices attached this is much faster
+			than hid_enumerate(). Devices attached over other buses
+			(e.g. Bluetooth) are never returned.
+
+			@ingroup API
+			@param vendor_id The Vendor ID (VID) of the device.
+			@param product_id The Product ID (PID) of the device.
+			@param interface_number The USB interface number, or -1 to
+				return every interface of the device.
+
+			@returns
+				Same as hid_enumerate().
+		*/
+		struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate_usb_interface(unsigned short vendor_id, unsigned short product_id, int interface_number);
+
 		/** @brief Free an enumeration Linked List
 
 		    This function frees a linked list created by hid_enumerate().
@@ -245,6 +357,63 @@ extern "C" {
 		*/
 		int  HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length);
 
+		/** @brief Completion callback of hid_write_async().
+
+			@ingroup API
+			@param context The pointer passed to hid_write_async().
+			@param result The actual number of bytes written or -1 on error.
+		*/
+		typedef void (HID_API_CALL *hid_write_callback)(void *context, int result);
+
+		/** @brief Queue an Output report without waiting for the transfer.
+
+			Works like hid_write(), but returns as soon as the report has
+			been handed over to the driver. A small number of reports
+			can be in flight at the same time, they complete in the order
+			they were queued. If every slot is busy, this function waits
+			for the oldest write with the same timeout as hid_write().
+
+			The data is copied, so the caller may reuse @p data right
+			after the call returns. @p callback is invoked from inside
+			hid_write_async(), hid_write_complete() or hid_close() on
+			the thread that called them, never from a driver thread.
+			Writes cancelled by hid_close() report -1.
+
+			Do not mix with hid_write() on the same device if the order
+			of reports matters.
+
+			This function sets the return value of hid_error().
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param data The data to send, including the report number as
+				the first byte.
+			@param length The length in bytes of the data to send.
+			@param callback Function called once the write completes
+				(Optionally NULL).
+			@param context Pointer passed to @p callback.
+
+			@returns
+				This function returns the number of bytes queued and
+				-1 on error.
+		*/
+		int  HID_API_EXPORT HID_API_CALL hid_write_async(hid_device *dev, const unsigned char *data, size_t length, hid_write_callback callback, void *context);
+
+		/** @brief Wait for Output reports queued by hid_write_async().
+
+			Invokes the callbacks of all writes which completed.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param milliseconds timeout in milliseconds, 0 to only poll
+				or -1 for blocking wait.
+
+			@returns
+				This function returns the number of writes which are
+				still in flight.
+		*/
+		int  HID_API_EXPORT HID_API_CALL hid_write_complete(hid_device *dev, int milliseconds);
+
 		/** @brief Read an Input report from a HID device with timeout.
 
 			Input reports are returned
@@ -268,6 +437,76 @@ extern "C" {
 		*/
 		int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds);
 
+		/** @brief Read an Input report by exchanging buffers.
+
+			Works like hid_read_timeout(), but nothing is copied. The
+			buffer the driver has filled is handed over in @p buffer and
+			the caller buffer takes its place for the next read. The
+			report number is kept in the first byte, also the 0 Windows
+			adds for devices without numbered reports.
+
+			Buffers must come from malloc() and hold a whole Input
+			report. Whichever buffer the device owns is released by
+			hid_close(), the others by the caller.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param buffer In: buffer to give to the device. Out: buffer
+				holding the report, unchanged when nothing was read.
+			@param buffer_size Size of the buffer passed in.
+			@param milliseconds timeout in milliseconds or -1 for blocking wait.
+
+			@returns
+				This function returns the number of bytes in the report,
+				0 on timeout and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_read_timeout_swap(hid_device *dev, unsigned char **buffer, size_t buffer_size, int milliseconds);
+
+		/** @brief Wait until an Input report is available on any of
+			several HID devices.
+
+			Lets one thread service many devices without a blocking
+			read per device. Call hid_read_timeout() with a timeout of 0
+			on every device until it returns 0, that leaves a read
+			pending on each of them, then wait here and read again from
+			the device which became ready.
+
+			@ingroup API
+			@param devs Array of device handles returned from hid_open().
+			@param count Number of devices, at most 64.
+			@param milliseconds timeout in milliseconds or -1 for blocking wait.
+
+			@returns
+				This function returns the index of a device which can
+				be read without blocking, or -1 if none became ready
+				within the timeout.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_wait_any(hid_device **devs, int count, int milliseconds);
+
+		/** @brief Get a handle which becomes ready when an Input report
+			can be read, to wait on it together with handles of the caller.
+
+			On Windows this is the manual reset event of the overlapped
+			read, for WaitForMultipleObjects(). A read is started when none
+			is pending, so call this again before every wait: once a report
+			was taken the event stays signaled until the next read starts.
+			On Linux this is the hidraw descriptor, readable for poll() or
+			epoll while a report is queued.
+
+			After the handle became ready hid_read_timeout() with a timeout
+			of 0 returns the report. The handle belongs to the device and
+			must not be closed or reset by the caller.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param handle Receives the event or descriptor.
+
+			@returns
+				This function returns 0 on success and -1 on error.
+				This function sets the return value of hid_error().
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_get_read_wait_handle(hid_device *dev, hid_wait_handle *handle);
+
 		/** @brief Read an Input report from a HID device.
 
 			Input reports are returned
@@ -310,6 +549,24 @@ extern "C" {
 		*/
 		int  HID_API_EXPORT HID_API_CALL hid_set_nonblocking(hid_device *dev, int nonblock);
 
+		/** @brief Set the number of Input reports queued by the driver.
+
+			Reports which arrive while nobody reads are kept in this
+			queue, once it is full the oldest ones are overwritten.
+			hid_open_path() sets 64. Windows accepts 2 to 512.
+
+			On Linux hidraw keeps a fixed queue of 64 reports, the call
+			only succeeds for counts which fit into it.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param count Number of Input reports to queue.
+
+			@returns
+				This function returns 0 on success and -1 on error.
+		*/
+		int  HID_API_EXPORT HID_API_CALL hid_set_num_input_buffers(hid_device *dev, int count);
+
 		/** @brief Send a Feature report to the device.
 
 			Feature reports are sent over the Control endpoint as a
@@ -367,6 +624,31 @@ extern "C" {
 		*/
 		int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length);
 
+		/** @brief Get several feature reports from a HID device at once.
+
+			Works like calling hid_get_feature_report() for every
+			buffer, but all requests are handed over to the driver
+			before waiting for the first one, so they are in flight
+			together instead of paying a full round trip each.
+
+			This function sets the return value of hid_error().
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param data Array of @p count buffers. The first byte of each
+				one contains the Report ID of the report to be read.
+			@param length Array of @p count buffer lengths, including
+				the report ID byte.
+			@param results Array of @p count results, each receives the
+				same value hid_get_feature_report() would return.
+			@param count Number of reports, at most HID_FEATURE_SLOTS.
+
+			@returns
+				This function returns the number of reports read
+				successfully or -1 if @p count is out of range.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_get_feature_reports(hid_device *dev, unsigned char **data, const size_t *length, int *results, size_t count);
+
 		/** @brief Get a input report from a HID device.
 
 			Set the first byte of @p data[] to the Report ID of the
@@ -392,6 +674,144 @@ extern "C" {
 		*/
 		int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned char *data, size_t length);
 
+		/** @brief Create an I/O completion port for HID devices.
+
+			Lets one thread drive reads, writes and feature requests of
+			many devices. Attach every device with hid_iocp_attach(),
+			queue requests with hid_iocp_submit_*() and collect them
+			with hid_iocp_wait(). The synchronous calls keep working on
+			attached devices and never show up on the port.
+
+			On Linux the port is emulated with epoll. Reads complete
+			once the device becomes readable, writes and feature
+			requests finish inside the submit call.
+
+			@ingroup API
+
+			@returns
+				This function returns a pointer to the port on success
+				or NULL on failure.
+		*/
+		HID_API_EXPORT hid_iocp * HID_API_CALL hid_iocp_create(void);
+
+		/** @brief Destroy a completion port.
+
+			Close every attached device first, this function waits
+			until their cancelled requests have been returned.
+
+			@ingroup API
+			@param iocp A port returned from hid_iocp_create().
+		*/
+		void HID_API_EXPORT HID_API_CALL hid_iocp_destroy(hid_iocp *iocp);
+
+		/** @brief Associate a device with a completion port.
+
+			A device can be attached to one port only, for as long as
+			it stays open.
+
+			@ingroup API
+			@param iocp A port returned from hid_iocp_create().
+			@param dev A device handle returned from hid_open().
+
+			@returns
+				This function returns 0 on success and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_iocp_attach(hid_iocp *iocp, hid_device *dev);
+
+		/** @brief Queue an Input report read on a completion port.
+
+			@p data must stay valid until the completion is returned
+			by hid_iocp_wait(), the report is stored there the same
+			way hid_read() would.
+
+			@ingroup API
+			@param iocp A port the device was attached to.
+			@param dev A device handle returned from hid_open().
+			@param data A buffer to put the read data into.
+			@param length The number of bytes to read.
+			@param context Pointer reported back with the completion.
+
+			@returns
+				This function returns 0 when the request was queued
+				and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_iocp_submit_read(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context);
+
+		/** @brief Queue an Output report write on a completion port.
+
+			The data is copied, see hid_write() for the format.
+
+			@ingroup API
+			@param iocp A port the device was attached to.
+			@param dev A device handle returned from hid_open().
+			@param data The data to send, including the report number.
+			@param length The length in bytes of the data to send.
+			@param context Pointer reported back with the completion.
+
+			@returns
+				This function returns 0 when the request was queued
+				and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_iocp_submit_write(hid_iocp *iocp, hid_device *dev, const unsigned char *data, size_t length, void *context);
+
+		/** @brief Queue a Feature report request on a completion port.
+
+			@p data must stay valid until the completion is returned,
+			see hid_get_feature_report() for the format.
+
+			@ingroup API
+			@param iocp A port the device was attached to.
+			@param dev A device handle returned from hid_open().
+			@param data A buffer with the Report ID in the first byte.
+			@param length The length of the buffer.
+			@param context Pointer reported back with the completion.
+
+			@returns
+				This function returns 0 when the request was queued
+				and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_iocp_submit_get_feature(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context);
+
+		/** @brief Collect finished requests of a completion port.
+
+			Dequeues up to @p count completions with one system call.
+
+			@ingroup API
+			@param iocp A port returned from hid_iocp_create().
+			@param completions Array receiving the completions.
+			@param count Size of the array.
+			@param milliseconds timeout in milliseconds or -1 for blocking wait.
+
+			@returns
+				This function returns the number of completions stored,
+				0 on timeout and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_iocp_wait(hid_iocp *iocp, struct hid_iocp_completion *completions, size_t count, int milliseconds);
+
+		/** @brief Copy the call counters of a device.
+
+			Counters are always on and updated with relaxed atomic
+			operations, no lock is taken. Every counted call reads the
+			monotonic clock twice. Each counter is loaded atomically but the
+			copy is not one atomic snapshot, counters of calls running
+			concurrently may be partly included.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+			@param stats Structure receiving the counters.
+
+			@returns
+				This function returns 0 on success and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_get_stats(hid_device *dev, struct hid_device_stats *stats);
+
+		/** @brief Set all call counters of a device back to zero.
+
+			@ingroup API
+			@param dev A device handle returned from hid_open().
+		*/
+		void HID_API_EXPORT HID_API_CALL hid_reset_stats(hid_device *dev);
+
 		/** @brief Close a HID device.
 
 			This function sets the return value of hid_error().
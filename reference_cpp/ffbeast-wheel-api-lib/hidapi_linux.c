@@ -0,0 +1,1061 @@
+/*******************************************************
+ HIDAPI - Multi-Platform library for
+ communication with HID devices.
+
+ Linux hidraw backend of the FFBeast reference library.
+ Talks to /dev/hidrawN directly, devices are found through udev.
+
+ At the discretion of the user of this library,
+ this software may be licensed under the terms of the
+ GNU General Public License v3, a BSD-Style license, or the
+ original HIDAPI license as outlined in the LICENSE.txt,
+ LICENSE-gpl3.txt, LICENSE-bsd.txt, and LICENSE-orig.txt
+ files located at the root of the source distribution.
+ These files may also be found in the public source
+ code repository located at:
+        https://github.com/libusb/hidapi .
+********************************************************/
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <linux/hidraw.h>
+#include <libudev.h>
+
+#include "hidapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static struct hid_api_version api_version = {
+	.major = HID_API_VERSION_MAJOR,
+	.minor = HID_API_VERSION_MINOR,
+	.patch = HID_API_VERSION_PATCH
+};
+
+/* Largest buffer ever passed to write(). Short reports are padded like on
+   Windows, so the same 65 byte reports work on both platforms. */
+#define WRITE_BUF_SIZE 65
+
+struct hid_iocp_op;
+
+struct hid_device_ {
+	int device_handle;
+	int blocking;
+	wchar_t *last_error_str;
+	hid_iocp *iocp;
+	/* Reads queued by hid_iocp_submit_read(), completed in order */
+	struct hid_iocp_op *read_head;
+	struct hid_iocp_op *read_tail;
+	struct hid_device_stats stats;
+};
+
+static wchar_t *last_global_error_str = NULL;
+
+static hid_device *new_hid_device(void)
+{
+	hid_device *dev = (hid_device*) calloc(1, sizeof(hid_device));
+	if (!dev)
+		return NULL;
+	dev->device_handle = -1;
+	dev->blocking = 1;
+	dev->last_error_str = NULL;
+	dev->iocp = NULL;
+	dev->read_head = NULL;
+	dev->read_tail = NULL;
+	return dev;
+}
+
+static wchar_t *utf8_to_wchar_t(const char *utf8)
+{
+	wchar_t *ret = NULL;
+
+	if (utf8) {
+		size_t wlen = mbstowcs(NULL, utf8, 0);
+		if ((size_t) -1 == wlen) {
+			return wcsdup(L"");
+		}
+		ret = (wchar_t*) calloc(wlen+1, sizeof(wchar_t));
+		if (ret == NULL)
+			return NULL;
+		mbstowcs(ret, utf8, wlen+1);
+		ret[wlen] = 0x0000;
+	}
+
+	return ret;
+}
+
+/* Stores strerror(errno) prefixed with op, like register_error() on Windows
+   stores the FormatMessage() text. */
+static void register_error_str(wchar_t **error_str, const char *op)
+{
+	char msg[256];
+
+	snprintf(msg, sizeof(msg), "%s: %s", op, strerror(errno));
+	free(*error_str);
+	*error_str = utf8_to_wchar_t(msg);
+}
+
+/* Call counters, relaxed atomic updates like on Windows so hid_get_stats()
+   can run on any thread. The structure holds nothing but unsigned long
+   long counters. */
+static void stats_add(unsigned long long *counter, unsigned long long value)
+{
+	__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void stats_max(unsigned long long *counter, unsigned long long value)
+{
+	unsigned long long seen = __atomic_load_n(counter, __ATOMIC_RELAXED);
+	while (seen < value && !__atomic_compare_exchange_n(counter, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static unsigned long long stats_clock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long) now.tv_sec * 1000000000ULL + (unsigned long long) now.tv_nsec;
+}
+
+static int record_op(struct hid_op_stats *op, unsigned long long start, int result)
+{
+	unsigned long long ns = stats_clock() - start;
+	unsigned long long us;
+	int bucket = 0;
+
+	stats_add(&op->calls, 1);
+	if (result < 0)
+		stats_add(&op->errors, 1);
+	else if (result == 0)
+		stats_add(&op->timeouts, 1);
+	else
+		stats_add(&op->bytes, (unsigned long long) result);
+	stats_add(&op->total_ns, ns);
+	stats_max(&op->max_ns, ns);
+	for (us = ns / 1000; us > 1 && bucket < HID_STATS_BUCKETS - 1; us >>= 1)
+		bucket++;
+	stats_add(&op->histogram[bucket], 1);
+	return result;
+}
+
+static void register_error(hid_device *dev, const char *op)
+{
+	stats_add(&dev->stats.registered_errors, 1);
+	register_error_str(&dev->last_error_str, op);
+}
+
+static void clear_error(hid_device *dev)
+{
+	free(dev->last_error_str);
+	dev->last_error_str = NULL;
+}
+
+/* HID_ID looks like 0003:00001234:00005678, bus type then VID and PID */
+static int parse_hid_id(const char *hid_id, unsigned *bus_type, unsigned short *vendor_id, unsigned short *product_id)
+{
+	unsigned int bus, vid, pid;
+
+	if (hid_id == NULL || sscanf(hid_id, "%x:%x:%x", &bus, &vid, &pid) != 3)
+		return 0;
+
+	*bus_type = bus;
+	*vendor_id = (unsigned short) vid;
+	*product_id = (unsigned short) pid;
+	return 1;
+}
+
+static struct udev_device *usb_interface_of(struct udev_device *raw_dev)
+{
+	return udev_device_get_parent_with_subsystem_devtype(raw_dev, "usb", "usb_interface");
+}
+
+static struct udev_device *usb_device_of(struct udev_device *raw_dev)
+{
+	return udev_device_get_parent_with_subsystem_devtype(raw_dev, "usb", "usb_device");
+}
+
+static struct hid_device_info *enumerate_devices(unsigned short vendor_id, unsigned short product_id, int interface_number)
+{
+	struct udev *udev;
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *devices, *dev_list_entry;
+	struct hid_device_info *root = NULL; /* return object */
+	struct hid_device_info *cur_dev = NULL;
+
+	if (hid_init() < 0)
+		return NULL;
+
+	udev = udev_new();
+	if (!udev)
+		return NULL;
+
+	enumerate = udev_enumerate_new(udev);
+	udev_enumerate_add_match_subsystem(enumerate, "hidraw");
+	udev_enumerate_scan_devices(enumerate);
+	devices = udev_enumerate_get_list_entry(enumerate);
+
+	udev_list_entry_foreach(dev_list_entry, devices) {
+		const char *sysfs_path = udev_list_entry_get_name(dev_list_entry);
+		struct udev_device *raw_dev = udev_device_new_from_syspath(udev, sysfs_path);
+		struct udev_device *hid_dev, *intf_dev, *usb_dev;
+		const char *dev_path;
+		unsigned bus_type;
+		unsigned short dev_vid, dev_pid;
+		int dev_interface = -1;
+		struct hid_device_info *tmp;
+
+		if (!raw_dev)
+			continue;
+
+		dev_path = udev_device_get_devnode(raw_dev);
+		hid_dev = udev_device_get_parent_with_subsystem_devtype(raw_dev, "hid", NULL);
+		if (!dev_path || !hid_dev ||
+		    !parse_hid_id(udev_device_get_property_value(hid_dev, "HID_ID"), &bus_type, &dev_vid, &dev_pid))
+			goto next;
+
+		/* Cheap checks first, the rest of the attributes are only read
+		   for devices which are going to be returned. */
+		if ((vendor_id != 0x0 && vendor_id != dev_vid) ||
+		    (product_id != 0x0 && product_id != dev_pid))
+			goto next;
+
+		intf_dev = usb_interface_of(raw_dev);
+		if (intf_dev) {
+			const char *str = udev_device_get_sysattr_value(intf_dev, "bInterfaceNumber");
+			dev_interface = str ? (int) strtol(str, NULL, 16) : -1;
+		}
+		if (interface_number >= 0 && interface_number != dev_interface)
+			goto next;
+
+		tmp = (struct hid_device_info*) calloc(1, sizeof(struct hid_device_info));
+		if (cur_dev)
+			cur_dev->next = tmp;
+		else
+			root = tmp;
+		cur_dev = tmp;
+
+		cur_dev->path = strdup(dev_path);
+		cur_dev->vendor_id = dev_vid;
+		cur_dev->product_id = dev_pid;
+		cur_dev->interface_number = dev_interface;
+		cur_dev->serial_number = utf8_to_wchar_t(udev_device_get_property_value(hid_dev, "HID_UNIQ"));
+		cur_dev->product_string = utf8_to_wchar_t(udev_device_get_property_value(hid_dev, "HID_NAME"));
+
+		usb_dev = usb_device_of(raw_dev);
+		if (usb_dev) {
+			const char *str = udev_device_get_sysattr_value(usb_dev, "bcdDevice");
+			cur_dev->release_number = str ? (unsigned short) strtol(str, NULL, 16) : 0x0;
+			free(cur_dev->product_string);
+			cur_dev->manufacturer_string = utf8_to_wchar_t(udev_device_get_sysattr_value(usb_dev, "manufacturer"));
+			cur_dev->product_string = utf8_to_wchar_t(udev_device_get_sysattr_value(usb_dev, "product"));
+		}
+
+		/* Usage page and usage would need the report descriptor to be
+		   parsed, nothing in this library looks at them. */
+		cur_dev->usage_page = 0;
+		cur_dev->usage = 0;
+
+	next:
+		udev_device_unref(raw_dev);
+	}
+
+	udev_enumerate_unref(enumerate);
+	udev_unref(udev);
+
+	return root;
+}
+
+/* Looks up the udev node of an open device, the strings are not available
+   through hidraw itself. */
+static int get_device_string(hid_device *dev, const char *key, wchar_t *string, size_t maxlen)
+{
+	struct udev *udev;
+	struct udev_device *raw_dev, *usb_dev;
+	struct stat s;
+	const char *str = NULL;
+	int ret = -1;
+
+	if (maxlen == 0)
+		return -1;
+
+	if (fstat(dev->device_handle, &s) < 0) {
+		register_error(dev, "fstat");
+		return -1;
+	}
+
+	udev = udev_new();
+	if (!udev)
+		return -1;
+
+	raw_dev = udev_device_new_from_devnum(udev, 'c', s.st_rdev);
+	if (raw_dev) {
+		usb_dev = usb_device_of(raw_dev);
+		if (usb_dev)
+			str = udev_device_get_sysattr_value(usb_dev, key);
+		if (str) {
+			size_t len = mbstowcs(string, str, maxlen);
+			if (len != (size_t) -1) {
+				string[(len < maxlen) ? len : maxlen - 1] = 0x0000;
+				ret = 0;
+			}
+		}
+		udev_device_unref(raw_dev);
+	}
+	udev_unref(udev);
+
+	return ret;
+}
+
+HID_API_EXPORT const struct hid_api_version* HID_API_CALL hid_version()
+{
+	return &api_version;
+}
+
+HID_API_EXPORT const char* HID_API_CALL hid_version_str()
+{
+	return HID_API_VERSION_STR;
+}
+
+int HID_API_EXPORT hid_init(void)
+{
+	const char *locale;
+
+	/* Set the locale if it's not set, udev strings are converted with
+	   mbstowcs(). */
+	locale = setlocale(LC_CTYPE, NULL);
+	if (!locale)
+		setlocale(LC_CTYPE, "");
+
+	return 0;
+}
+
+int HID_API_EXPORT hid_exit(void)
+{
+	free(last_global_error_str);
+	last_global_error_str = NULL;
+	return 0;
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+	return enumerate_devices(vendor_id, product_id, -1);
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate_usb_interface(unsigned short vendor_id, unsigned short product_id, int interface_number)
+{
+	return enumerate_devices(vendor_id, product_id, interface_number);
+}
+
+void  HID_API_EXPORT HID_API_CALL hid_free_enumeration(struct hid_device_info *devs)
+{
+	struct hid_device_info *d = devs;
+	while (d) {
+		struct hid_device_info *next = d->next;
+		free(d->path);
+		free(d->serial_number);
+		free(d->manufacturer_string);
+		free(d->product_string);
+		free(d);
+		d = next;
+	}
+}
+
+HID_API_EXPORT hid_device * HID_API_CALL hid_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number)
+{
+	struct hid_device_info *devs, *cur_dev;
+	const char *path_to_open = NULL;
+	hid_device *handle = NULL;
+
+	devs = hid_enumerate(vendor_id, product_id);
+	cur_dev = devs;
+	while (cur_dev) {
+		if (serial_number) {
+			if (cur_dev->serial_number && wcscmp(serial_number, cur_dev->serial_number) == 0) {
+				path_to_open = cur_dev->path;
+				break;
+			}
+		}
+		else {
+			path_to_open = cur_dev->path;
+			break;
+		}
+		cur_dev = cur_dev->next;
+	}
+
+	if (path_to_open) {
+		/* Open the device */
+		handle = hid_open_path(path_to_open);
+	}
+
+	hid_free_enumeration(devs);
+	return handle;
+}
+
+HID_API_EXPORT hid_device * HID_API_CALL hid_open_path(const char *path)
+{
+	hid_device *dev;
+
+	if (hid_init() < 0)
+		return NULL;
+
+	dev = new_hid_device();
+	if (!dev) {
+		errno = ENOMEM;
+		register_error_str(&last_global_error_str, "calloc");
+		return NULL;
+	}
+
+	/* The handle stays non-blocking, waiting is done with poll() so the
+	   timeout of every call is honoured. */
+	dev->device_handle = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (dev->device_handle < 0) {
+		register_error_str(&last_global_error_str, "open");
+		free(dev);
+		return NULL;
+	}
+
+	return dev;
+}
+
+static int write_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+	unsigned char buf[WRITE_BUF_SIZE];
+	const unsigned char *out = data;
+	struct pollfd fds;
+	ssize_t res;
+
+	/* Pad short reports the same way hid_write() on Windows does. */
+	if (length < WRITE_BUF_SIZE) {
+		memcpy(buf, data, length);
+		memset(buf + length, 0, WRITE_BUF_SIZE - length);
+		out = buf;
+		length = WRITE_BUF_SIZE;
+	}
+
+	for (;;) {
+		res = write(dev->device_handle, out, length);
+		if (res >= 0) {
+			clear_error(dev);
+			return (int) res;
+		}
+		if (errno != EAGAIN && errno != EINTR)
+			break;
+
+		/* Same one second limit as the Windows backend */
+		fds.fd = dev->device_handle;
+		fds.events = POLLOUT;
+		fds.revents = 0;
+		if (poll(&fds, 1, 1000) == 0) {
+			errno = ETIMEDOUT;
+			stats_add(&dev->stats.write.timeouts, 1);
+			break;
+		}
+	}
+
+	register_error(dev, "write");
+	return -1;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+	unsigned long long start = stats_clock();
+	return record_op(&dev->stats.write, start, write_report(dev, data, length));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write_async(hid_device *dev, const unsigned char *data, size_t length, hid_write_callback callback, void *context)
+{
+	/* hidraw completes an Output report inside write(), so there is no
+	   queue to keep. The callback still fires from here, which matches the
+	   contract of the Windows backend. */
+	unsigned long long start = stats_clock();
+	int result = record_op(&dev->stats.write, start, write_report(dev, data, length));
+
+	if (callback)
+		callback(context, result);
+
+	return result;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write_complete(hid_device *dev, int milliseconds)
+{
+	(void) dev;
+	(void) milliseconds;
+	return 0;
+}
+
+static int read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+	ssize_t bytes_read;
+
+	if (milliseconds != 0) {
+		struct pollfd fds;
+		int ret;
+
+		fds.fd = dev->device_handle;
+		fds.events = POLLIN;
+		fds.revents = 0;
+		ret = poll(&fds, 1, milliseconds);
+		if (ret == 0) {
+			/* Timeout */
+			return 0;
+		}
+		if (ret < 0) {
+			if (errno == EINTR)
+				return 0;
+			register_error(dev, "poll");
+			return -1;
+		}
+		if (fds.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			/* Device was unplugged */
+			errno = ENODEV;
+			register_error(dev, "poll");
+			return -1;
+		}
+	}
+
+	bytes_read = read(dev->device_handle, data, length);
+	if (bytes_read < 0) {
+		if (errno == EAGAIN || errno == EINPROGRESS || errno == EINTR)
+			return 0;
+		register_error(dev, "read");
+		return -1;
+	}
+
+	return (int) bytes_read;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+	unsigned long long start = stats_clock();
+	return record_op(&dev->stats.read, start, read_timeout(dev, data, length, milliseconds));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout_swap(hid_device *dev, unsigned char **buffer, size_t buffer_size, int milliseconds)
+{
+	/* hidraw already reads straight into the caller buffer, nothing is
+	   exchanged. */
+	return hid_read_timeout(dev, *buffer, buffer_size, milliseconds);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_wait_any(hid_device **devs, int count, int milliseconds)
+{
+	struct pollfd fds[64];
+	int ret, i;
+
+	if (count <= 0 || count > 64)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		fds[i].fd = devs[i]->device_handle;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	ret = poll(fds, (nfds_t) count, milliseconds);
+	if (ret <= 0)
+		return -1;
+
+	/* Errors count as ready too, the next read reports them. */
+	for (i = 0; i < count; i++) {
+		if (fds[i].revents)
+			return i;
+	}
+
+	return -1;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_read_wait_handle(hid_device *dev, hid_wait_handle *handle)
+{
+	/* hidraw queues reports in the kernel, the descriptor stays readable
+	   while any is queued, nothing has to be armed. */
+	*handle = dev->device_handle;
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read(hid_device *dev, unsigned char *data, size_t length)
+{
+	return hid_read_timeout(dev, data, length, (dev->blocking)? -1: 0);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_set_nonblocking(hid_device *dev, int nonblock)
+{
+	dev->blocking = !nonblock;
+	return 0; /* Success */
+}
+
+int HID_API_EXPORT HID_API_CALL hid_set_num_input_buffers(hid_device *dev, int count)
+{
+	/* HIDRAW_BUFFER_SIZE in the kernel, not configurable from user space */
+	if (count <= 0 || count > 64) {
+		errno = EINVAL;
+		register_error(dev, "hid_set_num_input_buffers");
+		return -1;
+	}
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+	int res;
+
+	res = ioctl(dev->device_handle, HIDIOCSFEATURE(length), data);
+	if (res < 0) {
+		register_error(dev, "ioctl (SFEATURE)");
+		return -1;
+	}
+
+	return res;
+}
+
+static int get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+	int res;
+
+	/* The report ID stays in the first byte and is included in the
+	   returned length, same as on Windows. */
+	res = ioctl(dev->device_handle, HIDIOCGFEATURE(length), data);
+	if (res < 0) {
+		register_error(dev, "ioctl (GFEATURE)");
+		return -1;
+	}
+
+	return res;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+	unsigned long long start = stats_clock();
+	return record_op(&dev->stats.get_feature, start, get_feature_report(dev, data, length));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_feature_reports(hid_device *dev, unsigned char **data, const size_t *length, int *results, size_t count)
+{
+	unsigned long long start = stats_clock();
+	size_t i;
+	int succeeded = 0;
+	int bytes = 0;
+
+	if (count == 0 || count > HID_FEATURE_SLOTS)
+		return -1;
+
+	/* The hidraw ioctl is synchronous, requests go one after another. */
+	for (i = 0; i < count; i++) {
+		results[i] = get_feature_report(dev, data[i], length[i]);
+		if (results[i] > 0) {
+			bytes += results[i];
+			succeeded++;
+		}
+	}
+
+	/* The whole batch counts as one call, failed when nothing came back. */
+	record_op(&dev->stats.get_feature, start, succeeded > 0 ? bytes : -1);
+	return succeeded;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned char *data, size_t length)
+{
+#ifdef HIDIOCGINPUT
+	int res;
+
+	res = ioctl(dev->device_handle, HIDIOCGINPUT(length), data);
+	if (res < 0) {
+		register_error(dev, "ioctl (GINPUT)");
+		return -1;
+	}
+
+	return res;
+#else
+	(void) data;
+	(void) length;
+	errno = ENOSYS;
+	register_error(dev, "ioctl (GINPUT)");
+	return -1;
+#endif
+}
+
+/* hid_iocp on top of epoll. Reads complete once epoll reports the device
+   readable. Writes and feature requests finish inside the submit call,
+   hidraw has no asynchronous form of them, and are queued as completed. */
+
+struct hid_iocp_op {
+	hid_device *dev;
+	int type;
+	unsigned char *data; /* Caller buffer */
+	size_t length;
+	void *context;
+	int result;
+	struct hid_iocp_op *next;
+};
+
+struct hid_iocp_ {
+	int epoll_fd;
+	int wake_fd; /* eventfd, woken when something lands on the done list */
+	pthread_mutex_t lock;
+	struct hid_iocp_op ops[HID_IOCP_OPS];
+	struct hid_iocp_op *free_ops;
+	struct hid_iocp_op *done_head;
+	struct hid_iocp_op *done_tail;
+};
+
+/* Called with the lock held */
+static void push_done(hid_iocp *iocp, struct hid_iocp_op *op)
+{
+	op->next = NULL;
+	if (iocp->done_tail)
+		iocp->done_tail->next = op;
+	else
+		iocp->done_head = op;
+	iocp->done_tail = op;
+}
+
+/* Called with the lock held. Interest in input is dropped while no read
+   is queued, epoll_wait() would otherwise return right away forever. */
+static void update_read_interest(hid_iocp *iocp, hid_device *dev)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = dev->read_head ? EPOLLIN : 0;
+	ev.data.ptr = dev;
+	epoll_ctl(iocp->epoll_fd, EPOLL_CTL_MOD, dev->device_handle, &ev);
+}
+
+static struct hid_iocp_op *acquire_iocp_op(hid_iocp *iocp, hid_device *dev, int type)
+{
+	struct hid_iocp_op *op;
+
+	pthread_mutex_lock(&iocp->lock);
+	op = iocp->free_ops;
+	if (op)
+		iocp->free_ops = op->next;
+	pthread_mutex_unlock(&iocp->lock);
+
+	/* Every request slot is in flight */
+	if (!op)
+		return NULL;
+
+	op->dev = dev;
+	op->type = type;
+	op->next = NULL;
+	return op;
+}
+
+static void complete_iocp_op(hid_iocp *iocp, struct hid_iocp_op *op, int result)
+{
+	uint64_t one = 1;
+
+	op->result = result;
+	pthread_mutex_lock(&iocp->lock);
+	push_done(iocp, op);
+	pthread_mutex_unlock(&iocp->lock);
+	if (write(iocp->wake_fd, &one, sizeof(one)) < 0) {
+		/* Counter is saturated, the waiter is awake anyway */
+	}
+}
+
+HID_API_EXPORT hid_iocp * HID_API_CALL hid_iocp_create(void)
+{
+	struct epoll_event ev;
+	int i;
+	hid_iocp *iocp = (hid_iocp*) calloc(1, sizeof(hid_iocp));
+
+	if (!iocp)
+		return NULL;
+
+	iocp->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	iocp->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (iocp->epoll_fd < 0 || iocp->wake_fd < 0)
+		goto err;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(iocp->epoll_fd, EPOLL_CTL_ADD, iocp->wake_fd, &ev) < 0)
+		goto err;
+
+	pthread_mutex_init(&iocp->lock, NULL);
+	for (i = HID_IOCP_OPS - 1; i >= 0; i--) {
+		iocp->ops[i].next = iocp->free_ops;
+		iocp->free_ops = &iocp->ops[i];
+	}
+
+	return iocp;
+
+err:
+	if (iocp->epoll_fd >= 0)
+		close(iocp->epoll_fd);
+	if (iocp->wake_fd >= 0)
+		close(iocp->wake_fd);
+	free(iocp);
+	return NULL;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_iocp_destroy(hid_iocp *iocp)
+{
+	if (!iocp)
+		return;
+
+	/* Nothing is owned by the kernel here, requests of devices which were
+	   closed before have already been completed by hid_close(). */
+	close(iocp->epoll_fd);
+	close(iocp->wake_fd);
+	pthread_mutex_destroy(&iocp->lock);
+	free(iocp);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_attach(hid_iocp *iocp, hid_device *dev)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = 0;
+	ev.data.ptr = dev;
+	if (epoll_ctl(iocp->epoll_fd, EPOLL_CTL_ADD, dev->device_handle, &ev) < 0) {
+		register_error(dev, "epoll_ctl");
+		return -1;
+	}
+	dev->iocp = iocp;
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_read(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context)
+{
+	struct hid_iocp_op *op = acquire_iocp_op(iocp, dev, HID_IOCP_READ);
+
+	if (!op)
+		return -1;
+	op->data = data;
+	op->length = length;
+	op->context = context;
+
+	pthread_mutex_lock(&iocp->lock);
+	if (dev->read_tail)
+		dev->read_tail->next = op;
+	else
+		dev->read_head = op;
+	dev->read_tail = op;
+	if (dev->read_head == op)
+		update_read_interest(iocp, dev);
+	pthread_mutex_unlock(&iocp->lock);
+
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_write(hid_iocp *iocp, hid_device *dev, const unsigned char *data, size_t length, void *context)
+{
+	struct hid_iocp_op *op = acquire_iocp_op(iocp, dev, HID_IOCP_WRITE);
+
+	if (!op)
+		return -1;
+	op->data = NULL;
+	op->length = length;
+	op->context = context;
+	complete_iocp_op(iocp, op, hid_write(dev, data, length));
+
+	return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_get_feature(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context)
+{
+	struct hid_iocp_op *op = acquire_iocp_op(iocp, dev, HID_IOCP_GET_FEATURE);
+
+	if (!op)
+		return -1;
+	op->data = data;
+	op->length = length;
+	op->context = context;
+	complete_iocp_op(iocp, op, hid_get_feature_report(dev, data, length));
+
+	return 0;
+}
+
+/* Called with the lock held. Serves queued reads of a readable device
+   until it runs dry. */
+static void service_reads(hid_iocp *iocp, hid_device *dev)
+{
+	while (dev->read_head) {
+		struct hid_iocp_op *op = dev->read_head;
+		ssize_t bytes_read = read(dev->device_handle, op->data, op->length);
+
+		if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR))
+			break;
+		if (bytes_read < 0)
+			register_error(dev, "read");
+
+		dev->read_head = op->next;
+		if (!dev->read_head)
+			dev->read_tail = NULL;
+		op->result = (bytes_read < 0) ? -1 : (int) bytes_read;
+		push_done(iocp, op);
+	}
+	update_read_interest(iocp, dev);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_wait(hid_iocp *iocp, struct hid_iocp_completion *completions, size_t count, int milliseconds)
+{
+	struct epoll_event events[HID_IOCP_OPS];
+	int filled = 0;
+	int ready, i;
+
+	if (count > HID_IOCP_OPS)
+		count = HID_IOCP_OPS;
+	if (count == 0)
+		return 0;
+
+	/* Only block when nothing is waiting to be reported */
+	pthread_mutex_lock(&iocp->lock);
+	if (iocp->done_head)
+		milliseconds = 0;
+	pthread_mutex_unlock(&iocp->lock);
+
+	ready = epoll_wait(iocp->epoll_fd, events, (int) count, milliseconds);
+	if (ready < 0 && errno != EINTR)
+		return -1;
+
+	pthread_mutex_lock(&iocp->lock);
+	for (i = 0; i < ready; i++) {
+		if (events[i].data.ptr == NULL) {
+			uint64_t value;
+			if (read(iocp->wake_fd, &value, sizeof(value)) < 0) {
+				/* Already drained by an earlier pass */
+			}
+			continue;
+		}
+		service_reads(iocp, (hid_device *) events[i].data.ptr);
+	}
+
+	while (iocp->done_head && (size_t) filled < count) {
+		struct hid_iocp_op *op = iocp->done_head;
+		struct hid_iocp_completion *c = &completions[filled++];
+
+		iocp->done_head = op->next;
+		if (!iocp->done_head)
+			iocp->done_tail = NULL;
+
+		c->dev = op->dev;
+		c->type = op->type;
+		c->result = op->result;
+		c->data = op->data;
+		c->context = op->context;
+
+		op->next = iocp->free_ops;
+		iocp->free_ops = op;
+	}
+	pthread_mutex_unlock(&iocp->lock);
+
+	return filled;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_close(hid_device *dev)
+{
+	if (!dev)
+		return;
+
+	if (dev->iocp) {
+		hid_iocp *iocp = dev->iocp;
+
+		/* Reads which are still queued are reported as failed, like
+		   cancelled requests on Windows. */
+		pthread_mutex_lock(&iocp->lock);
+		epoll_ctl(iocp->epoll_fd, EPOLL_CTL_DEL, dev->device_handle, NULL);
+		while (dev->read_head) {
+			struct hid_iocp_op *op = dev->read_head;
+			dev->read_head = op->next;
+			op->result = -1;
+			push_done(iocp, op);
+		}
+		dev->read_tail = NULL;
+		pthread_mutex_unlock(&iocp->lock);
+	}
+
+	close(dev->device_handle);
+	free(dev->last_error_str);
+	free(dev);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	return get_device_string(dev, "manufacturer", string, maxlen);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_product_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	return get_device_string(dev, "product", string, maxlen);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_serial_number_string(hid_device *dev, wchar_t *string, size_t maxlen)
+{
+	return get_device_string(dev, "serial", string, maxlen);
+}
+
+int HID_API_EXPORT_CALL HID_API_CALL hid_get_indexed_string(hid_device *dev, int string_index, wchar_t *string, size_t maxlen)
+{
+	(void) string_index;
+	(void) string;
+	(void) maxlen;
+
+	/* hidraw gives no access to arbitrary string descriptors */
+	errno = ENOSYS;
+	register_error(dev, "hid_get_indexed_string");
+	return -1;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_stats(hid_device *dev, struct hid_device_stats *stats)
+{
+	unsigned long long *source, *destination;
+	size_t i;
+
+	if (!dev || !stats)
+		return -1;
+	source = (unsigned long long *) &dev->stats;
+	destination = (unsigned long long *) stats;
+	for (i = 0; i < sizeof(*stats) / sizeof(unsigned long long); i++)
+		destination[i] = __atomic_load_n(&source[i], __ATOMIC_RELAXED);
+	return 0;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_reset_stats(hid_device *dev)
+{
+	size_t i;
+
+	if (dev) {
+		for (i = 0; i < sizeof(dev->stats) / sizeof(unsigned long long); i++)
+			__atomic_store_n(&((unsigned long long *) &dev->stats)[i], 0, __ATOMIC_RELAXED);
+	}
+}
+
+HID_API_EXPORT const wchar_t * HID_API_CALL  hid_error(hid_device *dev)
+{
+	if (dev) {
+		if (dev->last_error_str == NULL)
+			return L"Success";
+		return dev->last_error_str;
+	}
+
+	if (last_global_error_str == NULL)
+		return L"Success";
+	return last_global_error_str;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __linux__ */
@@ -0,0 +1,1102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "hidapi.h"
+#include "hidapi_mock.h"
+#include "host_clock.h"
+#include "settings_fields.h"
+
+#define MOCK_REPORT_SIZE        65 // Report id and 64 byte payload, same as on the wire
+#define MOCK_MAX_INPUT_BUFFERS  512 // Same limit as the Windows driver
+#define MOCK_WAIT_SLICE_NS      10000000ULL // Longest sleep, waiting reads notice unplugging within this time
+#define MOCK_SPIN_NS            200000ULL // Closer than this to the next report waits yield instead of sleeping
+
+typedef struct __attribute__((packed)) {
+    uint8_t ReportId;
+    DeviceStateTypeDef State;
+} MockStateReportTypeDef;
+
+/**
+ * Simulated device. Read path only touches atomics, settings and license are guarded by the lock.
+ * */
+typedef struct {
+    std::mutex lock;
+    DeviceSettingsTypeDef settings;
+    DeviceSettingsTypeDef flash; // Settings restored on reboot
+    FirmwareLicenseTypeDef license;
+
+    std::atomic<bool> connected;
+    std::atomic<uint32_t> rate;
+    std::atomic<int16_t> position;
+    std::atomic<uint32_t> firmware; // FirmwareVersionTypeDef
+    std::atomic<uint8_t> registered;
+    std::atomic<uint64_t> control; // DirectControlTypeDef, 7 bytes fit in one atomic word
+    std::atomic<int32_t> forceScale; // 0 to 100, TotalEffectStrength or 0 when force is disabled
+    std::atomic<uint64_t> epoch; // Time report timeline started
+    std::atomic<uint32_t> generation; // Bumped on every restart of timeline, handles then start over
+    std::atomic<bool> replaying; // Reports carry replayState instead of the simulated state
+    SeqLock<DeviceStateTypeDef> replayState; // Written by MockWheelSetState only
+
+    std::atomic<uint64_t> stateReports;
+    std::atomic<uint64_t> overwrittenReports;
+    std::atomic<uint64_t> controlReports;
+    std::atomic<uint64_t> settingsWrites;
+    std::atomic<uint64_t> featureReads;
+    std::atomic<uint64_t> commands;
+} MockDeviceTypeDef;
+
+struct hid_iocp_op;
+
+struct hid_device_ {
+    MockDeviceTypeDef *device;
+    int index;
+    int blocking;
+    int inputBuffers;
+    uint32_t generation;
+    uint64_t consumed; // Reports of the timeline this handle has read or lost
+    const wchar_t *lastError;
+    hid_iocp *iocp;
+    struct hid_device_stats stats;
+};
+
+static_assert(sizeof(DirectControlTypeDef) <= sizeof(uint64_t), "Direct control must fit one atomic word");
+static_assert(sizeof(MockStateReportTypeDef) == MOCK_REPORT_SIZE, "State report must be 65 bytes");
+
+static struct hid_api_version api_version = {
+    HID_API_VERSION_MAJOR,
+    HID_API_VERSION_MINOR,
+    HID_API_VERSION_PATCH
+};
+
+static std::atomic<int> deviceCount{1};
+
+static void FactorySettings(DeviceSettingsTypeDef *settings){
+    memset(settings, 0, sizeof(DeviceSettingsTypeDef));
+    settings->Effect.MotionRange = 900;
+    settings->Effect.TotalEffectStrength = 100;
+    settings->Effect.SoftStopRange = 10;
+    settings->Effect.SoftStopStrength = 100;
+    settings->Effect.DirectXConstantDirection = 1;
+    settings->Effect.DirectXSpringStrength = 100;
+    settings->Effect.DirectXConstantStrength = 100;
+    settings->Effect.DirectXPeriodicStrength = 100;
+    settings->Hardware.EncoderCPR = 4096;
+    settings->Hardware.IntegralGain = 100;
+    settings->Hardware.ProportionalGain = 50;
+    settings->Hardware.ForceEnabled = 1;
+    settings->Hardware.AmplifierGain = AMPLIFIER_GAIN_20;
+    settings->Hardware.CalibrationMagnitude = 30;
+    settings->Hardware.CalibrationSpeed = 50;
+    settings->Hardware.PowerLimit = 100;
+    settings->Hardware.BrakingLimit = 50;
+    settings->Hardware.SpeedBufferSize = 8;
+    settings->Hardware.EncoderDirection = 1;
+    settings->Hardware.ForceDirection = 1;
+    settings->Hardware.PolePairs = 7;
+    for (int i = 0; i < 3; i++){
+        settings->Adc.RAxisMax[i] = 4095;
+        settings->Adc.RAxisToButtonHigh[i] = 100;
+    }
+}
+
+static uint32_t PackFirmware(FirmwareVersionTypeDef version){
+    uint32_t packed;
+    memcpy(&packed, &version, sizeof(packed));
+    return packed;
+}
+
+static FirmwareVersionTypeDef UnpackFirmware(uint32_t packed){
+    FirmwareVersionTypeDef version;
+    memcpy(&version, &packed, sizeof(version));
+    return version;
+}
+
+static DirectControlTypeDef LoadControl(const MockDeviceTypeDef *device){
+    uint64_t packed = device->control.load(std::memory_order_acquire);
+    DirectControlTypeDef control;
+    memcpy(&control, &packed, sizeof(control));
+    return control;
+}
+
+static void StoreControl(MockDeviceTypeDef *device, const DirectControlTypeDef *control){
+    uint64_t packed = 0;
+    memcpy(&packed, control, sizeof(DirectControlTypeDef));
+    device->control.store(packed, std::memory_order_release);
+}
+
+// Called with the lock held after settings changed
+static void UpdateForceScale(MockDeviceTypeDef *device){
+    int32_t scale = device->settings.Hardware.ForceEnabled ? device->settings.Effect.TotalEffectStrength : 0;
+    device->forceScale.store(scale, std::memory_order_relaxed);
+}
+
+static void RestartTimeline(MockDeviceTypeDef *device){
+    device->epoch.store(HostClockNanoseconds(), std::memory_order_relaxed);
+    device->generation.fetch_add(1, std::memory_order_release);
+}
+
+static void ResetDevice(MockDeviceTypeDef *device, int index){
+    std::lock_guard<std::mutex> guard(device->lock);
+    FactorySettings(&device->settings);
+    memcpy(&device->flash, &device->settings, sizeof(DeviceSettingsTypeDef));
+
+    FirmwareVersionTypeDef version = {1, 25, 1, 0};
+    memset(&device->license, 0, sizeof(FirmwareLicenseTypeDef));
+    device->license.DeviceId[0] = 0x4D4F434B; // "MOCK"
+    device->license.DeviceId[2] = (uint32_t) index;
+
+    device->connected.store(true, std::memory_order_relaxed);
+    device->rate.store(MOCK_WHEEL_DEFAULT_RATE_HZ, std::memory_order_relaxed);
+    device->position.store(0, std::memory_order_relaxed);
+    device->firmware.store(PackFirmware(version), std::memory_order_relaxed);
+    device->registered.store(1, std::memory_order_relaxed);
+    device->control.store(0, std::memory_order_relaxed);
+    device->replaying.store(false, std::memory_order_relaxed);
+    UpdateForceScale(device);
+
+    device->stateReports.store(0, std::memory_order_relaxed);
+    device->overwrittenReports.store(0, std::memory_order_relaxed);
+    device->controlReports.store(0, std::memory_order_relaxed);
+    device->settingsWrites.store(0, std::memory_order_relaxed);
+    device->featureReads.store(0, std::memory_order_relaxed);
+    device->commands.store(0, std::memory_order_relaxed);
+    RestartTimeline(device);
+}
+
+static MockDeviceTypeDef *Devices(){
+    // Function local, so devices exist before the first hid_init of any static WheelApi
+    static MockDeviceTypeDef devices[MOCK_WHEEL_MAX_DEVICES];
+    static bool ready = [](){
+        for (int i = 0; i < MOCK_WHEEL_MAX_DEVICES; i++){
+            ResetDevice(&devices[i], i);
+        }
+        return true;
+    }();
+    (void) ready;
+    return devices;
+}
+
+static MockDeviceTypeDef *FindDevice(int index){
+    if (index < 0 || index >= MOCK_WHEEL_MAX_DEVICES){
+        return nullptr;
+    }
+    return &Devices()[index];
+}
+
+// Call counters, same semantics and relaxed atomic updates as in the hardware backends
+static void StatsAdd(unsigned long long *counter, unsigned long long value){
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void StatsMax(unsigned long long *counter, unsigned long long value){
+    unsigned long long seen = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (seen < value && !__atomic_compare_exchange_n(counter, &seen, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    }
+}
+
+static int RecordOp(struct hid_op_stats *op, uint64_t start, int result){
+    uint64_t ns = HostClockNanoseconds() - start;
+    int bucket = 0;
+    StatsAdd(&op->calls, 1);
+    if (result < 0){
+        StatsAdd(&op->errors, 1);
+    } else if (result == 0){
+        StatsAdd(&op->timeouts, 1);
+    } else {
+        StatsAdd(&op->bytes, (unsigned long long) result);
+    }
+    StatsAdd(&op->total_ns, ns);
+    StatsMax(&op->max_ns, ns);
+    for (uint64_t us = ns / 1000; us > 1 && bucket < HID_STATS_BUCKETS - 1; us >>= 1){
+        bucket++;
+    }
+    StatsAdd(&op->histogram[bucket], 1);
+    return result;
+}
+
+static int Fail(hid_device *dev, const wchar_t *message){
+    StatsAdd(&dev->stats.registered_errors, 1);
+    dev->lastError = message;
+    return -1;
+}
+
+static int CheckConnected(hid_device *dev){
+    if (!dev->device->connected.load(std::memory_order_acquire)){
+        return Fail(dev, L"Device disconnected");
+    }
+    return 1;
+}
+
+// Number of reports timeline has produced by now, split so hours of nanoseconds times rate never overflow
+static uint64_t DueReports(uint64_t elapsed, uint32_t rate){
+    return (elapsed / 1000000000ULL) * rate + (elapsed % 1000000000ULL) * rate / 1000000000ULL;
+}
+
+// Time report number count of the timeline is due
+static uint64_t ReportDueTime(uint64_t epoch, uint64_t count, uint32_t rate){
+    return epoch + (count / rate) * 1000000000ULL + ((count % rate) * 1000000000ULL + rate - 1) / rate;
+}
+
+static void SleepUntil(uint64_t time){
+    uint64_t now = HostClockNanoseconds();
+    if (now >= time){
+        return;
+    }
+    uint64_t remaining = time - now;
+    if (remaining > MOCK_WAIT_SLICE_NS){
+        remaining = MOCK_WAIT_SLICE_NS;
+    }
+    if (remaining > MOCK_SPIN_NS){
+        std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - MOCK_SPIN_NS / 2));
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+// Takes next report of the handle off the timeline. Returns 1 when one is available, 0 when none is due yet.
+static int TakeReport(hid_device *dev, uint64_t now, uint64_t *nextDue){
+    MockDeviceTypeDef *device = dev->device;
+    uint32_t generation = device->generation.load(std::memory_order_acquire);
+    if (generation != dev->generation){
+        dev->generation = generation;
+        dev->consumed = 0;
+    }
+
+    uint32_t rate = device->rate.load(std::memory_order_relaxed);
+    if (rate == 0){
+        dev->consumed++;
+        device->stateReports.fetch_add(1, std::memory_order_relaxed);
+        return 1;
+    }
+
+    uint64_t epoch = device->epoch.load(std::memory_order_relaxed);
+    uint64_t due = now > epoch ? DueReports(now - epoch, rate) : 0;
+    if (due <= dev->consumed){
+        *nextDue = ReportDueTime(epoch, dev->consumed + 1, rate);
+        return 0;
+    }
+    // Driver keeps the newest reports only, older ones are gone for good
+    uint64_t backlog = due - dev->consumed;
+    if (backlog > (uint64_t) dev->inputBuffers){
+        device->overwrittenReports.fetch_add(backlog - dev->inputBuffers, std::memory_order_relaxed);
+        dev->consumed = due - dev->inputBuffers;
+    }
+    dev->consumed++;
+    device->stateReports.fetch_add(1, std::memory_order_relaxed);
+    return 1;
+}
+
+static int FillStateReport(hid_device *dev, unsigned char *data, size_t length){
+    MockDeviceTypeDef *device = dev->device;
+    MockStateReportTypeDef report;
+    memset(&report, 0, sizeof(report));
+    report.ReportId = REPORT_GENERIC_INPUT_OUTPUT;
+    if (device->replaying.load(std::memory_order_acquire) && device->replayState.load(&report.State) != 0){
+        size_t size = length < sizeof(report) ? length : sizeof(report);
+        memcpy(data, &report, size);
+        return (int) size;
+    }
+    report.State.FirmwareVersion = UnpackFirmware(device->firmware.load(std::memory_order_relaxed));
+    report.State.IsRegistered = device->registered.load(std::memory_order_relaxed);
+
+    int32_t position = device->position.load(std::memory_order_relaxed);
+    DirectControlTypeDef control = LoadControl(device);
+    int32_t torque = control.ConstantForce + control.PeriodicForce - control.SpringForce * position / 10000;
+    torque = torque * device->forceScale.load(std::memory_order_relaxed) / 100;
+    report.State.Position = (int16_t) position;
+    report.State.Torque = (int16_t) (torque < -10000 ? -10000 : (torque > 10000 ? 10000 : torque));
+
+    size_t size = length < sizeof(report) ? length : sizeof(report);
+    memcpy(data, &report, size);
+    return (int) size;
+}
+
+static int ReadTimeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds){
+    uint64_t start = HostClockNanoseconds();
+    uint64_t deadline = milliseconds < 0 ? UINT64_MAX : start + (uint64_t) milliseconds * 1000000ULL;
+    for (;;){
+        if (CheckConnected(dev) < 0){
+            return -1;
+        }
+        uint64_t now = HostClockNanoseconds();
+        uint64_t nextDue = 0;
+        if (TakeReport(dev, now, &nextDue)){
+            return FillStateReport(dev, data, length);
+        }
+        if (now >= deadline){
+            return 0;
+        }
+        SleepUntil(nextDue < deadline ? nextDue : deadline);
+    }
+}
+
+static void ApplySetting(MockDeviceTypeDef *device, const FieldDataTypeDef *field){
+    const SettingsFieldInfoTypeDef *info = FindSettingsField((SettingsFieldEnum) field->FieldId);
+    if (info == nullptr){
+        return;
+    }
+    const uint8_t *source = field->Value.Buffer;
+    int32_t value = 0;
+    switch (info->Type){
+    case SETTINGS_VALUE_INT8: {
+        int8_t v; memcpy(&v, source, sizeof(v)); value = v;
+        break;
+    }
+    case SETTINGS_VALUE_UINT8: {
+        uint8_t v; memcpy(&v, source, sizeof(v)); value = v;
+        break;
+    }
+    case SETTINGS_VALUE_INT16: {
+        int16_t v; memcpy(&v, source, sizeof(v)); value = v;
+        break;
+    }
+    case SETTINGS_VALUE_UINT16: {
+        uint16_t v; memcpy(&v, source, sizeof(v)); value = v;
+        break;
+    }
+    }
+    std::lock_guard<std::mutex> guard(device->lock);
+    // Write only fields and out of range indexes are accepted and forgotten, like the firmware does
+    WriteSettingsFieldValue(&device->settings, info, field->Value.Index, value);
+    UpdateForceScale(device);
+}
+
+static void Reboot(MockDeviceTypeDef *device){
+    {
+        std::lock_guard<std::mutex> guard(device->lock);
+        memcpy(&device->settings, &device->flash, sizeof(DeviceSettingsTypeDef));
+        UpdateForceScale(device);
+    }
+    device->control.store(0, std::memory_order_release);
+    RestartTimeline(device);
+}
+
+static int WriteReport(hid_device *dev, const unsigned char *data, size_t length){
+    if (CheckConnected(dev) < 0){
+        return -1;
+    }
+    if (length < 2 || length > MOCK_REPORT_SIZE || data[0] != REPORT_GENERIC_INPUT_OUTPUT){
+        return Fail(dev, L"Invalid output report");
+    }
+    // Short reports are padded like the hardware backends do
+    HidInOutReportTypeDef report;
+    memset(&report, 0, sizeof(report));
+    memcpy(&report, data, length);
+    const DataReportTypeDef *generic = (const DataReportTypeDef *) report.Buffer;
+    MockDeviceTypeDef *device = dev->device;
+
+    switch (generic->ReportData){
+    case DATA_OVERRIDE_DATA:
+        StoreControl(device, (const DirectControlTypeDef *) generic->Buffer);
+        device->controlReports.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case DATA_SETTINGS_FIELD_DATA:
+        ApplySetting(device, (const FieldDataTypeDef *) generic->Buffer);
+        device->settingsWrites.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case DATA_COMMAND_SAVE_SETTINGS:
+        {
+            std::lock_guard<std::mutex> guard(device->lock);
+            memcpy(&device->flash, &device->settings, sizeof(DeviceSettingsTypeDef));
+        }
+        Reboot(device);
+        device->commands.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case DATA_COMMAND_REBOOT:
+        Reboot(device);
+        device->commands.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case DATA_COMMAND_DFU_MODE:
+        // Device comes back as bootloader, for the api it is gone
+        device->connected.store(false, std::memory_order_release);
+        device->commands.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case DATA_COMMAND_RESET_CENTER:
+        device->position.store(0, std::memory_order_relaxed);
+        device->commands.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case DATA_FIRMWARE_ACTIVATION_DATA:
+        // Any key is accepted
+        device->registered.store(1, std::memory_order_relaxed);
+        device->commands.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        break;
+    }
+    dev->lastError = nullptr;
+    return MOCK_REPORT_SIZE;
+}
+
+static int GetFeatureReport(hid_device *dev, unsigned char *data, size_t length){
+    if (CheckConnected(dev) < 0){
+        return -1;
+    }
+    if (length < 1){
+        return Fail(dev, L"Invalid feature report");
+    }
+    MockDeviceTypeDef *device = dev->device;
+    size_t size = length - 1 < 64 ? length - 1 : 64;
+
+    std::lock_guard<std::mutex> guard(device->lock);
+    const void *source;
+    switch (data[0]){
+    case REPORT_EFFECT_SETTINGS_FEATURE:
+        source = &device->settings.Effect;
+        break;
+    case REPORT_HARDWARE_SETTINGS_FEATURE:
+        source = &device->settings.Hardware;
+        break;
+    case REPORT_GPIO_SETTINGS_FEATURE:
+        source = &device->settings.Gpio;
+        break;
+    case REPORT_ADC_SETTINGS_FEATURE:
+        source = &device->settings.Adc;
+        break;
+    case REPORT_FIRMWARE_LICENSE_FEATURE:
+        device->license.FirmwareVersion = UnpackFirmware(device->firmware.load(std::memory_order_relaxed));
+        device->license.IsRegistered = device->registered.load(std::memory_order_relaxed);
+        source = &device->license;
+        break;
+    default:
+        return Fail(dev, L"Unknown feature report");
+    }
+    memcpy(data + 1, source, size);
+    device->featureReads.fetch_add(1, std::memory_order_relaxed);
+    return (int) (size + 1);
+}
+
+static int ParsePath(const char *path){
+    size_t prefix = strlen(MOCK_WHEEL_PATH_PREFIX);
+    if (path == nullptr || strncmp(path, MOCK_WHEEL_PATH_PREFIX, prefix) != 0){
+        return -1;
+    }
+    char *end;
+    long index = strtol(path + prefix, &end, 10);
+    if (end == path + prefix || *end != 0 || index < 0 || index >= deviceCount.load(std::memory_order_relaxed)){
+        return -1;
+    }
+    return (int) index;
+}
+
+static wchar_t *CopyString(const wchar_t *source){
+    size_t length = wcslen(source) + 1;
+    wchar_t *copy = (wchar_t *) malloc(length * sizeof(wchar_t));
+    if (copy != nullptr){
+        memcpy(copy, source, length * sizeof(wchar_t));
+    }
+    return copy;
+}
+
+static void SerialNumber(int index, wchar_t *string, size_t maxlen){
+    swprintf(string, maxlen, L"MOCK%04d", index);
+}
+
+static int CopyDeviceString(const wchar_t *source, wchar_t *string, size_t maxlen){
+    if (maxlen == 0){
+        return -1;
+    }
+    wcsncpy(string, source, maxlen);
+    string[maxlen - 1] = L'\0';
+    return 0;
+}
+
+extern "C" {
+
+HID_API_EXPORT const struct hid_api_version* HID_API_CALL hid_version(){
+    return &api_version;
+}
+
+HID_API_EXPORT const char* HID_API_CALL hid_version_str(){
+    return HID_API_VERSION_STR;
+}
+
+int HID_API_EXPORT hid_init(void){
+    Devices();
+    return 0;
+}
+
+int HID_API_EXPORT hid_exit(void){
+    return 0;
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate_usb_interface(unsigned short vendor_id, unsigned short product_id, int interface_number){
+    struct hid_device_info *root = nullptr;
+    struct hid_device_info **tail = &root;
+    if ((vendor_id != 0 && vendor_id != USB_VID) || (product_id != 0 && product_id != WHEEL_PID_FS) ||
+        (interface_number >= 0 && interface_number != INTERFACE_VENDOR)){
+        return nullptr;
+    }
+    int count = deviceCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++){
+        if (!Devices()[i].connected.load(std::memory_order_acquire)){
+            continue;
+        }
+        struct hid_device_info *info = (struct hid_device_info *) calloc(1, sizeof(struct hid_device_info));
+        if (info == nullptr){
+            break;
+        }
+        char path[32];
+        wchar_t serial[16];
+        snprintf(path, sizeof(path), MOCK_WHEEL_PATH_PREFIX "%d", i);
+        SerialNumber(i, serial, sizeof(serial) / sizeof(serial[0]));
+        info->path = strdup(path);
+        info->vendor_id = USB_VID;
+        info->product_id = WHEEL_PID_FS;
+        info->serial_number = CopyString(serial);
+        info->release_number = 0x0100;
+        info->manufacturer_string = CopyString(L"FFBeast");
+        info->product_string = CopyString(L"FFBeast Wheel (mock)");
+        info->usage_page = 0xFF00;
+        info->usage = 0x0001;
+        info->interface_number = INTERFACE_VENDOR;
+        *tail = info;
+        tail = &info->next;
+    }
+    return root;
+}
+
+struct hid_device_info HID_API_EXPORT * HID_API_CALL hid_enumerate(unsigned short vendor_id, unsigned short product_id){
+    return hid_enumerate_usb_interface(vendor_id, product_id, -1);
+}
+
+void HID_API_EXPORT HID_API_CALL hid_free_enumeration(struct hid_device_info *devs){
+    while (devs != nullptr){
+        struct hid_device_info *next = devs->next;
+        free(devs->path);
+        free(devs->serial_number);
+        free(devs->manufacturer_string);
+        free(devs->product_string);
+        free(devs);
+        devs = next;
+    }
+}
+
+HID_API_EXPORT hid_device * HID_API_CALL hid_open_path(const char *path){
+    int index = ParsePath(path);
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr || !device->connected.load(std::memory_order_acquire)){
+        return nullptr;
+    }
+    hid_device *dev = (hid_device *) calloc(1, sizeof(hid_device));
+    if (dev == nullptr){
+        return nullptr;
+    }
+    dev->device = device;
+    dev->index = index;
+    dev->blocking = 1;
+    dev->inputBuffers = STATE_INPUT_BUFFERS;
+    // Reports emitted before the handle existed are never seen, like on a freshly opened device
+    dev->generation = device->generation.load(std::memory_order_acquire);
+    uint32_t rate = device->rate.load(std::memory_order_relaxed);
+    uint64_t epoch = device->epoch.load(std::memory_order_relaxed);
+    uint64_t now = HostClockNanoseconds();
+    dev->consumed = rate != 0 && now > epoch ? DueReports(now - epoch, rate) : 0;
+    return dev;
+}
+
+HID_API_EXPORT hid_device * HID_API_CALL hid_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number){
+    struct hid_device_info *devs = hid_enumerate_usb_interface(vendor_id, product_id, INTERFACE_VENDOR);
+    hid_device *dev = nullptr;
+    for (struct hid_device_info *cur = devs; cur != nullptr && dev == nullptr; cur = cur->next){
+        if (serial_number == nullptr || wcscmp(serial_number, cur->serial_number) == 0){
+            dev = hid_open_path(cur->path);
+        }
+    }
+    hid_free_enumeration(devs);
+    return dev;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length){
+    uint64_t start = HostClockNanoseconds();
+    return RecordOp(&dev->stats.write, start, WriteReport(dev, data, length));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write_async(hid_device *dev, const unsigned char *data, size_t length, hid_write_callback callback, void *context){
+    // Simulated transfer completes at once, callback fires from here like on hidraw
+    uint64_t start = HostClockNanoseconds();
+    int result = RecordOp(&dev->stats.write, start, WriteReport(dev, data, length));
+    if (callback){
+        callback(context, result);
+    }
+    return result;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_write_complete(hid_device *dev, int milliseconds){
+    (void) dev;
+    (void) milliseconds;
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds){
+    uint64_t start = HostClockNanoseconds();
+    return RecordOp(&dev->stats.read, start, ReadTimeout(dev, data, length, milliseconds));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read_timeout_swap(hid_device *dev, unsigned char **buffer, size_t buffer_size, int milliseconds){
+    return hid_read_timeout(dev, *buffer, buffer_size, milliseconds);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_wait_any(hid_device **devs, int count, int milliseconds){
+    if (count <= 0 || count > 64){
+        return -1;
+    }
+    uint64_t deadline = milliseconds < 0 ? UINT64_MAX : HostClockNanoseconds() + (uint64_t) milliseconds * 1000000ULL;
+    for (;;){
+        uint64_t now = HostClockNanoseconds();
+        uint64_t earliest = deadline;
+        for (int i = 0; i < count; i++){
+            hid_device *dev = devs[i];
+            MockDeviceTypeDef *device = dev->device;
+            // Errors count as ready too, the next read reports them
+            if (!device->connected.load(std::memory_order_acquire)){
+                return i;
+            }
+            uint32_t rate = device->rate.load(std::memory_order_relaxed);
+            uint64_t epoch = device->epoch.load(std::memory_order_relaxed);
+            if (rate == 0 || device->generation.load(std::memory_order_acquire) != dev->generation){
+                return i;
+            }
+            uint64_t due = now > epoch ? DueReports(now - epoch, rate) : 0;
+            if (due > dev->consumed){
+                return i;
+            }
+            uint64_t next = ReportDueTime(epoch, dev->consumed + 1, rate);
+            earliest = next < earliest ? next : earliest;
+        }
+        if (now >= deadline){
+            return -1;
+        }
+        SleepUntil(earliest);
+    }
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_read_wait_handle(hid_device *dev, hid_wait_handle *handle){
+    // Reports are produced from the clock inside the read calls, there is nothing the OS could signal
+    (void) handle;
+    return Fail(dev, L"Simulated device has no wait handle");
+}
+
+int HID_API_EXPORT HID_API_CALL hid_read(hid_device *dev, unsigned char *data, size_t length){
+    return hid_read_timeout(dev, data, length, dev->blocking ? -1 : 0);
+}
+
+int HID_API_EXPORT HID_API_CALL hid_set_nonblocking(hid_device *dev, int nonblock){
+    dev->blocking = !nonblock;
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_set_num_input_buffers(hid_device *dev, int count){
+    if (count <= 0 || count > MOCK_MAX_INPUT_BUFFERS){
+        return Fail(dev, L"Invalid number of input buffers");
+    }
+    dev->inputBuffers = count;
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_send_feature_report(hid_device *dev, const unsigned char *data, size_t length){
+    (void) data;
+    (void) length;
+    // Firmware takes settings through output reports only
+    return Fail(dev, L"Feature reports are read only");
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length){
+    uint64_t start = HostClockNanoseconds();
+    return RecordOp(&dev->stats.get_feature, start, GetFeatureReport(dev, data, length));
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_feature_reports(hid_device *dev, unsigned char **data, const size_t *length, int *results, size_t count){
+    uint64_t start = HostClockNanoseconds();
+    int succeeded = 0;
+    int bytes = 0;
+    if (count == 0 || count > HID_FEATURE_SLOTS){
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++){
+        results[i] = GetFeatureReport(dev, data[i], length[i]);
+        if (results[i] > 0){
+            bytes += results[i];
+            succeeded++;
+        }
+    }
+    // Whole batch counts as one call, failed when nothing came back
+    RecordOp(&dev->stats.get_feature, start, succeeded > 0 ? bytes : -1);
+    return succeeded;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_input_report(hid_device *dev, unsigned char *data, size_t length){
+    // Current state on request, input stream of the handle is not touched
+    if (CheckConnected(dev) < 0){
+        return -1;
+    }
+    return FillStateReport(dev, data, length);
+}
+
+/* Completion port over the simulated devices. Writes and feature requests complete inside the submit call,
+   reads complete inside hid_iocp_wait once their device has a report due. */
+
+struct hid_iocp_op {
+    hid_device *dev;
+    int type;
+    unsigned char *data;
+    size_t length;
+    void *context;
+    int result;
+    struct hid_iocp_op *next;
+};
+
+struct hid_iocp_ {
+    std::mutex lock;
+    struct hid_iocp_op ops[HID_IOCP_OPS];
+    struct hid_iocp_op *freeOps;
+    struct hid_iocp_op *doneHead;
+    struct hid_iocp_op *doneTail;
+    struct hid_iocp_op *readHead; // Pending reads of every attached device in submission order
+    struct hid_iocp_op *readTail;
+};
+
+// Called with the lock held
+static void PushDone(hid_iocp *iocp, struct hid_iocp_op *op){
+    op->next = nullptr;
+    if (iocp->doneTail){
+        iocp->doneTail->next = op;
+    } else {
+        iocp->doneHead = op;
+    }
+    iocp->doneTail = op;
+}
+
+static struct hid_iocp_op *AcquireOp(hid_iocp *iocp, hid_device *dev, int type){
+    std::lock_guard<std::mutex> guard(iocp->lock);
+    struct hid_iocp_op *op = iocp->freeOps;
+    if (op == nullptr || dev->iocp != iocp){
+        return nullptr;
+    }
+    iocp->freeOps = op->next;
+    op->dev = dev;
+    op->type = type;
+    op->next = nullptr;
+    return op;
+}
+
+static void CompleteOp(hid_iocp *iocp, struct hid_iocp_op *op, int result){
+    std::lock_guard<std::mutex> guard(iocp->lock);
+    op->result = result;
+    PushDone(iocp, op);
+}
+
+// Called with the lock held. Moves reads whose device has a report due to the done list,
+// returns time the next pending read can complete.
+static uint64_t ServiceReads(hid_iocp *iocp, uint64_t now){
+    uint64_t earliest = UINT64_MAX;
+    struct hid_iocp_op **link = &iocp->readHead;
+    struct hid_iocp_op *previous = nullptr;
+    while (*link != nullptr){
+        struct hid_iocp_op *op = *link;
+        uint64_t nextDue = UINT64_MAX;
+        int result;
+        if (CheckConnected(op->dev) < 0){
+            result = -1;
+        } else if (TakeReport(op->dev, now, &nextDue)){
+            result = FillStateReport(op->dev, op->data, op->length);
+        } else {
+            earliest = nextDue < earliest ? nextDue : earliest;
+            previous = op;
+            link = &op->next;
+            continue;
+        }
+        *link = op->next;
+        if (iocp->readTail == op){
+            iocp->readTail = previous;
+        }
+        op->result = result;
+        PushDone(iocp, op);
+    }
+    return earliest;
+}
+
+HID_API_EXPORT hid_iocp * HID_API_CALL hid_iocp_create(void){
+    hid_iocp *iocp = new (std::nothrow) hid_iocp();
+    if (iocp == nullptr){
+        return nullptr;
+    }
+    for (int i = 0; i < HID_IOCP_OPS; i++){
+        iocp->ops[i].next = i + 1 < HID_IOCP_OPS ? &iocp->ops[i + 1] : nullptr;
+    }
+    iocp->freeOps = &iocp->ops[0];
+    iocp->doneHead = iocp->doneTail = nullptr;
+    iocp->readHead = iocp->readTail = nullptr;
+    return iocp;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_iocp_destroy(hid_iocp *iocp){
+    delete iocp;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_attach(hid_iocp *iocp, hid_device *dev){
+    if (iocp == nullptr || dev == nullptr || dev->iocp != nullptr){
+        return -1;
+    }
+    dev->iocp = iocp;
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_read(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context){
+    struct hid_iocp_op *op = AcquireOp(iocp, dev, HID_IOCP_READ);
+    if (op == nullptr){
+        return -1;
+    }
+    op->data = data;
+    op->length = length;
+    op->context = context;
+    std::lock_guard<std::mutex> guard(iocp->lock);
+    if (iocp->readTail){
+        iocp->readTail->next = op;
+    } else {
+        iocp->readHead = op;
+    }
+    iocp->readTail = op;
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_write(hid_iocp *iocp, hid_device *dev, const unsigned char *data, size_t length, void *context){
+    struct hid_iocp_op *op = AcquireOp(iocp, dev, HID_IOCP_WRITE);
+    if (op == nullptr){
+        return -1;
+    }
+    op->data = nullptr;
+    op->length = length;
+    op->context = context;
+    CompleteOp(iocp, op, hid_write(dev, data, length));
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_submit_get_feature(hid_iocp *iocp, hid_device *dev, unsigned char *data, size_t length, void *context){
+    struct hid_iocp_op *op = AcquireOp(iocp, dev, HID_IOCP_GET_FEATURE);
+    if (op == nullptr){
+        return -1;
+    }
+    op->data = data;
+    op->length = length;
+    op->context = context;
+    CompleteOp(iocp, op, hid_get_feature_report(dev, data, length));
+    return 0;
+}
+
+int HID_API_EXPORT HID_API_CALL hid_iocp_wait(hid_iocp *iocp, struct hid_iocp_completion *completions, size_t count, int milliseconds){
+    if (count > HID_IOCP_OPS){
+        count = HID_IOCP_OPS;
+    }
+    if (count == 0){
+        return 0;
+    }
+    uint64_t deadline = milliseconds < 0 ? UINT64_MAX : HostClockNanoseconds() + (uint64_t) milliseconds * 1000000ULL;
+    std::unique_lock<std::mutex> guard(iocp->lock);
+    for (;;){
+        uint64_t now = HostClockNanoseconds();
+        uint64_t earliest = ServiceReads(iocp, now);
+        if (iocp->doneHead != nullptr || now >= deadline){
+            break;
+        }
+        // Submits from other threads go on while this one sleeps
+        guard.unlock();
+        SleepUntil(earliest < deadline ? earliest : deadline);
+        guard.lock();
+    }
+
+    int filled = 0;
+    while (iocp->doneHead != nullptr && (size_t) filled < count){
+        struct hid_iocp_op *op = iocp->doneHead;
+        struct hid_iocp_completion *c = &completions[filled++];
+        iocp->doneHead = op->next;
+        if (iocp->doneHead == nullptr){
+            iocp->doneTail = nullptr;
+        }
+        c->dev = op->dev;
+        c->type = op->type;
+        c->result = op->result;
+        c->data = op->data;
+        c->context = op->context;
+        op->next = iocp->freeOps;
+        iocp->freeOps = op;
+    }
+    return filled;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_close(hid_device *dev){
+    if (dev == nullptr){
+        return;
+    }
+    if (dev->iocp != nullptr){
+        // Reads still queued are reported as failed, like cancelled requests on Windows
+        hid_iocp *iocp = dev->iocp;
+        std::lock_guard<std::mutex> guard(iocp->lock);
+        struct hid_iocp_op **link = &iocp->readHead;
+        struct hid_iocp_op *previous = nullptr;
+        while (*link != nullptr){
+            struct hid_iocp_op *op = *link;
+            if (op->dev != dev){
+                previous = op;
+                link = &op->next;
+                continue;
+            }
+            *link = op->next;
+            if (iocp->readTail == op){
+                iocp->readTail = previous;
+            }
+            op->result = -1;
+            PushDone(iocp, op);
+        }
+    }
+    free(dev);
+}
+
+int HID_API_EXPORT_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen){
+    (void) dev;
+    return CopyDeviceString(L"FFBeast", string, maxlen);
+}
+
+int HID_API_EXPORT_CALL hid_get_product_string(hid_device *dev, wchar_t *string, size_t maxlen){
+    (void) dev;
+    return CopyDeviceString(L"FFBeast Wheel (mock)", string, maxlen);
+}
+
+int HID_API_EXPORT_CALL hid_get_serial_number_string(hid_device *dev, wchar_t *string, size_t maxlen){
+    wchar_t serial[16];
+    SerialNumber(dev->index, serial, sizeof(serial) / sizeof(serial[0]));
+    return CopyDeviceString(serial, string, maxlen);
+}
+
+int HID_API_EXPORT_CALL hid_get_indexed_string(hid_device *dev, int string_index, wchar_t *string, size_t maxlen){
+    (void) string_index;
+    (void) string;
+    (void) maxlen;
+    return Fail(dev, L"String descriptors are not simulated");
+}
+
+int HID_API_EXPORT HID_API_CALL hid_get_stats(hid_device *dev, struct hid_device_stats *stats){
+    if (dev == nullptr || stats == nullptr){
+        return -1;
+    }
+    const unsigned long long *source = (const unsigned long long *) &dev->stats;
+    unsigned long long *destination = (unsigned long long *) stats;
+    for (size_t i = 0; i < sizeof(*stats) / sizeof(unsigned long long); i++){
+        destination[i] = __atomic_load_n(&source[i], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+void HID_API_EXPORT HID_API_CALL hid_reset_stats(hid_device *dev){
+    if (dev != nullptr){
+        unsigned long long *counters = (unsigned long long *) &dev->stats;
+        for (size_t i = 0; i < sizeof(dev->stats) / sizeof(unsigned long long); i++){
+            __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+HID_API_EXPORT const wchar_t * HID_API_CALL hid_error(hid_device *dev){
+    if (dev != nullptr && dev->lastError != nullptr){
+        return dev->lastError;
+    }
+    return L"Success";
+}
+
+} // extern "C"
+
+int MockWheelSetCount(int count){
+    count = count < 0 ? 0 : (count > MOCK_WHEEL_MAX_DEVICES ? MOCK_WHEEL_MAX_DEVICES : count);
+    deviceCount.store(count, std::memory_order_relaxed);
+    return count;
+}
+
+int MockWheelConfigure(int index, const MockWheelConfigTypeDef *config){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    device->rate.store(config->ReportRateHz, std::memory_order_relaxed);
+    device->position.store(config->Position < -10000 ? -10000 : (config->Position > 10000 ? 10000 : config->Position),
+                           std::memory_order_relaxed);
+    device->firmware.store(PackFirmware(config->FirmwareVersion), std::memory_order_relaxed);
+    device->registered.store(config->IsRegistered ? 1 : 0, std::memory_order_relaxed);
+    device->connected.store(config->Connected, std::memory_order_release);
+    RestartTimeline(device);
+    return 1;
+}
+
+int MockWheelReadConfig(int index, MockWheelConfigTypeDef *destination){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    destination->ReportRateHz = device->rate.load(std::memory_order_relaxed);
+    destination->Position = device->position.load(std::memory_order_relaxed);
+    destination->FirmwareVersion = UnpackFirmware(device->firmware.load(std::memory_order_relaxed));
+    destination->IsRegistered = device->registered.load(std::memory_order_relaxed);
+    destination->Connected = device->connected.load(std::memory_order_acquire);
+    return 1;
+}
+
+int MockWheelSetState(int index, const DeviceStateTypeDef *state){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    device->replayState.store(*state);
+    device->replaying.store(true, std::memory_order_release);
+    return 1;
+}
+
+int MockWheelClearState(int index){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    device->replaying.store(false, std::memory_order_release);
+    return 1;
+}
+
+int MockWheelReadControl(int index, DirectControlTypeDef *destination){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    *destination = LoadControl(device);
+    return 1;
+}
+
+int MockWheelReadSettings(int index, DeviceSettingsTypeDef *destination){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(device->lock);
+    memcpy(destination, &device->settings, sizeof(DeviceSettingsTypeDef));
+    return 1;
+}
+
+int MockWheelReadCounters(int index, MockWheelCountersTypeDef *destination){
+    MockDeviceTypeDef *device = FindDevice(index);
+    if (device == nullptr){
+        return 0;
+    }
+    destination->StateReports = device->stateReports.load(std::memory_order_relaxed);
+    destination->OverwrittenReports = device->overwrittenReports.load(std::memory_order_relaxed);
+    destination->ControlReports = device->controlReports.load(std::memory_order_relaxed);
+    destination->SettingsWrites = device->settingsWrites.load(std::memory_order_relaxed);
+    destination->FeatureReads = device->featureReads.load(std::memory_order_relaxed);
+    destination->Commands = device->commands.load(std::memory_order_relaxed);
+    return 1;
+}
+
+void MockWheelReset(){
+    for (int i = 0; i < MOCK_WHEEL_MAX_DEVICES; i++){
+        ResetDevice(&Devices()[i], i);
+    }
+    deviceCount.store(1, std::memory_order_relaxed);
+}
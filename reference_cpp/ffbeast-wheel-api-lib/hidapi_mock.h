@@ -0,0 +1,87 @@
+#ifndef HIDAPI_MOCK_H
+#define HIDAPI_MOCK_H
+
+#include <stdint.h>
+#include "telemetry_recorder.h"
+#include "wheel_api.h"
+
+#define MOCK_WHEEL_MAX_DEVICES      8
+#define MOCK_WHEEL_DEFAULT_RATE_HZ  1000 // Same as full speed USB polling interval of the real device
+#define MOCK_WHEEL_PATH_PREFIX      "mock:" // Path of device N is "mock:N"
+
+/**
+ * Behaviour of one simulated wheel, see MockWheelConfigure.
+ * */
+typedef struct {
+    uint32_t ReportRateHz; // 0 hands out a new state report on every read, for measuring library overhead alone
+    int16_t Position; // Reported position, -10000 to +10000
+    FirmwareVersionTypeDef FirmwareVersion;
+    uint8_t IsRegistered;
+    bool Connected; // false fails every call on open handles and hides device from enumeration, like unplugging it
+} MockWheelConfigTypeDef;
+
+typedef struct {
+    uint64_t StateReports; // Reports handed to reads on any handle
+    uint64_t OverwrittenReports; // Reports lost because a handle did not read them before its input buffers filled up
+    uint64_t ControlReports; // DATA_OVERRIDE_DATA reports received
+    uint64_t SettingsWrites; // DATA_SETTINGS_FIELD_DATA reports received
+    uint64_t FeatureReads;
+    uint64_t Commands; // Save, reboot, DFU, reset center and activation
+} MockWheelCountersTypeDef;
+
+/**
+ * In memory backend of hidapi.h that behaves like the wheel firmware. Link hidapi_mock.cpp instead of hidapi.c or
+ * hidapi_linux.c and WheelApi, WheelManager and ConnectionManager run unchanged against simulated devices.
+ *
+ * Each device emits state reports at ReportRateHz on every open handle, keeps only as many unread reports as the
+ * handle has input buffers, stores settings written through the 64 byte generic report and serves them back as
+ * feature reports. Torque follows the last direct control report. Save keeps settings over reboot.
+ * Nothing touches the operating system except sleeping until the next report is due, so calls are deterministic
+ * and cost only what the library does around them.
+ * */
+
+// Number of devices that enumerate, 1 after start. Returns count clamped to MOCK_WHEEL_MAX_DEVICES.
+int MockWheelSetCount(int count);
+// Replaces behaviour of device, restarts its report timeline. Returns 1, 0 for unknown index.
+int MockWheelConfigure(int index, const MockWheelConfigTypeDef *config);
+int MockWheelReadConfig(int index, MockWheelConfigTypeDef *destination);
+// Every report carries state as given, torque and padding included, instead of the simulated state. One caller at
+// a time. Returns 1, 0 for unknown index.
+int MockWheelSetState(int index, const DeviceStateTypeDef *state);
+// Back to simulated position and torque
+int MockWheelClearState(int index);
+// Last direct control received by device
+int MockWheelReadControl(int index, DirectControlTypeDef *destination);
+// Settings as device currently holds them, before save
+int MockWheelReadSettings(int index, DeviceSettingsTypeDef *destination);
+int MockWheelReadCounters(int index, MockWheelCountersTypeDef *destination);
+// Every device back to factory settings and default behaviour, counters cleared. No handle may be open.
+void MockWheelReset();
+
+/**
+ * Plays a recorded session into device index: each recorded state becomes the state the device reports from its
+ * timestamp on, paced like TelemetryReplay::play, so WheelApi and everything above it run against the session.
+ * Reports still go out at the configured rate, configure the rate of the recording for one report per state.
+ * Recorded control is skipped, simulated state is back when replay ends. Returns number of states replayed.
+ * */
+inline uint64_t MockWheelReplay(int index, const TelemetryReplay *replay, float speed){
+    struct MockReplay {
+        int Index;
+        uint64_t States;
+
+        static bool Record(void *context, const TelemetryRecordTypeDef *record){
+            MockReplay *target = (MockReplay *) context;
+            if (record->Direction == TELEMETRY_STATE_IN){
+                MockWheelSetState(target->Index, &record->State);
+                target->States++;
+            }
+            return true;
+        }
+    };
+    MockReplay target = {index, 0};
+    replay->play(speed, &MockReplay::Record, &target);
+    MockWheelClearState(index);
+    return target.States;
+}
+
+#endif // HIDAPI_MOCK_H
@@ -0,0 +1,16 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <stdint.h>
+#include <chrono>
+
+/**
+ * Monotonic host time in nanoseconds.
+ * Backed by QueryPerformanceCounter on Windows and CLOCK_MONOTONIC elsewhere, never jumps with wall clock changes.
+ * */
+inline uint64_t HostClockNanoseconds() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // HOST_CLOCK_H
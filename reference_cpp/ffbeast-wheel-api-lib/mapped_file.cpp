@@ -0,0 +1,343 @@
+#include "mapped_file.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(){
+}
+
+MappedFile::~MappedFile(){
+    close();
+}
+
+bool MappedFile::isOpen() const{
+    return view != nullptr;
+}
+
+uint8_t *MappedFile::data() const{
+    return view;
+}
+
+size_t MappedFile::size() const{
+    return length;
+}
+
+// Name of the segment in the system namespace, returns -1 when name is empty or too long
+static int SharedObjectName(const char *name, char *destination, size_t capacity){
+    size_t nameLength = strlen(name);
+    if (nameLength == 0 || nameLength > MAPPED_SHARED_NAME_MAX){
+        return -1;
+    }
+#ifdef _WIN32
+    // Session local namespace, Global needs SeCreateGlobalPrivilege
+    snprintf(destination, capacity, "Local\\%s", name);
+#else
+    snprintf(destination, capacity, "/%s", name);
+#endif
+    return 1;
+}
+
+#ifdef _WIN32
+
+static int MapHandle(HANDLE file, size_t size, bool writable, HANDLE *mapping, uint8_t **view){
+    *mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                  (DWORD)((uint64_t)size >> 32), (DWORD)((uint64_t)size & 0xFFFFFFFF), NULL);
+    if (*mapping == NULL){
+        return -1;
+    }
+    *view = (uint8_t *)MapViewOfFile(*mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (*view == nullptr){
+        CloseHandle(*mapping);
+        *mapping = NULL;
+        return -1;
+    }
+    return 1;
+}
+
+int MappedFile::create(const char *path, size_t size){
+    close();
+    if (size == 0){
+        return -1;
+    }
+    HANDLE handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE){
+        return -1;
+    }
+    // Mapping of a new file with explicit size grows it, new pages read as zero
+    HANDLE map;
+    if (MapHandle(handle, size, true, &map, &view) < 0){
+        CloseHandle(handle);
+        return -1;
+    }
+    file = handle;
+    mapping = map;
+    length = size;
+    writable = true;
+    return 1;
+}
+
+int MappedFile::open(const char *path, bool writable){
+    close();
+    HANDLE handle = CreateFileA(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE){
+        return GetLastError() == ERROR_FILE_NOT_FOUND ? 0 : -1;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)){
+        CloseHandle(handle);
+        return -1;
+    }
+    if (fileSize.QuadPart == 0){
+        CloseHandle(handle);
+        return 0;
+    }
+    HANDLE map;
+    if (MapHandle(handle, (size_t)fileSize.QuadPart, writable, &map, &view) < 0){
+        CloseHandle(handle);
+        return -1;
+    }
+    file = handle;
+    mapping = map;
+    length = (size_t)fileSize.QuadPart;
+    this->writable = writable;
+    return 1;
+}
+
+int MappedFile::createShared(const char *name, size_t size){
+    close();
+    char objectName[sizeof(sharedName)];
+    if (size == 0 || SharedObjectName(name, objectName, sizeof(objectName)) < 0){
+        return -1;
+    }
+    // Paging file backed, lives as long as any process holds a handle or a view
+    HANDLE map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+                                    (DWORD)((uint64_t)size & 0xFFFFFFFF), objectName);
+    if (map == NULL){
+        return -1;
+    }
+    bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    view = (uint8_t *)MapViewOfFile(map, FILE_MAP_WRITE, 0, 0, size);
+    if (view == nullptr){
+        CloseHandle(map);
+        return -1;
+    }
+    if (existed){
+        memset(view, 0, size);
+    }
+    mapping = map;
+    length = size;
+    writable = true;
+    return 1;
+}
+
+int MappedFile::openShared(const char *name, bool writable){
+    close();
+    char objectName[sizeof(sharedName)];
+    if (SharedObjectName(name, objectName, sizeof(objectName)) < 0){
+        return -1;
+    }
+    HANDLE map = OpenFileMappingA(writable ? FILE_MAP_WRITE : FILE_MAP_READ, FALSE, objectName);
+    if (map == NULL){
+        return GetLastError() == ERROR_FILE_NOT_FOUND ? 0 : -1;
+    }
+    view = (uint8_t *)MapViewOfFile(map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (view == nullptr || VirtualQuery(view, &info, sizeof(info)) == 0){
+        if (view != nullptr){
+            UnmapViewOfFile(view);
+            view = nullptr;
+        }
+        CloseHandle(map);
+        return -1;
+    }
+    // Size of the view is rounded up to whole pages
+    mapping = map;
+    length = (size_t)info.RegionSize;
+    this->writable = writable;
+    return 1;
+}
+
+void MappedFile::close(size_t finalSize){
+    if (view != nullptr){
+        UnmapViewOfFile(view);
+        CloseHandle((HANDLE)mapping);
+    }
+    if (file != nullptr){
+        if (writable && finalSize > 0 && finalSize < length){
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)finalSize;
+            if (SetFilePointerEx((HANDLE)file, end, NULL, FILE_BEGIN)){
+                SetEndOfFile((HANDLE)file);
+            }
+        }
+        CloseHandle((HANDLE)file);
+    }
+    view = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    length = 0;
+    writable = false;
+}
+
+int MappedFile::flush(){
+    if (view == nullptr){
+        return 0;
+    }
+    return FlushViewOfFile(view, length) && (file == nullptr || FlushFileBuffers((HANDLE)file)) ? 1 : -1;
+}
+
+#else
+
+int MappedFile::create(const char *path, size_t size){
+    close();
+    if (size == 0){
+        return -1;
+    }
+    int handle = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (handle < 0){
+        return -1;
+    }
+    // Truncate then extend, so every page reads as zero and no old data survives
+    if (ftruncate(handle, (off_t)size) < 0){
+        ::close(handle);
+        return -1;
+    }
+    void *address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+    if (address == MAP_FAILED){
+        ::close(handle);
+        return -1;
+    }
+    fd = handle;
+    view = (uint8_t *)address;
+    length = size;
+    writable = true;
+    return 1;
+}
+
+int MappedFile::open(const char *path, bool writable){
+    close();
+    int handle = ::open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (handle < 0){
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct stat info;
+    if (fstat(handle, &info) < 0){
+        ::close(handle);
+        return -1;
+    }
+    if (info.st_size == 0){
+        ::close(handle);
+        return 0;
+    }
+    void *address = mmap(NULL, (size_t)info.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, handle, 0);
+    if (address == MAP_FAILED){
+        ::close(handle);
+        return -1;
+    }
+    fd = handle;
+    view = (uint8_t *)address;
+    length = (size_t)info.st_size;
+    this->writable = writable;
+    return 1;
+}
+
+int MappedFile::createShared(const char *name, size_t size){
+    close();
+    char objectName[sizeof(sharedName)];
+    if (size == 0 || SharedObjectName(name, objectName, sizeof(objectName)) < 0){
+        return -1;
+    }
+    // Segment left behind by a crashed owner is unlinked, so this one always starts zero filled
+    shm_unlink(objectName);
+    int handle = shm_open(objectName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (handle < 0){
+        return -1;
+    }
+    void *address = MAP_FAILED;
+    if (ftruncate(handle, (off_t)size) == 0){
+        address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+    }
+    if (address == MAP_FAILED){
+        ::close(handle);
+        shm_unlink(objectName);
+        return -1;
+    }
+    fd = handle;
+    view = (uint8_t *)address;
+    length = size;
+    writable = true;
+    memcpy(sharedName, objectName, sizeof(sharedName));
+    return 1;
+}
+
+int MappedFile::openShared(const char *name, bool writable){
+    close();
+    char objectName[sizeof(sharedName)];
+    if (SharedObjectName(name, objectName, sizeof(objectName)) < 0){
+        return -1;
+    }
+    int handle = shm_open(objectName, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC, 0);
+    if (handle < 0){
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct stat info;
+    if (fstat(handle, &info) < 0){
+        ::close(handle);
+        return -1;
+    }
+    if (info.st_size == 0){
+        // Owner has not sized it yet
+        ::close(handle);
+        return 0;
+    }
+    void *address = mmap(NULL, (size_t)info.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, handle, 0);
+    if (address == MAP_FAILED){
+        ::close(handle);
+        return -1;
+    }
+    fd = handle;
+    view = (uint8_t *)address;
+    length = (size_t)info.st_size;
+    this->writable = writable;
+    return 1;
+}
+
+void MappedFile::close(size_t finalSize){
+    if (view != nullptr){
+        munmap(view, length);
+        if (writable && finalSize > 0 && finalSize < length){
+            if (ftruncate(fd, (off_t)finalSize) < 0){
+                // File keeps its preallocated size, readers stop at the first empty record anyway
+            }
+        }
+        ::close(fd);
+        if (sharedName[0] != 0){
+            shm_unlink(sharedName);
+        }
+    }
+    view = nullptr;
+    fd = -1;
+    sharedName[0] = 0;
+    length = 0;
+    writable = false;
+}
+
+int MappedFile::flush(){
+    if (view == nullptr){
+        return 0;
+    }
+    return msync(view, length, MS_SYNC) == 0 ? 1 : -1;
+}
+
+#endif
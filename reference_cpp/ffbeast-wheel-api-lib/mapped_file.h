@@ -0,0 +1,55 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAPPED_SHARED_NAME_MAX  64 // Longest name of a shared segment, without namespace prefix
+
+/**
+ * File mapped into memory as a whole. Loads and stores go straight to the page cache,
+ * so nothing on the data path makes a system call. Not copyable, one object owns one mapping.
+ * Shared segments are the same mapping without a file, named so other processes can map it too.
+ * */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Creates file, or truncates existing one, with size zero filled bytes and maps it read write. Returns 1 or -1.
+    int create(const char *path, size_t size);
+    // Maps whole existing file. Returns 1, 0 when file does not exist or is empty, -1 on error.
+    int open(const char *path, bool writable = false);
+    // Creates named segment of size zero filled bytes, Local\name on Windows and /name in shm on POSIX.
+    // A stale POSIX segment of the same name is replaced, mappings of it held elsewhere keep the old memory.
+    // Windows reuses a segment still mapped by other processes and clears it. Returns 1 or -1.
+    int createShared(const char *name, size_t size);
+    // Maps named segment created by another process. Returns 1, 0 when no such segment exists, -1 on error.
+    int openShared(const char *name, bool writable = false);
+    // Unmaps and closes, optional size shrinks a writable file to the bytes actually used
+    void close(size_t finalSize = 0);
+    // Writes dirty pages back to disk, slow and never needed for other processes to see the data
+    int flush();
+
+    bool isOpen() const;
+    uint8_t *data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    uint8_t *view = nullptr;
+    size_t length = 0;
+    bool writable = false;
+    char sharedName[MAPPED_SHARED_NAME_MAX + 8] = {}; // Set while this object owns a POSIX segment, removed on close
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+#endif // MAPPED_FILE_H
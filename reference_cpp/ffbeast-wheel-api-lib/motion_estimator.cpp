@@ -0,0 +1,96 @@
+#include "motion_estimator.h"
+
+#define INTERVAL_ADAPT_RATE 0.02f // Share of every new time step folded into measured report interval
+
+MotionEstimator::MotionEstimator(){
+    setSmoothing(MOTION_DEFAULT_SMOOTHING);
+    intervalSeconds = (float)MOTION_DEFAULT_INTERVAL_NS * 1.0e-9f;
+    intervalNs.store(MOTION_DEFAULT_INTERVAL_NS, std::memory_order_relaxed);
+}
+
+void MotionEstimator::setSmoothing(float smoothing){
+    float s = smoothing < 0.0f ? 0.0f : (smoothing > 0.999f ? 0.999f : smoothing);
+    float r = 1.0f - s;
+    setGains(1.0f - s * s * s, 1.5f * r * r * (1.0f + s), 0.5f * r * r * r);
+}
+
+void MotionEstimator::setGains(float alpha, float beta, float gamma){
+    this->alpha = alpha;
+    this->beta = beta;
+    this->gamma = gamma;
+}
+
+void MotionEstimator::reset(){
+    initialized = false;
+}
+
+void MotionEstimator::update(const TimestampedStateTypeDef *sample){
+    float position = (float)sample->State.Position / 10000.0f;
+    uint64_t gap = sample->Timestamp - estimate.Timestamp;
+
+    if (!initialized || gap > MOTION_RESET_GAP_NS){
+        estimate.Timestamp = sample->Timestamp;
+        estimate.Position = position;
+        estimate.Velocity = 0.0f;
+        estimate.Acceleration = 0.0f;
+        estimate.Reports = 1;
+        initialized = true;
+        published.store(estimate);
+        return;
+    }
+
+    // Average of raw steps converges to the device interval even when reads are late and come in bursts.
+    // Clamp keeps a single stall or burst from dragging it far.
+    float raw = sample->Timestamp > estimate.Timestamp ? (float)gap * 1.0e-9f : 0.0f;
+    float clamped = raw < 0.25f * intervalSeconds ? 0.25f * intervalSeconds
+                  : (raw > 4.0f * intervalSeconds ? 4.0f * intervalSeconds : raw);
+    intervalSeconds += (clamped - intervalSeconds) * INTERVAL_ADAPT_RATE;
+    intervalNs.store((uint64_t)(intervalSeconds * 1.0e9f), std::memory_order_relaxed);
+
+    // Every report is one device sample, so step is a whole number of intervals and never zero
+    float steps = (float)(int)(raw / intervalSeconds + 0.5f);
+    float dt = (steps < 1.0f ? 1.0f : steps) * intervalSeconds;
+
+    float predictedPosition = estimate.Position + (estimate.Velocity + 0.5f * estimate.Acceleration * dt) * dt;
+    float predictedVelocity = estimate.Velocity + estimate.Acceleration * dt;
+    float residual = position - predictedPosition;
+
+    estimate.Position = predictedPosition + alpha * residual;
+    estimate.Velocity = predictedVelocity + (beta / dt) * residual;
+    estimate.Acceleration += (2.0f * gamma / (dt * dt)) * residual;
+    estimate.Timestamp = sample->Timestamp;
+    estimate.Reports++;
+    published.store(estimate);
+}
+
+int MotionEstimator::pump(WheelApi *api){
+    TimestampedStateTypeDef samples[MOTION_PUMP_BATCH];
+    int total = 0;
+    int count;
+    while ((count = api->drainStates(samples, MOTION_PUMP_BATCH)) > 0){
+        for (int i = 0; i < count; i++){
+            update(&samples[i]);
+        }
+        total += count;
+    }
+    return total;
+}
+
+int MotionEstimator::read(MotionStateTypeDef *destination) const{
+    return published.load(destination) > 0 ? 1 : 0;
+}
+
+int MotionEstimator::predict(uint64_t time, MotionStateTypeDef *destination) const{
+    if (!read(destination)){
+        return 0;
+    }
+    float dt = (float)(int64_t)(time - destination->Timestamp) * 1.0e-9f;
+    destination->Position += (destination->Velocity + 0.5f * destination->Acceleration * dt) * dt;
+    destination->Velocity += destination->Acceleration * dt;
+    destination->Timestamp = time;
+    return 1;
+}
+
+uint64_t MotionEstimator::reportIntervalNs() const{
+    return intervalNs.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,67 @@
+#ifndef MOTION_ESTIMATOR_H
+#define MOTION_ESTIMATOR_H
+
+#include <stdint.h>
+#include "seqlock.h"
+#include "wheel_api.h"
+
+#define MOTION_DEFAULT_SMOOTHING    0.85f // Fading memory of the filter, higher is smoother and slower
+#define MOTION_DEFAULT_INTERVAL_NS  1000000ULL // Assumed report interval until one is measured
+#define MOTION_RESET_GAP_NS         100000000ULL // Longer gap between reports restarts filter from the new position
+#define MOTION_PUMP_BATCH           32
+
+// Filtered wheel motion, position in normalized range -1 to +1, velocity per second, acceleration per second squared
+typedef struct {
+    uint64_t Timestamp; // Host time of the report the estimate belongs to
+    float Position;
+    float Velocity;
+    float Acceleration;
+    uint64_t Reports; // Reports folded into estimate since last reset
+} MotionStateTypeDef;
+
+/**
+ * Alpha beta gamma filter over the position stream. Every report costs a handful of multiplies and adds.
+ *
+ * Gains come from a single smoothing factor (critically damped fading memory filter) or are set directly,
+ * they never depend on SpeedBufferSize or PositionSmoothing of the firmware. Host timestamps jitter with
+ * thread scheduling, so time step is the measured report interval times number of intervals elapsed,
+ * which also keeps bursts of reports drained late from being read as a sudden jump in velocity.
+ *
+ * update and pump are called from one thread, read is wait free from any thread.
+ * */
+class MotionEstimator
+{
+public:
+    MotionEstimator();
+
+    // 0 to 1, gives alpha = 1 - s^3, beta = 1.5 (1 - s)^2 (1 + s), gamma = 0.5 (1 - s)^3
+    void setSmoothing(float smoothing);
+    void setGains(float alpha, float beta, float gamma);
+    void reset();
+
+    // Folds one report into estimate
+    void update(const TimestampedStateTypeDef *sample);
+    // Drains state ring of the api and folds in every report, returns number of reports consumed.
+    // Makes the estimator the single consumer of drainStates.
+    int pump(WheelApi *api);
+
+    // Returns 1 when an estimate is available, 0 before first report
+    int read(MotionStateTypeDef *destination) const;
+    // Estimate extrapolated to time in HostClockNanoseconds units, returns same as read
+    int predict(uint64_t time, MotionStateTypeDef *destination) const;
+    // Report interval the filter is using
+    uint64_t reportIntervalNs() const;
+
+private:
+    float alpha;
+    float beta;
+    float gamma;
+
+    bool initialized = false;
+    MotionStateTypeDef estimate = {};
+    float intervalSeconds;
+    std::atomic<uint64_t> intervalNs;
+    SeqLock<MotionStateTypeDef> published;
+};
+
+#endif // MOTION_ESTIMATOR_H
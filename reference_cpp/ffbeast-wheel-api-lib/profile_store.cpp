@@ -0,0 +1,268 @@
+#include "profile_store.h"
+#include <string.h>
+#include <algorithm>
+#include "settings_fields.h"
+
+static int32_t ClampToField(const SettingsFieldInfoTypeDef *info, int32_t value){
+    return value < info->Min ? info->Min : (value > info->Max ? info->Max : value);
+}
+
+int ProfileStoreBuilder::addProfile(uint32_t carId, const SettingsUpdateTypeDef *updates, int count){
+    if (count < 0 || count > PROFILE_MAX_FRAMES){
+        return 0;
+    }
+    ProfileTypeDef profile;
+    profile.CarId = carId;
+    for (int i = 0; i < count; ++i){
+        const SettingsFieldInfoTypeDef *info = FindSettingsField(updates[i].Field);
+        if (info == nullptr || updates[i].Index >= info->Count || (int) updates[i].Field > UINT8_MAX){
+            return 0;
+        }
+        ProfileEntryTypeDef entry = {};
+        entry.Field = (uint8_t) updates[i].Field;
+        entry.Index = updates[i].Index;
+        entry.Flags = info->Group == SETTINGS_GROUP_NONE ? PROFILE_ENTRY_WRITE_ONLY : 0;
+        entry.Value = ClampToField(info, updates[i].Value);
+
+        bool repeated = false;
+        for (size_t j = 0; j < profile.Entries.size(); ++j){
+            if (profile.Entries[j].Field == entry.Field && profile.Entries[j].Index == entry.Index){
+                profile.Entries[j].Value = entry.Value;
+                repeated = true;
+                break;
+            }
+        }
+        if (!repeated){
+            profile.Entries.push_back(entry);
+        }
+    }
+
+    for (size_t i = 0; i < profiles.size(); ++i){
+        if (profiles[i].CarId == carId){
+            profiles[i] = profile;
+            return 1;
+        }
+    }
+    profiles.push_back(profile);
+    return 1;
+}
+
+int ProfileStoreBuilder::profileCount() const{
+    return (int) profiles.size();
+}
+
+void ProfileStoreBuilder::clear(){
+    profiles.clear();
+}
+
+int ProfileStoreBuilder::write(const char *path) const{
+    std::vector<const ProfileTypeDef *> sorted;
+    size_t frameCount = 0;
+    for (size_t i = 0; i < profiles.size(); ++i){
+        sorted.push_back(&profiles[i]);
+        frameCount += profiles[i].Entries.size();
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const ProfileTypeDef *a, const ProfileTypeDef *b){
+        return a->CarId < b->CarId;
+    });
+
+    ProfileStoreHeaderTypeDef header = {};
+    header.Magic = PROFILE_STORE_MAGIC;
+    header.Version = PROFILE_STORE_VERSION;
+    header.FrameSize = sizeof(HidInOutReportTypeDef);
+    header.ProfileCount = (uint32_t) sorted.size();
+    header.FrameCount = (uint32_t) frameCount;
+    header.IndexOffset = sizeof(ProfileStoreHeaderTypeDef);
+    header.EntryOffset = header.IndexOffset + sorted.size() * sizeof(ProfileIndexTypeDef);
+    header.FrameOffset = header.EntryOffset + frameCount * sizeof(ProfileEntryTypeDef);
+    size_t size = (size_t) header.FrameOffset + frameCount * sizeof(HidInOutReportTypeDef);
+
+    MappedFile out;
+    if (out.create(path, size) < 0){
+        return -1;
+    }
+    uint8_t *base = out.data();
+    memcpy(base, &header, sizeof(header));
+    ProfileIndexTypeDef *index = (ProfileIndexTypeDef *) (base + header.IndexOffset);
+    ProfileEntryTypeDef *entries = (ProfileEntryTypeDef *) (base + header.EntryOffset);
+    HidInOutReportTypeDef *frames = (HidInOutReportTypeDef *) (base + header.FrameOffset);
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < sorted.size(); ++i){
+        const std::vector<ProfileEntryTypeDef> &source = sorted[i]->Entries;
+        index[i].CarId = sorted[i]->CarId;
+        index[i].FirstFrame = next;
+        index[i].FrameCount = (uint32_t) source.size();
+        for (size_t j = 0; j < source.size(); ++j, ++next){
+            entries[next] = source[j];
+            EncodeSettingsReport(&frames[next], FindSettingsField((SettingsFieldEnum) source[j].Field), source[j].Index,
+                                 source[j].Value);
+        }
+    }
+    int result = out.flush();
+    out.close();
+    return result > 0 ? 1 : -1;
+}
+
+ProfileStore::ProfileStore(){
+}
+
+ProfileStore::~ProfileStore(){
+    close();
+}
+
+int ProfileStore::open(const char *path){
+    close();
+    int result = file.open(path);
+    if (result <= 0){
+        return result;
+    }
+    if (Validate() < 0){
+        close();
+        return -1;
+    }
+    const uint8_t *base = file.data();
+    header = (const ProfileStoreHeaderTypeDef *) base;
+    index = (const ProfileIndexTypeDef *) (base + header->IndexOffset);
+    entryTable = (const ProfileEntryTypeDef *) (base + header->EntryOffset);
+    frameTable = (const HidInOutReportTypeDef *) (base + header->FrameOffset);
+    return 1;
+}
+
+// Offsets and counts come from the file, nothing may wrap and point outside the mapping
+static bool TableFits(size_t size, uint64_t offset, uint64_t count, size_t elementSize){
+    return offset <= size && count <= (size - offset) / elementSize;
+}
+
+// Bounds of every table, order of the index and every frame against its entry
+int ProfileStore::Validate() const{
+    size_t size = file.size();
+    const uint8_t *base = file.data();
+    const ProfileStoreHeaderTypeDef *h = (const ProfileStoreHeaderTypeDef *) base;
+    if (size < sizeof(ProfileStoreHeaderTypeDef) || h->Magic != PROFILE_STORE_MAGIC ||
+        h->Version != PROFILE_STORE_VERSION || h->FrameSize != sizeof(HidInOutReportTypeDef)){
+        return -1;
+    }
+    if (h->IndexOffset < sizeof(ProfileStoreHeaderTypeDef) ||
+        !TableFits(size, h->IndexOffset, h->ProfileCount, sizeof(ProfileIndexTypeDef)) ||
+        !TableFits(size, h->EntryOffset, h->FrameCount, sizeof(ProfileEntryTypeDef)) ||
+        !TableFits(size, h->FrameOffset, h->FrameCount, sizeof(HidInOutReportTypeDef)) ||
+        h->IndexOffset % alignof(ProfileIndexTypeDef) != 0 || h->EntryOffset % alignof(ProfileEntryTypeDef) != 0){
+        return -1;
+    }
+
+    const ProfileIndexTypeDef *profiles = (const ProfileIndexTypeDef *) (base + h->IndexOffset);
+    const ProfileEntryTypeDef *entries = (const ProfileEntryTypeDef *) (base + h->EntryOffset);
+    const HidInOutReportTypeDef *frames = (const HidInOutReportTypeDef *) (base + h->FrameOffset);
+    for (uint32_t i = 0; i < h->ProfileCount; ++i){
+        const ProfileIndexTypeDef *p = &profiles[i];
+        if ((i > 0 && profiles[i - 1].CarId >= p->CarId) || p->FrameCount > PROFILE_MAX_FRAMES ||
+            (uint64_t) p->FirstFrame + p->FrameCount > h->FrameCount){
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < h->FrameCount; ++i){
+        const ProfileEntryTypeDef *entry = &entries[i];
+        const SettingsFieldInfoTypeDef *info = FindSettingsField((SettingsFieldEnum) entry->Field);
+        if (info == nullptr || entry->Index >= info->Count || entry->Value != ClampToField(info, entry->Value)){
+            return -1;
+        }
+        HidInOutReportTypeDef expected;
+        EncodeSettingsReport(&expected, info, entry->Index, entry->Value);
+        if (memcmp(&expected, &frames[i], sizeof(HidInOutReportTypeDef)) != 0){
+            return -1;
+        }
+    }
+    return 1;
+}
+
+void ProfileStore::close(){
+    header = nullptr;
+    index = nullptr;
+    entryTable = nullptr;
+    frameTable = nullptr;
+    file.close();
+}
+
+bool ProfileStore::isOpen() const{
+    return header != nullptr;
+}
+
+int ProfileStore::profileCount() const{
+    return header != nullptr ? (int) header->ProfileCount : 0;
+}
+
+const ProfileIndexTypeDef *ProfileStore::find(uint32_t carId) const{
+    if (header == nullptr){
+        return nullptr;
+    }
+    const ProfileIndexTypeDef *end = index + header->ProfileCount;
+    const ProfileIndexTypeDef *found = std::lower_bound(index, end, carId, [](const ProfileIndexTypeDef &entry, uint32_t id){
+        return entry.CarId < id;
+    });
+    return found != end && found->CarId == carId ? found : nullptr;
+}
+
+const ProfileEntryTypeDef *ProfileStore::entries(const ProfileIndexTypeDef *profile) const{
+    return entryTable + profile->FirstFrame;
+}
+
+const HidInOutReportTypeDef *ProfileStore::frames(const ProfileIndexTypeDef *profile) const{
+    return frameTable + profile->FirstFrame;
+}
+
+int ProfileStore::apply(WheelApi *api, uint32_t carId, bool saveSettings) const{
+    const ProfileIndexTypeDef *profile = find(carId);
+    if (profile == nullptr){
+        return -1;
+    }
+    DeviceSettingsTypeDef cache;
+    bool haveCache = api->readCachedSettings(&cache) > 0;
+    const ProfileEntryTypeDef *entry = entries(profile);
+    const HidInOutReportTypeDef *frame = frames(profile);
+
+    int written = 0;
+    int failedWrites = 0;
+    // Same as SettingsTransaction, never reap the async queue of another sender
+    bool async = api->claimAsyncWrites();
+    for (uint32_t i = 0; i < profile->FrameCount; ++i){
+        const SettingsFieldInfoTypeDef *info = FindSettingsField((SettingsFieldEnum) entry[i].Field);
+        int32_t current;
+        if (haveCache && !(entry[i].Flags & PROFILE_ENTRY_WRITE_ONLY) &&
+            ReadSettingsFieldValue(&cache, info, entry[i].Index, &current) && current == entry[i].Value){
+            continue;
+        }
+        SettingsFieldEnum field = (SettingsFieldEnum) entry[i].Field;
+        int result = async ? api->sendSettingFrameAsync(&frame[i], field, entry[i].Index, entry[i].Value,
+                                                        &ProfileStore::OnWriteComplete, &failedWrites)
+                           : api->sendSettingFrame(&frame[i], field, entry[i].Index, entry[i].Value);
+        if (result <= 0){
+            failedWrites++;
+            break;
+        }
+        written++;
+    }
+
+    if (async){
+        api->completeWrites(-1);
+        api->releaseAsyncWrites();
+    }
+    if (failedWrites > 0){
+        // Not known which of the queued frames made it to the device
+        api->invalidateSettingsCache();
+        return -1;
+    }
+    if (saveSettings){
+        if (api->saveAndReboot() <= 0){
+            return -1;
+        }
+        written++;
+    }
+    return written;
+}
+
+void HID_API_CALL ProfileStore::OnWriteComplete(void *context, int result){
+    if (result < 0){
+        (*(int *) context)++;
+    }
+}
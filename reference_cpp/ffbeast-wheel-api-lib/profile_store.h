@@ -0,0 +1,117 @@
+#ifndef PROFILE_STORE_H
+#define PROFILE_STORE_H
+
+#include <stdint.h>
+#include <vector>
+#include "mapped_file.h"
+#include "settings_transaction.h"
+#include "wheel_api.h"
+
+#define PROFILE_STORE_MAGIC         0x50464546 // "FEFP" in file byte order
+#define PROFILE_STORE_VERSION       1
+#define PROFILE_MAX_FRAMES          SETTINGS_TRANSACTION_CAPACITY // Frames of one profile
+
+// Entry flags
+#define PROFILE_ENTRY_WRITE_ONLY    0x01 // Field is not part of settings reports, always sent
+
+/**
+ * First 64 bytes of a store file. Index, entries and frames follow at the given offsets.
+ * */
+typedef struct {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t FrameSize; // sizeof(HidInOutReportTypeDef)
+    uint32_t ProfileCount;
+    uint32_t FrameCount; // Total of all profiles
+    uint64_t IndexOffset; // ProfileIndexTypeDef[ProfileCount] sorted by CarId
+    uint64_t EntryOffset; // ProfileEntryTypeDef[FrameCount]
+    uint64_t FrameOffset; // HidInOutReportTypeDef[FrameCount], entry i describes frame i
+    uint8_t _padding[24];
+} ProfileStoreHeaderTypeDef;
+
+typedef struct {
+    uint32_t CarId;
+    uint32_t FirstFrame;
+    uint32_t FrameCount;
+    uint32_t Reserved;
+} ProfileIndexTypeDef;
+
+/**
+ * What a frame writes, kept so apply can diff against settings cache without decoding the frame.
+ * Value is already clamped to bounds of the field.
+ * */
+typedef struct {
+    uint8_t Field; // SettingsFieldEnum
+    uint8_t Index;
+    uint8_t Flags; // PROFILE_ENTRY_*
+    uint8_t Reserved;
+    int32_t Value;
+} ProfileEntryTypeDef;
+
+/**
+ * Compiles profiles into a store file, once, outside the sim. Updates are validated and clamped here and encoded
+ * to the exact reports the device receives, a repeated field and index keeps its first position and last value.
+ * */
+class ProfileStoreBuilder
+{
+public:
+    // Returns 1 when added, 0 when an update names an unknown field or index out of range or the profile has more
+    // than PROFILE_MAX_FRAMES updates. Adding a car id again replaces its profile.
+    int addProfile(uint32_t carId, const SettingsUpdateTypeDef *updates, int count);
+    int profileCount() const;
+    void clear();
+    // Writes the store, returns 1 or -1
+    int write(const char *path) const;
+
+private:
+    typedef struct {
+        uint32_t CarId;
+        std::vector<ProfileEntryTypeDef> Entries;
+    } ProfileTypeDef;
+
+    std::vector<ProfileTypeDef> profiles;
+};
+
+/**
+ * Store mapped read only from a single file. Every frame is checked against its entry when the store is opened,
+ * so switching cars is a binary search over the index, a compare of each entry with the settings cache and
+ * async writes of the prebuilt frames that differ. Nothing is parsed or encoded at switch time.
+ * */
+class ProfileStore
+{
+public:
+    ProfileStore();
+    ~ProfileStore();
+
+    // Returns 1, 0 when file does not exist, -1 when it is not a valid store
+    int open(const char *path);
+    void close();
+    bool isOpen() const;
+    int profileCount() const;
+
+    // Returns index entry of the car or nullptr
+    const ProfileIndexTypeDef *find(uint32_t carId) const;
+    const ProfileEntryTypeDef *entries(const ProfileIndexTypeDef *profile) const;
+    const HidInOutReportTypeDef *frames(const ProfileIndexTypeDef *profile) const;
+
+    /**
+     * Sends frames of the car profile that differ from the settings cache of the api, every frame when the cache is
+     * not valid, and waits until all of them were written. Frames are pipelined through the async queue of the api,
+     * or written one by one when another sender has claimed it. When saveSettings is set, save command follows and the
+     * device reboots. Returns number of reports written (0 when settings already match), -1 for unknown car or when
+     * a write failed, settings cache is invalidated then.
+     * */
+    int apply(WheelApi *api, uint32_t carId, bool saveSettings = false) const;
+
+private:
+    MappedFile file;
+    const ProfileStoreHeaderTypeDef *header = nullptr;
+    const ProfileIndexTypeDef *index = nullptr;
+    const ProfileEntryTypeDef *entryTable = nullptr;
+    const HidInOutReportTypeDef *frameTable = nullptr;
+
+    int Validate() const;
+    static void HID_API_CALL OnWriteComplete(void *context, int result);
+};
+
+#endif // PROFILE_STORE_H
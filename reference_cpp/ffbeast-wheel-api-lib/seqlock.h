@@ -0,0 +1,93 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Single writer sequence lock holding a copy of a trivially copyable value.
+ * Writer never waits for readers, readers retry when they overlap with a store.
+ * Payload is kept in relaxed atomic words so concurrent copies are race free.
+ * */
+template <typename T>
+class SeqLock
+{
+public:
+    SeqLock() {
+        sequence.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            payload[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Must only be called from one thread at a time
+    void store(const T &value) {
+        uint64_t words[WORD_COUNT] = {};
+        memcpy(words, &value, sizeof(T));
+
+        uint64_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            payload[i].store(words[i], std::memory_order_relaxed);
+        }
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Returns number of stores made so far, 0 means destination was not written
+    uint64_t load(T *destination) const {
+        uint64_t version;
+        while (!TryLoad(destination, &version)) {
+        }
+        return version;
+    }
+
+    /**
+     * Same as load but gives up after attempts reads that overlapped a store and returns 0 then as well.
+     * For writers in another process, which can die inside store and leave the sequence odd for good.
+     * */
+    uint64_t load(T *destination, int attempts) const {
+        uint64_t version;
+        for (int i = 0; i < attempts; ++i) {
+            if (TryLoad(destination, &version)) {
+                return version;
+            }
+        }
+        return 0;
+    }
+
+    // Number of stores made so far without copying the payload
+    uint64_t version() const {
+        return sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+private:
+    static const size_t WORD_COUNT = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> payload[WORD_COUNT];
+
+    // One read, false when it overlapped a store
+    bool TryLoad(T *destination, uint64_t *version) const {
+        uint64_t words[WORD_COUNT];
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            words[i] = payload[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+        if (before != 0) {
+            memcpy(destination, words, sizeof(T));
+        }
+        *version = before >> 1;
+        return true;
+    }
+};
+
+#endif // SEQLOCK_H
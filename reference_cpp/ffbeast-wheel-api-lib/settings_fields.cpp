@@ -0,0 +1,116 @@
+#include <stddef.h>
+#include <string.h>
+#include "settings_fields.h"
+
+#define SETTINGS_FIELD_INFO(field, type, group, structType, member, count, min, max) \
+    { field, type, group, (uint8_t) offsetof(structType, member), count, min, max },
+
+static const SettingsFieldInfoTypeDef SETTINGS_FIELDS[] = {
+    SETTINGS_FIELD_LIST(SETTINGS_FIELD_INFO)
+    { SETTINGS_FIELD_RESET_CENTER_ON_Z0, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_NONE, 0, 1, 0, 1 },
+};
+
+#undef SETTINGS_FIELD_INFO
+
+static const int VALUE_SIZE[] = { 1, 1, 2, 2 };
+
+static uint8_t *GroupBase(DeviceSettingsTypeDef *settings, SettingsGroupEnum group) {
+    switch (group) {
+    case SETTINGS_GROUP_EFFECT:
+        return (uint8_t *) &settings->Effect;
+    case SETTINGS_GROUP_HARDWARE:
+        return (uint8_t *) &settings->Hardware;
+    case SETTINGS_GROUP_GPIO:
+        return (uint8_t *) &settings->Gpio;
+    case SETTINGS_GROUP_ADC:
+        return (uint8_t *) &settings->Adc;
+    default:
+        return nullptr;
+    }
+}
+
+static int32_t ClampToField(const SettingsFieldInfoTypeDef *info, int32_t value) {
+    return value < info->Min ? info->Min : (value > info->Max ? info->Max : value);
+}
+
+const SettingsFieldInfoTypeDef *FindSettingsField(SettingsFieldEnum field) {
+    for (size_t i = 0; i < sizeof(SETTINGS_FIELDS) / sizeof(SETTINGS_FIELDS[0]); ++i) {
+        if (SETTINGS_FIELDS[i].Field == field) {
+            return &SETTINGS_FIELDS[i];
+        }
+    }
+    return nullptr;
+}
+
+int ReadSettingsFieldValue(const DeviceSettingsTypeDef *settings, const SettingsFieldInfoTypeDef *info, uint8_t index, int32_t *value) {
+    const uint8_t *base = GroupBase((DeviceSettingsTypeDef *) settings, info->Group);
+    if (base == nullptr || index >= info->Count) {
+        return 0;
+    }
+    const uint8_t *source = base + info->Offset + index * VALUE_SIZE[info->Type];
+    switch (info->Type) {
+    case SETTINGS_VALUE_INT8: {
+        int8_t v; memcpy(&v, source, sizeof(v)); *value = v;
+        break;
+    }
+    case SETTINGS_VALUE_UINT8: {
+        uint8_t v; memcpy(&v, source, sizeof(v)); *value = v;
+        break;
+    }
+    case SETTINGS_VALUE_INT16: {
+        int16_t v; memcpy(&v, source, sizeof(v)); *value = v;
+        break;
+    }
+    case SETTINGS_VALUE_UINT16: {
+        uint16_t v; memcpy(&v, source, sizeof(v)); *value = v;
+        break;
+    }
+    }
+    return 1;
+}
+
+int WriteSettingsFieldValue(DeviceSettingsTypeDef *settings, const SettingsFieldInfoTypeDef *info, uint8_t index, int32_t value) {
+    uint8_t *base = GroupBase(settings, info->Group);
+    if (base == nullptr || index >= info->Count) {
+        return 0;
+    }
+    uint8_t *destination = base + info->Offset + index * VALUE_SIZE[info->Type];
+    value = ClampToField(info, value);
+    switch (info->Type) {
+    case SETTINGS_VALUE_INT8: {
+        int8_t v = (int8_t) value; memcpy(destination, &v, sizeof(v));
+        break;
+    }
+    case SETTINGS_VALUE_UINT8: {
+        uint8_t v = (uint8_t) value; memcpy(destination, &v, sizeof(v));
+        break;
+    }
+    case SETTINGS_VALUE_INT16: {
+        int16_t v = (int16_t) value; memcpy(destination, &v, sizeof(v));
+        break;
+    }
+    case SETTINGS_VALUE_UINT16: {
+        uint16_t v = (uint16_t) value; memcpy(destination, &v, sizeof(v));
+        break;
+    }
+    }
+    return 1;
+}
+
+void EncodeSettingsReport(HidInOutReportTypeDef *report, const SettingsFieldInfoTypeDef *info, uint8_t index, int32_t value) {
+    value = ClampToField(info, value);
+    switch (info->Type) {
+    case SETTINGS_VALUE_INT8:
+        CreateSettingsReport(report, (uint8_t) info->Field, index, (int8_t) value);
+        break;
+    case SETTINGS_VALUE_UINT8:
+        CreateSettingsReport(report, (uint8_t) info->Field, index, (uint8_t) value);
+        break;
+    case SETTINGS_VALUE_INT16:
+        CreateSettingsReport(report, (uint8_t) info->Field, index, (int16_t) value);
+        break;
+    case SETTINGS_VALUE_UINT16:
+        CreateSettingsReport(report, (uint8_t) info->Field, index, (uint16_t) value);
+        break;
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef SETTINGS_FIELDS_H
+#define SETTINGS_FIELDS_H
+
+#include <stdint.h>
+#include <limits>
+#include "wheel_api.h"
+
+typedef enum SettingsValueTypeEnum {
+    SETTINGS_VALUE_INT8 = 0,
+    SETTINGS_VALUE_UINT8 = 1,
+    SETTINGS_VALUE_INT16 = 2,
+    SETTINGS_VALUE_UINT16 = 3,
+} SettingsValueTypeEnum;
+
+typedef enum SettingsGroupEnum {
+    SETTINGS_GROUP_EFFECT = 0, // EffectSettingsTypeDef
+    SETTINGS_GROUP_HARDWARE = 1, // HardwareSettingsTypeDef
+    SETTINGS_GROUP_GPIO = 2, // GpioExtensionSettingsTypeDef
+    SETTINGS_GROUP_ADC = 3, // AdcExtensionSettingsTypeDef
+    SETTINGS_GROUP_NONE = 4, // Write only field that is not reported back in any feature report
+} SettingsGroupEnum;
+
+/**
+ * Wire layout of every settings field, same information as FIELD_TYPE_MAP on TS side.
+ * X(field, value type, group, struct type, struct member, number of indexes, min value, max value)
+ * Bounds follow the ranges documented on the settings structs.
+ * */
+#define SETTINGS_FIELD_LIST(X) \
+    X(SETTINGS_FIELD_DIRECT_X_CONSTANT_DIRECTION, SETTINGS_VALUE_INT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, DirectXConstantDirection, 1, -1, 1) \
+    X(SETTINGS_FIELD_DIRECT_X_SPRING_STRENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, DirectXSpringStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_DIRECT_X_CONSTANT_STRENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, DirectXConstantStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_DIRECT_X_PERIODIC_STRENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, DirectXPeriodicStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_TOTAL_EFFECT_STRENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, TotalEffectStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_MOTION_RANGE, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, MotionRange, 1, 0, UINT16_MAX) \
+    X(SETTINGS_FIELD_SOFT_STOP_STRENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, SoftStopStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_SOFT_STOP_RANGE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, SoftStopRange, 1, 0, UINT8_MAX) \
+    X(SETTINGS_FIELD_STATIC_DAMPENING_STRENGTH, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, StaticDampeningStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_SOFT_STOP_DAMPENING_STRENGTH, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, SoftStopDampeningStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_INTEGRATED_SPRING_STRENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_EFFECT, EffectSettingsTypeDef, IntegratedSpringStrength, 1, 0, 100) \
+    X(SETTINGS_FIELD_FORCE_ENABLED, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, ForceEnabled, 1, 0, 1) \
+    X(SETTINGS_FIELD_DEBUG_TORQUE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, DebugTorque, 1, 0, 1) \
+    X(SETTINGS_FIELD_AMPLIFIER_GAIN, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, AmplifierGain, 1, AMPLIFIER_GAIN_80, AMPLIFIER_GAIN_10) \
+    X(SETTINGS_FIELD_CALIBRATION_MAGNITUDE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, CalibrationMagnitude, 1, 0, 100) \
+    X(SETTINGS_FIELD_CALIBRATION_SPEED, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, CalibrationSpeed, 1, 0, 100) \
+    X(SETTINGS_FIELD_POWER_LIMIT, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, PowerLimit, 1, 0, 100) \
+    X(SETTINGS_FIELD_BRAKING_LIMIT, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, BrakingLimit, 1, 0, 100) \
+    X(SETTINGS_FIELD_POSITION_SMOOTHING, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, PositionSmoothing, 1, 0, 100) \
+    X(SETTINGS_FIELD_SPEED_BUFFER_SIZE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, SpeedBufferSize, 1, 0, UINT8_MAX) \
+    X(SETTINGS_FIELD_ENCODER_DIRECTION, SETTINGS_VALUE_INT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, EncoderDirection, 1, -1, 1) \
+    X(SETTINGS_FIELD_FORCE_DIRECTION, SETTINGS_VALUE_INT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, ForceDirection, 1, -1, 1) \
+    X(SETTINGS_FIELD_POLE_PAIRS, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, PolePairs, 1, 0, UINT8_MAX) \
+    X(SETTINGS_FIELD_ENCODER_CPR, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, EncoderCPR, 1, 0, UINT16_MAX) \
+    X(SETTINGS_FIELD_P_GAIN, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, ProportionalGain, 1, 0, UINT8_MAX) \
+    X(SETTINGS_FIELD_I_GAIN, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_HARDWARE, HardwareSettingsTypeDef, IntegralGain, 1, 0, UINT16_MAX) \
+    X(SETTINGS_FIELD_EXTENSION_MODE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, ExtensionMode, 1, EXTENSION_MODE_NONE, EXTENSION_MODE_CUSTOM) \
+    X(SETTINGS_FIELD_PIN_MODE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, PinMode, 10, PIN_MODE_NONE, PIN_MODE_REBOOT) \
+    X(SETTINGS_FIELD_BUTTON_MODE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, ButtonMode, 32, BUTTON_MODE_NONE, BUTTON_MODE_PULSE_INVERTED) \
+    X(SETTINGS_FIELD_SPI_MODE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, SpiMode, 1, SPI_MODE_0, SPI_MODE_3) \
+    X(SETTINGS_FIELD_SPI_LATCH_MODE, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, SpiLatchMode, 1, LATCH_MODE_UP, LATCH_MODE_DOWN) \
+    X(SETTINGS_FIELD_SPI_LATCH_DELAY, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, SpiLatchDelay, 1, 0, UINT8_MAX) \
+    X(SETTINGS_FIELD_SPI_CLK_PULSE_LENGTH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_GPIO, GpioExtensionSettingsTypeDef, SpiClkPulseLength, 1, 0, UINT8_MAX) \
+    X(SETTINGS_FIELD_ADC_MIN_DEAD_ZONE, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_ADC, AdcExtensionSettingsTypeDef, RAxisMin, 3, 0, UINT16_MAX) \
+    X(SETTINGS_FIELD_ADC_MAX_DEAD_ZONE, SETTINGS_VALUE_UINT16, SETTINGS_GROUP_ADC, AdcExtensionSettingsTypeDef, RAxisMax, 3, 0, UINT16_MAX) \
+    X(SETTINGS_FIELD_ADC_TO_BUTTON_LOW, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_ADC, AdcExtensionSettingsTypeDef, RAxisToButtonLow, 3, 0, 100) \
+    X(SETTINGS_FIELD_ADC_TO_BUTTON_HIGH, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_ADC, AdcExtensionSettingsTypeDef, RAxisToButtonHigh, 3, 0, 100) \
+    X(SETTINGS_FIELD_ADC_SMOOTHING, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_ADC, AdcExtensionSettingsTypeDef, RAxisSmoothing, 3, 0, 100) \
+    X(SETTINGS_FIELD_ADC_INVERT, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_ADC, AdcExtensionSettingsTypeDef, RAxisInvert, 3, 0, 1)
+
+typedef struct {
+    SettingsFieldEnum Field;
+    SettingsValueTypeEnum Type;
+    SettingsGroupEnum Group;
+    uint8_t Offset; // Offset of the member inside struct of the group
+    uint8_t Count; // Number of valid indexes, 1 for non indexed settings
+    int32_t Min; // Valid bounds of the value, always inside range of wire type
+    int32_t Max;
+} SettingsFieldInfoTypeDef;
+
+// Returns layout of the field or nullptr for unknown field id
+const SettingsFieldInfoTypeDef *FindSettingsField(SettingsFieldEnum field);
+
+// Reads current value of the field from settings, returns 0 for write only fields or index out of range
+int ReadSettingsFieldValue(const DeviceSettingsTypeDef *settings, const SettingsFieldInfoTypeDef *info, uint8_t index, int32_t *value);
+// Stores value of the field into settings clamped to its bounds, returns 0 for write only fields or index out of range
+int WriteSettingsFieldValue(DeviceSettingsTypeDef *settings, const SettingsFieldInfoTypeDef *info, uint8_t index, int32_t value);
+
+// Builds generic settings report, value is clamped to bounds of the field
+void EncodeSettingsReport(HidInOutReportTypeDef *report, const SettingsFieldInfoTypeDef *info, uint8_t index, int32_t value);
+
+template <SettingsValueTypeEnum Type>
+struct SettingsWireType;
+template <> struct SettingsWireType<SETTINGS_VALUE_INT8> { typedef int8_t Type; };
+template <> struct SettingsWireType<SETTINGS_VALUE_UINT8> { typedef uint8_t Type; };
+template <> struct SettingsWireType<SETTINGS_VALUE_INT16> { typedef int16_t Type; };
+template <> struct SettingsWireType<SETTINGS_VALUE_UINT16> { typedef uint16_t Type; };
+
+/**
+ * Same table as SETTINGS_FIELDS, resolved at compile time so sendSetting needs no lookup or type switch.
+ * */
+#define SETTINGS_FIELD_TRAITS(field, type, group, structType, member, count, minValue, maxValue) \
+    template <> struct SettingsFieldTraits<field> { \
+        typedef SettingsWireType<type>::Type ValueType; \
+        static const SettingsValueTypeEnum Type = type; \
+        static const SettingsGroupEnum Group = group; \
+        static const uint8_t Count = count; \
+        static constexpr int32_t Min = minValue; \
+        static constexpr int32_t Max = maxValue; \
+        static_assert(Min >= std::numeric_limits<ValueType>::min() && Max <= std::numeric_limits<ValueType>::max(), \
+                      "Bounds of " #field " do not fit its wire type"); \
+    };
+
+SETTINGS_FIELD_LIST(SETTINGS_FIELD_TRAITS)
+SETTINGS_FIELD_TRAITS(SETTINGS_FIELD_RESET_CENTER_ON_Z0, SETTINGS_VALUE_UINT8, SETTINGS_GROUP_NONE, void, none, 1, 0, 1)
+
+#undef SETTINGS_FIELD_TRAITS
+
+template <SettingsFieldEnum Field>
+int WheelApi::sendSetting(typename SettingsFieldTraits<Field>::ValueType value, uint8_t index) {
+    typedef SettingsFieldTraits<Field> Traits;
+    if (handle == nullptr || index >= Traits::Count) {
+        return 0;
+    }
+    if (value < Traits::Min) {
+        value = (typename Traits::ValueType) Traits::Min;
+    } else if (value > Traits::Max) {
+        value = (typename Traits::ValueType) Traits::Max;
+    }
+    HidInOutReportTypeDef genericReport;
+    CreateSettingsReport(&genericReport, (uint8_t) Field, index, value);
+    int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+    if (result > 0) {
+        UpdateSettingsCache(Field, index, value);
+    }
+    return result;
+}
+
+#endif // SETTINGS_FIELDS_H
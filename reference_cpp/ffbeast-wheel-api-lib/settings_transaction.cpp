@@ -0,0 +1,121 @@
+#include <string.h>
+#include "settings_transaction.h"
+#include "settings_fields.h"
+
+SettingsTransaction::SettingsTransaction(WheelApi *api) : api(api) {
+    memset(&baseline, 0, sizeof(baseline));
+}
+
+void SettingsTransaction::setBaseline(const DeviceSettingsTypeDef *settings){
+    if (settings == nullptr){
+        hasBaseline = false;
+        return;
+    }
+    memcpy(&baseline, settings, sizeof(DeviceSettingsTypeDef));
+    hasBaseline = true;
+}
+
+int SettingsTransaction::readBaseline(){
+    DeviceSettingsTypeDef settings;
+    if (api->readCachedSettings(&settings)){
+        setBaseline(&settings);
+        return 1;
+    }
+    if (api->readAllSettings(&settings)){
+        setBaseline(&settings);
+        return 1;
+    }
+    return 0;
+}
+
+int SettingsTransaction::set(SettingsFieldEnum field, uint8_t index, int32_t value){
+    const SettingsFieldInfoTypeDef *info = FindSettingsField(field);
+    if (info == nullptr || index >= info->Count){
+        return 0;
+    }
+    for (int i = 0; i < updateCount; ++i){
+        if (updates[i].Field == field && updates[i].Index == index){
+            updates[i].Value = value;
+            return 1;
+        }
+    }
+    if (updateCount >= SETTINGS_TRANSACTION_CAPACITY){
+        return 0;
+    }
+    updates[updateCount].Field = field;
+    updates[updateCount].Index = index;
+    updates[updateCount].Value = value;
+    updateCount++;
+    return 1;
+}
+
+void SettingsTransaction::clear(){
+    updateCount = 0;
+}
+
+int SettingsTransaction::size() const{
+    return updateCount;
+}
+
+int SettingsTransaction::commit(bool saveSettings){
+    int written = 0;
+    failedWrites = 0;
+    // Someone else owns the async queue (ForceScheduler), reaping it here would steal their completions
+    bool async = api->claimAsyncWrites();
+
+    for (int i = 0; i < updateCount; ++i){
+        const SettingsUpdateTypeDef *update = &updates[i];
+        const SettingsFieldInfoTypeDef *info = FindSettingsField(update->Field);
+        int32_t current;
+        if (hasBaseline && ReadSettingsFieldValue(&baseline, info, update->Index, &current)){
+            // Compare what would actually go on the wire
+            DeviceSettingsTypeDef probe = baseline;
+            int32_t encoded;
+            WriteSettingsFieldValue(&probe, info, update->Index, update->Value);
+            ReadSettingsFieldValue(&probe, info, update->Index, &encoded);
+            if (encoded == current){
+                continue;
+            }
+        }
+        int result = async ? api->sendSettingAsync(update->Field, update->Index, update->Value,
+                                                   &SettingsTransaction::OnWriteComplete, this)
+                           : api->sendSettingReport(update->Field, update->Index, update->Value);
+        if (result <= 0){
+            failedWrites++;
+            break;
+        }
+        written++;
+    }
+
+    if (async){
+        api->completeWrites(-1);
+        api->releaseAsyncWrites();
+    }
+    if (failedWrites > 0){
+        // Not known which of the queued values made it to the device
+        api->invalidateSettingsCache();
+        hasBaseline = false;
+        return -1;
+    }
+
+    if (hasBaseline){
+        for (int i = 0; i < updateCount; ++i){
+            WriteSettingsFieldValue(&baseline, FindSettingsField(updates[i].Field), updates[i].Index, updates[i].Value);
+        }
+    }
+    updateCount = 0;
+
+    if (saveSettings){
+        if (api->saveAndReboot() <= 0){
+            return -1;
+        }
+        written++;
+    }
+    return written;
+}
+
+void HID_API_CALL SettingsTransaction::OnWriteComplete(void *context, int result){
+    if (result < 0){
+        ((SettingsTransaction *) context)->failedWrites++;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef SETTINGS_TRANSACTION_H
+#define SETTINGS_TRANSACTION_H
+
+#include <stdint.h>
+#include "wheel_api.h"
+
+#define SETTINGS_TRANSACTION_CAPACITY 128 // Enough for every field and index of a full profile
+
+typedef struct {
+    SettingsFieldEnum Field;
+    uint8_t Index;
+    int32_t Value;
+} SettingsUpdateTypeDef;
+
+/**
+ * Collects many settings updates and applies them as one batch.
+ * Updates equal to the baseline are dropped, the rest are pipelined back to back with async writes.
+ * Repeated update of the same field and index keeps only the last value.
+ * */
+class SettingsTransaction
+{
+public:
+    explicit SettingsTransaction(WheelApi *api);
+
+    // Settings the diff is computed against, without baseline every update is sent
+    void setBaseline(const DeviceSettingsTypeDef *settings);
+    // Takes baseline from settings cache of the api, reads it from the device when cache is not valid
+    int readBaseline();
+
+    // Returns 1 when update was recorded, 0 for unknown field, index out of range or full transaction
+    int set(SettingsFieldEnum field, uint8_t index, int32_t value);
+    void clear();
+    int size() const;
+
+    /**
+     * Sends every update that differs from baseline and waits until all of them were written. Writes are pipelined
+     * through the async queue of the api, or sent one by one when another sender has claimed it.
+     * When saveSettings is set, single save command is sent at the end, device will reboot afterwards.
+     * Returns number of reports written or -1 when any of the writes failed.
+     * Baseline is updated with written values, transaction is cleared on success.
+     * */
+    int commit(bool saveSettings);
+
+private:
+    WheelApi *api;
+    DeviceSettingsTypeDef baseline;
+    bool hasBaseline = false;
+
+    SettingsUpdateTypeDef updates[SETTINGS_TRANSACTION_CAPACITY];
+    int updateCount = 0;
+    int failedWrites = 0;
+
+    static void HID_API_CALL OnWriteComplete(void *context, int result);
+};
+
+#endif // SETTINGS_TRANSACTION_H
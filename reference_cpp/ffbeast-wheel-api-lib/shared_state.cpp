@@ -0,0 +1,133 @@
+#include "shared_state.h"
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static uint64_t CurrentProcessId(){
+#ifdef _WIN32
+    return (uint64_t) GetCurrentProcessId();
+#else
+    return (uint64_t) getpid();
+#endif
+}
+
+SharedStatePublisher::SharedStatePublisher(){
+}
+
+SharedStatePublisher::~SharedStatePublisher(){
+    close();
+}
+
+int SharedStatePublisher::open(const char *name){
+    close();
+    if (file.createShared(name, sizeof(SharedStateSegmentTypeDef)) < 0){
+        return -1;
+    }
+    // Segment is zero filled, constructing in place only makes the atomics official
+    SharedStateSegmentTypeDef *created = new (file.data()) SharedStateSegmentTypeDef();
+    created->Version = SHARED_STATE_VERSION;
+    created->Size = sizeof(SharedStateSegmentTypeDef);
+    created->PublisherId = CurrentProcessId();
+    created->Flags.store(SHARED_STATE_ACTIVE, std::memory_order_relaxed);
+    created->Magic.store(SHARED_STATE_MAGIC, std::memory_order_release);
+    segment = created;
+    return 1;
+}
+
+void SharedStatePublisher::close(){
+    if (segment != nullptr){
+        segment->Flags.store(0, std::memory_order_release);
+        segment = nullptr;
+    }
+    file.close();
+}
+
+bool SharedStatePublisher::isOpen() const{
+    return segment != nullptr;
+}
+
+uint64_t SharedStatePublisher::publishedStates() const{
+    return segment != nullptr ? segment->State.version() : 0;
+}
+
+SharedStateReader::SharedStateReader(){
+}
+
+SharedStateReader::~SharedStateReader(){
+    close();
+}
+
+int SharedStateReader::open(const char *name){
+    close();
+    int result = file.openShared(name);
+    if (result <= 0){
+        return result;
+    }
+    const SharedStateSegmentTypeDef *mapped = (const SharedStateSegmentTypeDef *) file.data();
+    if (file.size() < sizeof(SharedStateSegmentTypeDef)){
+        file.close();
+        return -1;
+    }
+    uint32_t magic = mapped->Magic.load(std::memory_order_acquire);
+    if (magic == 0){
+        // Created but not initialized yet
+        file.close();
+        return 0;
+    }
+    if (magic != SHARED_STATE_MAGIC || mapped->Version != SHARED_STATE_VERSION ||
+        mapped->Size != sizeof(SharedStateSegmentTypeDef)){
+        file.close();
+        return -1;
+    }
+    segment = mapped;
+    return 1;
+}
+
+void SharedStateReader::close(){
+    segment = nullptr;
+    file.close();
+}
+
+bool SharedStateReader::isOpen() const{
+    return segment != nullptr;
+}
+
+bool SharedStateReader::isPublisherActive() const{
+    return segment != nullptr && (segment->Flags.load(std::memory_order_acquire) & SHARED_STATE_ACTIVE) != 0;
+}
+
+uint64_t SharedStateReader::readState(TimestampedStateTypeDef *destination) const{
+    return segment != nullptr ? segment->State.load(destination, SHARED_STATE_READ_ATTEMPTS) : 0;
+}
+
+uint64_t SharedStateReader::readState(DeviceStateTypeDef *destination) const{
+    TimestampedStateTypeDef sample;
+    uint64_t version = readState(&sample);
+    if (version != 0){
+        memcpy(destination, &sample.State, sizeof(DeviceStateTypeDef));
+    }
+    return version;
+}
+
+uint64_t SharedStateReader::stateVersion() const{
+    return segment != nullptr ? segment->State.version() : 0;
+}
+
+int SharedStateReader::readSettings(DeviceSettingsTypeDef *destination, uint8_t *validGroups) const{
+    SharedSettingsTypeDef shared;
+    if (segment == nullptr || segment->Settings.load(&shared, SHARED_STATE_READ_ATTEMPTS) == 0){
+        if (validGroups != nullptr){
+            *validGroups = 0;
+        }
+        return 0;
+    }
+    memcpy(destination, &shared.Settings, sizeof(DeviceSettingsTypeDef));
+    if (validGroups != nullptr){
+        *validGroups = shared.ValidGroups;
+    }
+    return shared.ValidGroups == SETTINGS_CACHE_ALL ? 1 : 0;
+}
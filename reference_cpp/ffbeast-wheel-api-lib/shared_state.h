@@ -0,0 +1,121 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <stdint.h>
+#include <atomic>
+#include "mapped_file.h"
+#include "seqlock.h"
+#include "wheel_api.h"
+
+#define SHARED_STATE_DEFAULT_NAME   "ffbeast-wheel-0" // One segment per wheel, publishers of further wheels count up
+#define SHARED_STATE_MAGIC          0x53414546 // "FEAS" in memory byte order
+#define SHARED_STATE_VERSION        1
+#define SHARED_STATE_READ_ATTEMPTS  1024 // Overlapping reads before a reader assumes the publisher died inside a store
+
+// Segment status flags
+#define SHARED_STATE_ACTIVE         0x01 // Publisher is attached, cleared on close. A crashed publisher leaves it set,
+                                         // age of the state timestamp tells readers whether anything still moves
+
+/**
+ * Settings as cached by the owning WheelApi, ValidGroups holds SETTINGS_CACHE_* bits of the groups that are known.
+ * */
+typedef struct {
+    uint8_t ValidGroups;
+    uint8_t _padding[7];
+    DeviceSettingsTypeDef Settings;
+} SharedSettingsTypeDef;
+
+/**
+ * Layout of the named segment. Magic is stored last when publisher attaches, so a reader that sees it sees
+ * a fully initialized segment. Both locks are lock free 64 bit atomics, which are address free and work across
+ * processes. State and settings sit on separate cache lines so settings updates never slow down state readers.
+ * */
+// Atomics of the segment are shared between processes, which holds only when they are lock free (address free)
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared state segment needs lock free 32 and 64 bit atomics");
+
+struct SharedStateSegmentTypeDef {
+    std::atomic<uint32_t> Magic;
+    uint32_t Version;
+    uint32_t Size; // sizeof(SharedStateSegmentTypeDef) of the publisher, readers reject a different layout
+    std::atomic<uint32_t> Flags;
+    uint64_t PublisherId; // Process id of the publisher
+
+    alignas(64) SeqLock<TimestampedStateTypeDef> State;
+    alignas(64) SeqLock<SharedSettingsTypeDef> Settings;
+};
+
+/**
+ * Owner side of the segment. Attach it to the WheelApi that owns the device with WheelApi::setSharedPublisher,
+ * every state report read by readState, the background reader or pumpState is then published together with
+ * every change of the settings cache. Publishing is a seqlock store, no system call.
+ * State and settings each need a single writer, which is how WheelApi already calls them.
+ * */
+class SharedStatePublisher
+{
+public:
+    SharedStatePublisher();
+    ~SharedStatePublisher();
+
+    // Creates the segment, returns 1 or -1
+    int open(const char *name = SHARED_STATE_DEFAULT_NAME);
+    // Clears SHARED_STATE_ACTIVE and removes the segment, readers keep their mapping until they close
+    void close();
+    bool isOpen() const;
+
+    void publishState(const TimestampedStateTypeDef &sample){
+        if (segment != nullptr){
+            segment->State.store(sample);
+        }
+    }
+
+    void publishSettings(const DeviceSettingsTypeDef &settings, uint8_t validGroups){
+        if (segment == nullptr){
+            return;
+        }
+        SharedSettingsTypeDef shared = {};
+        shared.ValidGroups = validGroups;
+        shared.Settings = settings;
+        segment->Settings.store(shared);
+    }
+
+    uint64_t publishedStates() const;
+
+private:
+    MappedFile file;
+    SharedStateSegmentTypeDef *segment = nullptr;
+};
+
+/**
+ * Reader side, any number of processes. Reads copy out of the mapping and retry only while they overlap with a
+ * store, there is no lock, no system call and nothing a reader does can stall the publisher.
+ * Timestamps are HostClockNanoseconds of the publisher, the clock is system wide so age is now minus Timestamp.
+ * */
+class SharedStateReader
+{
+public:
+    SharedStateReader();
+    ~SharedStateReader();
+
+    // Returns 1, 0 when no publisher created the segment yet, -1 on error or layout mismatch
+    int open(const char *name = SHARED_STATE_DEFAULT_NAME);
+    void close();
+    bool isOpen() const;
+    bool isPublisherActive() const;
+
+    // Returns number of states published so far, 0 means destination was not written: nothing published yet or
+    // the publisher stopped inside a store (SHARED_STATE_READ_ATTEMPTS reads overlapped it), readers never hang
+    uint64_t readState(TimestampedStateTypeDef *destination) const;
+    uint64_t readState(DeviceStateTypeDef *destination) const;
+    // Cheap check for new data without copying
+    uint64_t stateVersion() const;
+    // Returns 1 when every group is valid, 0 otherwise or when the read gave up like readState. Optional
+    // validGroups receives SETTINGS_CACHE_* bits, destination is written even when only some groups are valid.
+    int readSettings(DeviceSettingsTypeDef *destination, uint8_t *validGroups = nullptr) const;
+
+private:
+    MappedFile file;
+    const SharedStateSegmentTypeDef *segment = nullptr;
+};
+
+#endif // SHARED_STATE_H
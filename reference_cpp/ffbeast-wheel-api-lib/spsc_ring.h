@@ -0,0 +1,68 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Bounded lock free ring for exactly one producer thread and one consumer thread.
+ * Storage is inline so neither push nor drain allocates. Capacity must be a power of two.
+ * When ring is full push fails and the new element is dropped, already queued elements are kept.
+ * */
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Producer side
+    bool push(const T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= Capacity) {
+            return false;
+        }
+        items[h & MASK] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies up to maxCount oldest elements and returns how many were copied.
+    size_t drain(T *destination, size_t maxCount) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - t;
+        size_t count = available < maxCount ? available : maxCount;
+        size_t first = t & MASK;
+        size_t firstChunk = Capacity - first < count ? Capacity - first : count;
+        memcpy(destination, &items[first], firstChunk * sizeof(T));
+        memcpy(destination + firstChunk, &items[0], (count - firstChunk) * sizeof(T));
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Drops everything queued so far.
+    void clear() {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // Approximate when called from a third thread
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    static size_t capacity() {
+        return Capacity;
+    }
+
+private:
+    static const size_t MASK = Capacity - 1;
+
+    // Indexes are kept on separate cache lines so producer and consumer do not contend
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) T items[Capacity];
+};
+
+#endif // SPSC_RING_H
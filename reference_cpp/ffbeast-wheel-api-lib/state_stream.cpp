@@ -0,0 +1,270 @@
+#include "state_stream.h"
+#include <string.h>
+
+#define KEYFRAME_SIZE       20
+#define CONTROL_SIZE        20
+#define FIELD_MASK          0x0F
+
+static uint8_t *PutU16(uint8_t *out, uint16_t value){
+    out[0] = (uint8_t) value;
+    out[1] = (uint8_t) (value >> 8);
+    return out + 2;
+}
+
+static uint8_t *PutU32(uint8_t *out, uint32_t value){
+    for (int i = 0; i < 4; i++){
+        out[i] = (uint8_t) (value >> (8 * i));
+    }
+    return out + 4;
+}
+
+static uint8_t *PutU64(uint8_t *out, uint64_t value){
+    for (int i = 0; i < 8; i++){
+        out[i] = (uint8_t) (value >> (8 * i));
+    }
+    return out + 8;
+}
+
+static uint8_t *PutVarint(uint8_t *out, uint64_t value){
+    while (value >= 0x80){
+        *out++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t) value;
+    return out;
+}
+
+// Small differences of either sign become small unsigned numbers
+static uint64_t Zigzag(int32_t value){
+    return (uint64_t) (((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+}
+
+static int32_t Unzigzag(uint64_t value){
+    return (int32_t) ((uint32_t) (value >> 1) ^ (uint32_t) -(int32_t) (value & 1));
+}
+
+static uint16_t GetU16(const uint8_t *in){
+    return (uint16_t) (in[0] | (in[1] << 8));
+}
+
+static uint32_t GetU32(const uint8_t *in){
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++){
+        value |= (uint32_t) in[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t GetU64(const uint8_t *in){
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++){
+        value |= (uint64_t) in[i] << (8 * i);
+    }
+    return value;
+}
+
+// Returns position after the varint, nullptr when it runs past end or is longer than 64 bits
+static const uint8_t *GetVarint(const uint8_t *in, const uint8_t *end, uint64_t *value){
+    *value = 0;
+    for (int shift = 0; shift < 64 && in < end; shift += 7){
+        uint8_t byte = *in++;
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)){
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+size_t StateStreamEncoder::encode(const TimestampedStateTypeDef *sample, uint8_t *destination, size_t capacity){
+    if (capacity < STREAM_MAX_PACKET){
+        return 0;
+    }
+    const DeviceStateTypeDef *state = &sample->State;
+    uint64_t time = sample->Timestamp / STREAM_TIME_UNIT_NS;
+    uint8_t *out = destination;
+
+    if (sinceKeyframe >= STREAM_KEYFRAME_INTERVAL){
+        *out++ = STREAM_PACKET_KEYFRAME;
+        out = PutU16(out, sequence);
+        out = PutU64(out, sample->Timestamp);
+        memcpy(out, &state->FirmwareVersion, sizeof(FirmwareVersionTypeDef));
+        out += sizeof(FirmwareVersionTypeDef);
+        *out++ = state->IsRegistered;
+        out = PutU16(out, (uint16_t) state->Position);
+        out = PutU16(out, (uint16_t) state->Torque);
+        sinceKeyframe = 0;
+    } else {
+        uint8_t mask = 0;
+        if (memcmp(&state->FirmwareVersion, &previous.FirmwareVersion, sizeof(FirmwareVersionTypeDef)) != 0){
+            mask |= STREAM_FIELD_FIRMWARE;
+        }
+        mask |= state->IsRegistered != previous.IsRegistered ? STREAM_FIELD_REGISTERED : 0;
+        mask |= state->Position != previous.Position ? STREAM_FIELD_POSITION : 0;
+        mask |= state->Torque != previous.Torque ? STREAM_FIELD_TORQUE : 0;
+
+        *out++ = (uint8_t) (STREAM_PACKET_DELTA | mask);
+        out = PutU16(out, sequence);
+        out = PutVarint(out, time > previousTime ? time - previousTime : 0);
+        if (mask & STREAM_FIELD_FIRMWARE){
+            memcpy(out, &state->FirmwareVersion, sizeof(FirmwareVersionTypeDef));
+            out += sizeof(FirmwareVersionTypeDef);
+        }
+        if (mask & STREAM_FIELD_REGISTERED){
+            *out++ = state->IsRegistered;
+        }
+        if (mask & STREAM_FIELD_POSITION){
+            out = PutVarint(out, Zigzag((int32_t) state->Position - previous.Position));
+        }
+        if (mask & STREAM_FIELD_TORQUE){
+            out = PutVarint(out, Zigzag((int32_t) state->Torque - previous.Torque));
+        }
+        sinceKeyframe++;
+    }
+
+    // Time of a keyframe is exact, deltas build on the rounded value so receiver and sender never drift apart
+    previousTime = time > previousTime || sinceKeyframe == 0 ? time : previousTime;
+    memcpy(&previous, state, sizeof(DeviceStateTypeDef));
+    sequence++;
+    return (size_t) (out - destination);
+}
+
+void StateStreamEncoder::requestKeyframe(){
+    sinceKeyframe = STREAM_KEYFRAME_INTERVAL;
+}
+
+uint16_t StateStreamEncoder::nextSequence() const{
+    return sequence;
+}
+
+int StateStreamDecoder::decode(const uint8_t *packet, size_t length, TimestampedStateTypeDef *destination){
+    if (length < 3){
+        return -1;
+    }
+    const uint8_t *end = packet + length;
+    uint8_t type = packet[0];
+    uint16_t packetSequence = GetU16(packet + 1);
+    bool keyframe = type == STREAM_PACKET_KEYFRAME;
+    if (!keyframe && (type & ~FIELD_MASK) != STREAM_PACKET_DELTA){
+        return -1;
+    }
+    if (keyframe && length != KEYFRAME_SIZE){
+        return -1;
+    }
+
+    if (haveSequence){
+        uint16_t ahead = (uint16_t) (packetSequence - sequence);
+        if (ahead == 0 || ahead >= 0x8000){
+            // Duplicate or reordered behind newer one
+            return 0;
+        }
+        if (ahead > 1){
+            lost += ahead - 1;
+            synchronized = false;
+        }
+    }
+    haveSequence = true;
+    sequence = packetSequence;
+    if (!synchronized && !keyframe){
+        skipped++;
+        return 0;
+    }
+
+    const uint8_t *in = packet + 3;
+    if (keyframe){
+        current.Timestamp = GetU64(in);
+        in += 8;
+        memcpy(&current.State.FirmwareVersion, in, sizeof(FirmwareVersionTypeDef));
+        in += sizeof(FirmwareVersionTypeDef);
+        current.State.IsRegistered = *in++;
+        current.State.Position = (int16_t) GetU16(in);
+        current.State.Torque = (int16_t) GetU16(in + 2);
+        previousTime = current.Timestamp / STREAM_TIME_UNIT_NS;
+    } else {
+        // Decode into a copy so a malformed packet leaves current state intact
+        TimestampedStateTypeDef next = current;
+        uint64_t value;
+        uint8_t mask = type & FIELD_MASK;
+        // Delta that cannot be applied breaks the chain, wait for next keyframe
+        synchronized = false;
+        if ((in = GetVarint(in, end, &value)) == nullptr){
+            return -1;
+        }
+        uint64_t time = previousTime + value;
+        if (mask & STREAM_FIELD_FIRMWARE){
+            if (end - in < (ptrdiff_t) sizeof(FirmwareVersionTypeDef)){
+                return -1;
+            }
+            memcpy(&next.State.FirmwareVersion, in, sizeof(FirmwareVersionTypeDef));
+            in += sizeof(FirmwareVersionTypeDef);
+        }
+        if (mask & STREAM_FIELD_REGISTERED){
+            if (in >= end){
+                return -1;
+            }
+            next.State.IsRegistered = *in++;
+        }
+        if (mask & STREAM_FIELD_POSITION){
+            if ((in = GetVarint(in, end, &value)) == nullptr){
+                return -1;
+            }
+            next.State.Position = (int16_t) (next.State.Position + Unzigzag(value));
+        }
+        if (mask & STREAM_FIELD_TORQUE){
+            if ((in = GetVarint(in, end, &value)) == nullptr){
+                return -1;
+            }
+            next.State.Torque = (int16_t) (next.State.Torque + Unzigzag(value));
+        }
+        if (in != end){
+            return -1;
+        }
+        next.Timestamp = time * STREAM_TIME_UNIT_NS;
+        current = next;
+        previousTime = time;
+    }
+
+    synchronized = true;
+    memcpy(destination, &current, sizeof(TimestampedStateTypeDef));
+    return 1;
+}
+
+uint64_t StateStreamDecoder::lostPackets() const{
+    return lost;
+}
+
+uint64_t StateStreamDecoder::skippedPackets() const{
+    return skipped;
+}
+
+bool StateStreamDecoder::isSynchronized() const{
+    return synchronized;
+}
+
+size_t EncodeStreamControl(const StreamControlTypeDef *control, uint8_t *destination, size_t capacity){
+    if (capacity < CONTROL_SIZE){
+        return 0;
+    }
+    uint8_t *out = destination;
+    *out++ = STREAM_PACKET_CONTROL;
+    out = PutU64(out, control->Token);
+    out = PutU32(out, control->Sequence);
+    out = PutU16(out, (uint16_t) control->Control.SpringForce);
+    out = PutU16(out, (uint16_t) control->Control.ConstantForce);
+    out = PutU16(out, (uint16_t) control->Control.PeriodicForce);
+    *out++ = control->Control.ForceDrop;
+    return (size_t) (out - destination);
+}
+
+int DecodeStreamControl(const uint8_t *packet, size_t length, StreamControlTypeDef *destination){
+    if (length != CONTROL_SIZE || packet[0] != STREAM_PACKET_CONTROL){
+        return 0;
+    }
+    destination->Token = GetU64(packet + 1);
+    destination->Sequence = GetU32(packet + 9);
+    destination->Control.SpringForce = (int16_t) GetU16(packet + 13);
+    destination->Control.ConstantForce = (int16_t) GetU16(packet + 15);
+    destination->Control.PeriodicForce = (int16_t) GetU16(packet + 17);
+    destination->Control.ForceDrop = packet[19];
+    return 1;
+}
@@ -0,0 +1,90 @@
+#ifndef STATE_STREAM_H
+#define STATE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wheel_api.h"
+
+#define STREAM_DEFAULT_GROUP        "239.255.70.66" // Administratively scoped multicast, stays inside the site
+#define STREAM_DEFAULT_STATE_PORT   36400
+#define STREAM_DEFAULT_CONTROL_PORT 36401
+#define STREAM_KEYFRAME_INTERVAL    100 // Samples between full states, receivers that lost a packet resync within 100 ms at 1 kHz
+#define STREAM_TIME_UNIT_NS         10000ULL // Resolution of timestamps in delta packets, 1 ms interval fits one byte
+#define STREAM_MAX_PACKET           32 // Largest state or control packet
+
+/**
+ * First byte of every packet. Delta packets carry the changed field mask in the low nibble.
+ * */
+typedef enum {
+    STREAM_PACKET_KEYFRAME = 0x10, // Sequence, full timestamp and every field
+    STREAM_PACKET_DELTA = 0x20, // Sequence, timestamp delta and changed fields relative to previous sample
+    STREAM_PACKET_CONTROL = 0x40, // Client to daemon direct control
+} StreamPacketEnum;
+
+typedef enum {
+    STREAM_FIELD_FIRMWARE = 0x01,
+    STREAM_FIELD_REGISTERED = 0x02,
+    STREAM_FIELD_POSITION = 0x04, // Zigzag varint of the difference
+    STREAM_FIELD_TORQUE = 0x08, // Zigzag varint of the difference
+} StreamFieldEnum;
+
+/**
+ * Encodes state samples into packets of a few bytes. Padding of the report is never sent, unchanged fields are
+ * left out and position and torque go as variable length differences, so a sample of a wheel at rest takes 4 bytes
+ * and a moving one about 6. Every STREAM_KEYFRAME_INTERVAL samples a full state is sent instead.
+ * */
+class StateStreamEncoder
+{
+public:
+    // Returns packet length, 0 when destination is smaller than STREAM_MAX_PACKET
+    size_t encode(const TimestampedStateTypeDef *sample, uint8_t *destination, size_t capacity);
+    // Next packet is a keyframe
+    void requestKeyframe();
+    uint16_t nextSequence() const;
+
+private:
+    uint16_t sequence = 0;
+    int sinceKeyframe = STREAM_KEYFRAME_INTERVAL;
+    uint64_t previousTime = 0; // In STREAM_TIME_UNIT_NS
+    DeviceStateTypeDef previous = {};
+};
+
+/**
+ * Rebuilds samples from packets of one encoder. After a lost packet deltas are ignored until the next keyframe,
+ * so a reconstructed sample is always exactly the sample that was encoded. Timestamps are host time of the daemon.
+ * */
+class StateStreamDecoder
+{
+public:
+    // Returns 1 with destination filled, 0 when packet is skipped (old, duplicate, or waiting for keyframe), -1 when malformed
+    int decode(const uint8_t *packet, size_t length, TimestampedStateTypeDef *destination);
+
+    uint64_t lostPackets() const; // Sequence numbers that never arrived
+    uint64_t skippedPackets() const; // Deltas dropped while waiting for keyframe
+    bool isSynchronized() const;
+
+private:
+    bool synchronized = false;
+    bool haveSequence = false;
+    uint16_t sequence = 0;
+    uint64_t previousTime = 0;
+    TimestampedStateTypeDef current = {};
+    uint64_t lost = 0;
+    uint64_t skipped = 0;
+};
+
+/**
+ * Control packet, token authorizes the client, sequence orders packets so only the newest value is applied.
+ * */
+typedef struct {
+    uint64_t Token;
+    uint32_t Sequence;
+    DirectControlTypeDef Control;
+} StreamControlTypeDef;
+
+// Returns packet length, 0 when destination is too small
+size_t EncodeStreamControl(const StreamControlTypeDef *control, uint8_t *destination, size_t capacity);
+// Returns 1 when packet is a well formed control packet
+int DecodeStreamControl(const uint8_t *packet, size_t length, StreamControlTypeDef *destination);
+
+#endif // STATE_STREAM_H
@@ -0,0 +1,229 @@
+#include "telemetry_recorder.h"
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "effect_engine.h"
+#include "host_clock.h"
+
+#define REPLAY_SLEEP_MARGIN_NS 1000000ULL // Closer than this to next record the replay yields instead of sleeping
+
+static_assert(sizeof(TelemetryFileHeaderTypeDef) == 64, "Telemetry header must stay 64 bytes");
+static_assert(sizeof(TelemetryRecordTypeDef) % 8 == 0, "Telemetry records must keep timestamps aligned");
+
+TelemetryRecorder::TelemetryRecorder(){
+}
+
+TelemetryRecorder::~TelemetryRecorder(){
+    close();
+}
+
+int TelemetryRecorder::open(const char *path, uint64_t capacity){
+    close();
+    if (capacity == 0){
+        return -1;
+    }
+    size_t size = sizeof(TelemetryFileHeaderTypeDef) + (size_t)capacity * sizeof(TelemetryRecordTypeDef);
+    if (file.create(path, size) < 0){
+        return -1;
+    }
+
+    TelemetryFileHeaderTypeDef *header = (TelemetryFileHeaderTypeDef *)file.data();
+    header->Magic = TELEMETRY_MAGIC;
+    header->Version = TELEMETRY_VERSION;
+    header->RecordSize = sizeof(TelemetryRecordTypeDef);
+    header->Capacity = capacity;
+    header->Count = 0;
+    header->StartTime = HostClockNanoseconds();
+
+    records = (TelemetryRecordTypeDef *)(file.data() + sizeof(TelemetryFileHeaderTypeDef));
+    this->capacity = capacity;
+    next.store(0, std::memory_order_relaxed);
+    droppedRecords.store(0, std::memory_order_relaxed);
+    return 1;
+}
+
+void TelemetryRecorder::close(){
+    if (!file.isOpen()){
+        return;
+    }
+    uint64_t count = recorded();
+    ((TelemetryFileHeaderTypeDef *)file.data())->Count = count;
+    file.close(sizeof(TelemetryFileHeaderTypeDef) + (size_t)count * sizeof(TelemetryRecordTypeDef));
+    records = nullptr;
+    capacity = 0;
+}
+
+bool TelemetryRecorder::isOpen() const{
+    return file.isOpen();
+}
+
+TelemetryRecordTypeDef *TelemetryRecorder::Reserve(){
+    if (records == nullptr){
+        return nullptr;
+    }
+    uint64_t slot = next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= capacity){
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &records[slot];
+}
+
+void TelemetryRecorder::Publish(TelemetryRecordTypeDef *record, TelemetryDirectionEnum direction){
+    // Reader tailing a live log treats a slot as written once Direction is set
+    std::atomic_thread_fence(std::memory_order_release);
+    *(volatile uint8_t *)&record->Direction = (uint8_t)direction;
+}
+
+void TelemetryRecorder::recordState(const TimestampedStateTypeDef *sample){
+    TelemetryRecordTypeDef *record = Reserve();
+    if (record == nullptr){
+        return;
+    }
+    record->Timestamp = sample->Timestamp;
+    memcpy(&record->State, &sample->State, sizeof(DeviceStateTypeDef));
+    Publish(record, TELEMETRY_STATE_IN);
+}
+
+void TelemetryRecorder::recordControl(uint64_t timestamp, const DirectControlTypeDef *control){
+    TelemetryRecordTypeDef *record = Reserve();
+    if (record == nullptr){
+        return;
+    }
+    record->Timestamp = timestamp;
+    memcpy(&record->Control, control, sizeof(DirectControlTypeDef));
+    Publish(record, TELEMETRY_CONTROL_OUT);
+}
+
+uint64_t TelemetryRecorder::recorded() const{
+    uint64_t reserved = next.load(std::memory_order_relaxed);
+    return reserved < capacity ? reserved : capacity;
+}
+
+uint64_t TelemetryRecorder::dropped() const{
+    return droppedRecords.load(std::memory_order_relaxed);
+}
+
+int TelemetryReplay::open(const char *path){
+    close();
+    int opened = file.open(path);
+    if (opened <= 0){
+        return opened;
+    }
+
+    const TelemetryFileHeaderTypeDef *header = (const TelemetryFileHeaderTypeDef *)file.data();
+    if (file.size() < sizeof(TelemetryFileHeaderTypeDef) || header->Magic != TELEMETRY_MAGIC ||
+        header->Version != TELEMETRY_VERSION || header->RecordSize != sizeof(TelemetryRecordTypeDef)){
+        file.close();
+        return -1;
+    }
+
+    records = (const TelemetryRecordTypeDef *)(file.data() + sizeof(TelemetryFileHeaderTypeDef));
+    uint64_t available = (file.size() - sizeof(TelemetryFileHeaderTypeDef)) / sizeof(TelemetryRecordTypeDef);
+    if (header->Count != 0 && header->Count <= available){
+        recordCount = header->Count;
+    } else {
+        // Recorder never closed the log, session ends at first slot nobody wrote
+        recordCount = 0;
+        while (recordCount < available && records[recordCount].Direction != TELEMETRY_NONE){
+            recordCount++;
+        }
+    }
+    start = header->StartTime;
+    return 1;
+}
+
+void TelemetryReplay::close(){
+    file.close();
+    records = nullptr;
+    recordCount = 0;
+    start = 0;
+}
+
+uint64_t TelemetryReplay::count() const{
+    return recordCount;
+}
+
+const TelemetryRecordTypeDef *TelemetryReplay::record(uint64_t index) const{
+    return index < recordCount ? &records[index] : nullptr;
+}
+
+uint64_t TelemetryReplay::startTime() const{
+    return start;
+}
+
+// Waits until record time, scaled by speed, has passed since replay started
+static void WaitForRecord(uint64_t replayStart, uint64_t firstTimestamp, uint64_t timestamp, float speed){
+    if (speed <= 0.0f || timestamp <= firstTimestamp){
+        return;
+    }
+    uint64_t due = replayStart + (uint64_t)((double)(timestamp - firstTimestamp) / speed);
+    uint64_t now;
+    while ((now = HostClockNanoseconds()) < due){
+        if (due - now > REPLAY_SLEEP_MARGIN_NS){
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - REPLAY_SLEEP_MARGIN_NS));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+uint64_t TelemetryReplay::play(float speed, TelemetryCallback callback, void *context) const{
+    if (recordCount == 0 || callback == nullptr){
+        return 0;
+    }
+    uint64_t replayStart = HostClockNanoseconds();
+    uint64_t firstTimestamp = records[0].Timestamp;
+    uint64_t delivered = 0;
+    for (uint64_t i = 0; i < recordCount; i++){
+        WaitForRecord(replayStart, firstTimestamp, records[i].Timestamp, speed);
+        delivered++;
+        if (!callback(context, &records[i])){
+            break;
+        }
+    }
+    return delivered;
+}
+
+typedef struct {
+    EffectEngine *Engine;
+    TelemetryControlCallback Callback;
+    void *Context;
+} EngineReplayTypeDef;
+
+static bool ReplayThroughEngine(void *context, const TelemetryRecordTypeDef *record){
+    EngineReplayTypeDef *replay = (EngineReplayTypeDef *)context;
+    if (record->Direction != TELEMETRY_STATE_IN){
+        return true;
+    }
+
+    TimestampedStateTypeDef sample;
+    sample.Timestamp = record->Timestamp;
+    memcpy(&sample.State, &record->State, sizeof(DeviceStateTypeDef));
+    MotionEstimator *estimator = replay->Engine->getMotionEstimator();
+    estimator->update(&sample);
+
+    MotionStateTypeDef motion;
+    estimator->read(&motion);
+    EffectInputTypeDef input;
+    input.Position = motion.Position;
+    input.Velocity = motion.Velocity;
+    input.Acceleration = motion.Acceleration;
+
+    // Recorded time drives effect timing, so result does not depend on replay speed
+    DirectControlTypeDef control = {};
+    replay->Engine->evaluate(record->Timestamp, &input, &control);
+    if (replay->Callback != nullptr){
+        replay->Callback(replay->Context, record->Timestamp, &control);
+    }
+    return true;
+}
+
+uint64_t TelemetryReplay::playThroughEngine(EffectEngine *engine, float speed, TelemetryControlCallback callback,
+                                            void *context) const{
+    if (engine == nullptr){
+        return 0;
+    }
+    EngineReplayTypeDef replay = {engine, callback, context};
+    return play(speed, ReplayThroughEngine, &replay);
+}
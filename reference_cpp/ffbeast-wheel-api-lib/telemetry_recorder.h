@@ -0,0 +1,115 @@
+#ifndef TELEMETRY_RECORDER_H
+#define TELEMETRY_RECORDER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "mapped_file.h"
+#include "wheel_api.h"
+
+#define TELEMETRY_MAGIC             0x4D4C4546 // "FELM" in file byte order
+#define TELEMETRY_VERSION           1
+#define TELEMETRY_DEFAULT_CAPACITY  (1u << 20) // Records of both directions, about 8.7 minutes of 1 kHz state plus 1 kHz control, 80 MB
+
+class EffectEngine;
+
+typedef enum {
+    TELEMETRY_NONE = 0, // Slot never written, first such slot ends a session that was not closed
+    TELEMETRY_STATE_IN,
+    TELEMETRY_CONTROL_OUT,
+} TelemetryDirectionEnum;
+
+/**
+ * First 64 bytes of a log file. Count is written on close,
+ * a log left behind by a crash has Count 0 and is read up to the first empty slot.
+ * */
+typedef struct {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t RecordSize;
+    uint64_t Capacity;
+    uint64_t Count;
+    uint64_t StartTime; // HostClockNanoseconds when recording started
+    uint8_t _padding[32];
+} TelemetryFileHeaderTypeDef;
+
+/**
+ * One fixed size record, state reports keep the raw 64 byte report so nothing is lost to conversion.
+ * */
+typedef struct {
+    uint64_t Timestamp; // HostClockNanoseconds, report read time for state, send or tick time for control
+    uint8_t Direction; // TelemetryDirectionEnum, written last
+    uint8_t _padding[7];
+    union {
+        DeviceStateTypeDef State;
+        DirectControlTypeDef Control;
+    };
+} TelemetryRecordTypeDef;
+
+/**
+ * Appends records into a preallocated memory mapped file. Recording is a slot reservation with one atomic add
+ * and a copy into the mapping, no system call and no lock, so it is safe from the reader and the scheduler thread
+ * at the same time. When the file is full further records are counted as dropped.
+ * */
+class TelemetryRecorder
+{
+public:
+    TelemetryRecorder();
+    ~TelemetryRecorder();
+
+    // Creates log with room for capacity records, returns 1 or -1
+    int open(const char *path, uint64_t capacity = TELEMETRY_DEFAULT_CAPACITY);
+    // Stores record count and trims unused space. No record call may be running.
+    void close();
+    bool isOpen() const;
+
+    void recordState(const TimestampedStateTypeDef *sample);
+    void recordControl(uint64_t timestamp, const DirectControlTypeDef *control);
+
+    uint64_t recorded() const;
+    uint64_t dropped() const;
+
+private:
+    MappedFile file;
+    TelemetryRecordTypeDef *records = nullptr;
+    uint64_t capacity = 0;
+    std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> droppedRecords{0};
+
+    TelemetryRecordTypeDef *Reserve();
+    static void Publish(TelemetryRecordTypeDef *record, TelemetryDirectionEnum direction);
+};
+
+// Return false to stop replay
+typedef bool (*TelemetryCallback)(void *context, const TelemetryRecordTypeDef *record);
+// Control produced by the engine for a replayed state record
+typedef void (*TelemetryControlCallback)(void *context, uint64_t timestamp, const DirectControlTypeDef *control);
+
+/**
+ * Reads a log back. Records are delivered in slot order, which is the order they were recorded in.
+ * Speed scales the gaps between record timestamps, 1 is original pace, 0 delivers as fast as possible.
+ * */
+class TelemetryReplay
+{
+public:
+    // Returns 1, 0 when file is missing or empty, -1 when it is not a telemetry log
+    int open(const char *path);
+    void close();
+
+    uint64_t count() const;
+    const TelemetryRecordTypeDef *record(uint64_t index) const;
+    uint64_t startTime() const;
+
+    // Returns number of records delivered
+    uint64_t play(float speed, TelemetryCallback callback, void *context) const;
+    // Feeds recorded states through the motion estimator of the engine and evaluates it at every state timestamp,
+    // recorded control records are skipped. Engine must not be ticked by a scheduler at the same time.
+    uint64_t playThroughEngine(EffectEngine *engine, float speed, TelemetryControlCallback callback, void *context) const;
+
+private:
+    MappedFile file;
+    const TelemetryRecordTypeDef *records = nullptr;
+    uint64_t recordCount = 0;
+    uint64_t start = 0;
+};
+
+#endif // TELEMETRY_RECORDER_H
@@ -1,4 +1,14 @@
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
 #include "wheel_api.h"
+#include "host_clock.h"
+#include "settings_fields.h"
+#include "shared_state.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 typedef struct __attribute__((packed)) {
     uint8_t ReportId;
@@ -20,6 +30,11 @@ typedef struct __attribute__((packed)) {
     GpioExtensionSettingsTypeDef gpioExtensionSettings;
 } GpioExtensionSettingsReportTypeDef;
 
+typedef struct __attribute__((packed)) {
+    uint8_t ReportId;
+    FirmwareLicenseTypeDef firmwareLicense;
+} FirmwareLicenseReportTypeDef;
+
 typedef struct __attribute__((packed)) {
     uint8_t ReportId;
     DeviceStateTypeDef state;
@@ -29,34 +44,139 @@ WheelApi::WheelApi() {
     hid_init();
 }
 
+WheelApi::~WheelApi() {
+    disconnect();
+    // Buffers owned by the device were released by hid_close, the pool keeps the rest
+    for (int i = 0; i < STATE_VIEW_POOL_SIZE; ++i) {
+        free(viewBuffers[i]);
+    }
+}
+
+StateView::~StateView() {
+    reset();
+}
+
+StateView::StateView(StateView &&other)
+    : owner(other.owner), slot(other.slot), report(other.report), receivedAt(other.receivedAt) {
+    other.owner = nullptr;
+    other.slot = -1;
+    other.report = nullptr;
+}
+
+StateView &StateView::operator=(StateView &&other){
+    if (this != &other){
+        reset();
+        owner = other.owner;
+        slot = other.slot;
+        report = other.report;
+        receivedAt = other.receivedAt;
+        other.owner = nullptr;
+        other.slot = -1;
+        other.report = nullptr;
+    }
+    return *this;
+}
+
+bool StateView::isValid() const{
+    return report != nullptr;
+}
+
+const DeviceStateTypeDef &StateView::state() const{
+    return *report;
+}
+
+uint64_t StateView::timestamp() const{
+    return receivedAt;
+}
+
+void StateView::reset(){
+    if (owner != nullptr){
+        owner->ReleaseViewBuffer(slot);
+    }
+    owner = nullptr;
+    slot = -1;
+    report = nullptr;
+}
+
 int WheelApi::connect(){
+    if (handle != nullptr){
+        // Opening again would leak the handle and its read buffers
+        return 1;
+    }
     int result = 0;
-    struct hid_device_info *devs, *cur_dev;
-    const char *path_to_open = nullptr;
-    devs = hid_enumerate(USB_VID, WHEEL_PID_FS);
-    cur_dev = devs;
-    while (cur_dev) {
-        if (cur_dev->interface_number == 0){ //Vendor interface is 0
-            path_to_open = cur_dev->path;
-            break;
+    // Path of the last opened device is tried first, it avoids enumeration entirely on reconnect
+    if (!devicePath.empty()) {
+        handle = hid_open_path(devicePath.c_str());
+    }
+    if (handle == nullptr) {
+        struct hid_device_info *devs, *cur_dev;
+        devs = hid_enumerate_usb_interface(USB_VID, WHEEL_PID_FS, INTERFACE_VENDOR);
+        cur_dev = devs;
+        while (cur_dev) {
+            if (cur_dev->interface_number == 0){ //Vendor interface is 0
+                handle = hid_open_path(cur_dev->path);
+                if (handle != nullptr) {
+                    devicePath = cur_dev->path;
+                    break;
+                }
+            }
+            cur_dev = cur_dev->next;
         }
-        cur_dev = cur_dev->next;
+        hid_free_enumeration(devs);
     }
-    if (path_to_open) {
-        handle = hid_open_path(path_to_open);
+    if (handle != nullptr) {
         result = 1;
+        ApplyInputBufferCount();
+        refreshSettingsCache();
     }
-    hid_free_enumeration(devs);
     return result;
 }
 
+int WheelApi::connectPath(const char *path){
+    disconnect();
+    handle = hid_open_path(path);
+    if (handle == nullptr) {
+        return 0;
+    }
+    devicePath = path;
+    ApplyInputBufferCount();
+    refreshSettingsCache();
+    return 1;
+}
+
+void WheelApi::disconnect(){
+    stopStateReader();
+    if (handle != nullptr){
+        hid_close(handle);
+        handle = nullptr;
+    }
+    invalidateSettingsCache();
+}
+
+bool WheelApi::isConnected() const{
+    return handle != nullptr;
+}
+
+const char *WheelApi::getDevicePath() const{
+    return devicePath.c_str();
+}
+
+hid_device *WheelApi::getHandle() const{
+    return handle;
+}
+
 int WheelApi::saveAndReboot(){
     if (handle != nullptr){
         HidInOutReportTypeDef genericReport = {};
         genericReport.ReportId = REPORT_GENERIC_INPUT_OUTPUT;
         DataReportTypeDef *data = (DataReportTypeDef*)&genericReport.Buffer;
         data->ReportData = DATA_COMMAND_SAVE_SETTINGS;
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            // Device reloads settings from flash after reboot
+            invalidateSettingsCache();
+        }
+        return result;
     }
     return 0;
 }
@@ -67,7 +187,12 @@ int WheelApi::rebootController(){
         genericReport.ReportId = REPORT_GENERIC_INPUT_OUTPUT;
         DataReportTypeDef *data = (DataReportTypeDef*)&genericReport.Buffer;
         data->ReportData = DATA_COMMAND_REBOOT;
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            // Device reloads settings from flash after reboot
+            invalidateSettingsCache();
+        }
+        return result;
     }
     return 0;
 }
@@ -78,7 +203,12 @@ int WheelApi::switchtoDfu(){
         genericReport.ReportId = REPORT_GENERIC_INPUT_OUTPUT;
         DataReportTypeDef *data = (DataReportTypeDef*)&genericReport.Buffer;
         data->ReportData = DATA_COMMAND_DFU_MODE;
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            // Device reloads settings from flash after reboot
+            invalidateSettingsCache();
+        }
+        return result;
     }
     return 0;
 }
@@ -102,6 +232,9 @@ int WheelApi::readEffectSettings(EffectSettingsTypeDef *destination){
         result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(EffectSettingsReportTypeDef));
         if (result > 0) {
             memcpy(destination, &report.effectSettings, sizeof(EffectSettingsTypeDef));
+            memcpy(&settingsCache.Effect, &report.effectSettings, sizeof(EffectSettingsTypeDef));
+            settingsCacheValid |= SETTINGS_CACHE_EFFECT;
+            PublishSettingsCache();
         }
     }
     return result;
@@ -112,9 +245,12 @@ int WheelApi::readHardwareSettings(HardwareSettingsTypeDef *destination){
     if (handle != nullptr){
         HardwareSettingsReportTypeDef report;
         report.ReportId = REPORT_HARDWARE_SETTINGS_FEATURE;
-        int result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(HardwareSettingsReportTypeDef));
+        result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(HardwareSettingsReportTypeDef));
         if (result > 0) {
             memcpy(destination, &report.hardwareSettings, sizeof(HardwareSettingsTypeDef));
+            memcpy(&settingsCache.Hardware, &report.hardwareSettings, sizeof(HardwareSettingsTypeDef));
+            settingsCacheValid |= SETTINGS_CACHE_HARDWARE;
+            PublishSettingsCache();
         }
     }
     return result;
@@ -125,9 +261,12 @@ int WheelApi::readGpioExtensionSettings(GpioExtensionSettingsTypeDef *destinatio
     if (handle != nullptr){
         GpioExtensionSettingsReportTypeDef report;
         report.ReportId = REPORT_GPIO_SETTINGS_FEATURE;
-        int result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(GpioExtensionSettingsReportTypeDef));
+        result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(GpioExtensionSettingsReportTypeDef));
         if (result > 0) {
             memcpy(destination, &report.gpioExtensionSettings, sizeof(GpioExtensionSettingsTypeDef));
+            memcpy(&settingsCache.Gpio, &report.gpioExtensionSettings, sizeof(GpioExtensionSettingsTypeDef));
+            settingsCacheValid |= SETTINGS_CACHE_GPIO;
+            PublishSettingsCache();
         }
     }
     return result;
@@ -138,43 +277,534 @@ int WheelApi::readAdcExtensionSettings(AdcExtensionSettingsTypeDef *destination)
     if (handle != nullptr){
         AdcExtensionSettingsReportTypeDef report;
         report.ReportId = REPORT_ADC_SETTINGS_FEATURE;
-        int result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(AdcExtensionSettingsReportTypeDef));
+        result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(AdcExtensionSettingsReportTypeDef));
         if (result > 0) {
             memcpy(destination, &report.adcExtensionSettings, sizeof(AdcExtensionSettingsTypeDef));
+            memcpy(&settingsCache.Adc, &report.adcExtensionSettings, sizeof(AdcExtensionSettingsTypeDef));
+            settingsCacheValid |= SETTINGS_CACHE_ADC;
+            PublishSettingsCache();
+        }
+    }
+    return result;
+}
+
+int WheelApi::readFirmwareLicense(FirmwareLicenseTypeDef *destination){
+    int result = 0;
+    if (handle != nullptr){
+        FirmwareLicenseReportTypeDef report;
+        report.ReportId = REPORT_FIRMWARE_LICENSE_FEATURE;
+        result = hid_get_feature_report(handle, (unsigned char*)&report, sizeof(FirmwareLicenseReportTypeDef));
+        if (result > 0) {
+            memcpy(destination, &report.firmwareLicense, sizeof(FirmwareLicenseTypeDef));
         }
     }
     return result;
 }
 
+int WheelApi::readAllSettings(DeviceSettingsTypeDef *destination, FirmwareLicenseTypeDef *license){
+    if (handle == nullptr){
+        return 0;
+    }
+    EffectSettingsReportTypeDef effectReport;
+    HardwareSettingsReportTypeDef hardwareReport;
+    GpioExtensionSettingsReportTypeDef gpioReport;
+    AdcExtensionSettingsReportTypeDef adcReport;
+    FirmwareLicenseReportTypeDef licenseReport;
+    effectReport.ReportId = REPORT_EFFECT_SETTINGS_FEATURE;
+    hardwareReport.ReportId = REPORT_HARDWARE_SETTINGS_FEATURE;
+    gpioReport.ReportId = REPORT_GPIO_SETTINGS_FEATURE;
+    adcReport.ReportId = REPORT_ADC_SETTINGS_FEATURE;
+    licenseReport.ReportId = REPORT_FIRMWARE_LICENSE_FEATURE;
+
+    unsigned char *buffers[] = {
+        (unsigned char*)&effectReport, (unsigned char*)&hardwareReport,
+        (unsigned char*)&gpioReport, (unsigned char*)&adcReport, (unsigned char*)&licenseReport
+    };
+    const size_t lengths[] = {
+        sizeof(effectReport), sizeof(hardwareReport), sizeof(gpioReport), sizeof(adcReport), sizeof(licenseReport)
+    };
+    int results[5];
+    size_t count = license != nullptr ? 5 : 4;
+
+    // All requests are in flight together instead of one control transfer round trip each
+    if (hid_get_feature_reports(handle, buffers, lengths, results, count) < (int) count){
+        return 0;
+    }
+
+    memcpy(&destination->Effect, &effectReport.effectSettings, sizeof(EffectSettingsTypeDef));
+    memcpy(&destination->Hardware, &hardwareReport.hardwareSettings, sizeof(HardwareSettingsTypeDef));
+    memcpy(&destination->Gpio, &gpioReport.gpioExtensionSettings, sizeof(GpioExtensionSettingsTypeDef));
+    memcpy(&destination->Adc, &adcReport.adcExtensionSettings, sizeof(AdcExtensionSettingsTypeDef));
+    if (license != nullptr){
+        memcpy(license, &licenseReport.firmwareLicense, sizeof(FirmwareLicenseTypeDef));
+    }
+
+    memcpy(&settingsCache, destination, sizeof(DeviceSettingsTypeDef));
+    settingsCacheValid = SETTINGS_CACHE_ALL;
+    PublishSettingsCache();
+    return 1;
+}
+
+int WheelApi::refreshSettingsCache(){
+    DeviceSettingsTypeDef settings;
+    invalidateSettingsCache();
+    return readAllSettings(&settings);
+}
+
+void WheelApi::invalidateSettingsCache(){
+    settingsCacheValid = 0;
+    PublishSettingsCache();
+}
+
+bool WheelApi::isSettingsCacheValid() const{
+    return settingsCacheValid == SETTINGS_CACHE_ALL;
+}
+
+int WheelApi::readCachedSettings(DeviceSettingsTypeDef *destination){
+    if (!isSettingsCacheValid()){
+        return 0;
+    }
+    memcpy(destination, &settingsCache, sizeof(DeviceSettingsTypeDef));
+    return 1;
+}
+
+int WheelApi::readCachedEffectSettings(EffectSettingsTypeDef *destination){
+    if (!(settingsCacheValid & SETTINGS_CACHE_EFFECT)){
+        return 0;
+    }
+    memcpy(destination, &settingsCache.Effect, sizeof(EffectSettingsTypeDef));
+    return 1;
+}
+
+int WheelApi::readCachedHardwareSettings(HardwareSettingsTypeDef *destination){
+    if (!(settingsCacheValid & SETTINGS_CACHE_HARDWARE)){
+        return 0;
+    }
+    memcpy(destination, &settingsCache.Hardware, sizeof(HardwareSettingsTypeDef));
+    return 1;
+}
+
+int WheelApi::readCachedGpioExtensionSettings(GpioExtensionSettingsTypeDef *destination){
+    if (!(settingsCacheValid & SETTINGS_CACHE_GPIO)){
+        return 0;
+    }
+    memcpy(destination, &settingsCache.Gpio, sizeof(GpioExtensionSettingsTypeDef));
+    return 1;
+}
+
+int WheelApi::readCachedAdcExtensionSettings(AdcExtensionSettingsTypeDef *destination){
+    if (!(settingsCacheValid & SETTINGS_CACHE_ADC)){
+        return 0;
+    }
+    memcpy(destination, &settingsCache.Adc, sizeof(AdcExtensionSettingsTypeDef));
+    return 1;
+}
+
+void WheelApi::UpdateSettingsCache(SettingsFieldEnum field, uint8_t index, int32_t value){
+    const SettingsFieldInfoTypeDef *info = FindSettingsField(field);
+    if (info != nullptr){
+        // Write only fields and out of range indexes are simply not cached
+        WriteSettingsFieldValue(&settingsCache, info, index, value);
+        PublishSettingsCache();
+    }
+}
+
+void WheelApi::PublishSettingsCache(){
+    SharedStatePublisher *publisher = sharedPublisher.load(std::memory_order_acquire);
+    if (publisher != nullptr){
+        publisher->publishSettings(settingsCache, settingsCacheValid);
+    }
+}
+
+// Synchronous reads bypass the snapshot, they publish here
+void WheelApi::PublishState(const DeviceStateTypeDef *state, uint64_t timestamp){
+    SharedStatePublisher *publisher = sharedPublisher.load(std::memory_order_acquire);
+    if (publisher != nullptr){
+        TimestampedStateTypeDef sample;
+        sample.Timestamp = timestamp;
+        memcpy(&sample.State, state, sizeof(DeviceStateTypeDef));
+        publisher->publishState(sample);
+    }
+}
+
+void WheelApi::setSharedPublisher(SharedStatePublisher *publisher){
+    sharedPublisher.store(publisher, std::memory_order_release);
+    // New segment starts with whatever is known right now
+    PublishSettingsCache();
+    // State has a single writer, the thread owning reads. A running reader fills it with its next report.
+    bool readerOwned = stateReaderRunning.load(std::memory_order_acquire) || externalStateReader.load(std::memory_order_acquire);
+    TimestampedStateTypeDef sample;
+    if (publisher != nullptr && !readerOwned && stateSnapshot.load(&sample) != 0){
+        publisher->publishState(sample);
+    }
+}
+
 int WheelApi::readState(DeviceStateTypeDef *destination){
+    if (stateReaderRunning.load(std::memory_order_acquire) || externalStateReader.load(std::memory_order_acquire)){
+        // Background reader owns the pending read, serve latest published state instead
+        TimestampedStateTypeDef snapshot;
+        if (ReadNewSnapshot(&snapshot) == 0){
+            return 0;
+        }
+        memcpy(destination, &snapshot.State, sizeof(DeviceStateTypeDef));
+        return (int) sizeof(StateReportTypeDef);
+    }
     if (handle != nullptr){
         StateReportTypeDef report;
-        int result = hid_read_timeout(handle, (unsigned char*)&report, 65, 100);
+        int result = hid_read_timeout(handle, (unsigned char*)&report, 65, stateReadTimeout());
+        uint64_t now = HostClockNanoseconds();
+        ObserveReports(result > 0 ? 1 : result, now);
         if (result > 0) {
             memcpy(destination, &report.state, sizeof(DeviceStateTypeDef));
+            PublishState(&report.state, now);
         }
         return result;
     }
     return 0;
 }
 
+int WheelApi::setInputBufferCount(int count){
+    if (count <= 0){
+        return -1;
+    }
+    if (handle == nullptr){
+        inputBufferCount = count;
+        inputBufferCountApplied = false;
+        return 0;
+    }
+    if (hid_set_num_input_buffers(handle, count) < 0){
+        return -1;
+    }
+    inputBufferCount = count;
+    inputBufferCountApplied = true;
+    return 1;
+}
+
+bool WheelApi::isInputBufferCountApplied() const{
+    return inputBufferCountApplied;
+}
+
+void WheelApi::ApplyInputBufferCount(){
+    // Connection stays usable with the driver default depth, failure is only recorded
+    inputBufferCountApplied = hid_set_num_input_buffers(handle, inputBufferCount) >= 0;
+}
+
+int WheelApi::readLatestState(DeviceStateTypeDef *destination, int *discarded){
+    int skipped = 0;
+    int result = 0;
+    if (stateReaderRunning.load(std::memory_order_acquire) || externalStateReader.load(std::memory_order_acquire)){
+        // Snapshot is the newest report already
+        TimestampedStateTypeDef snapshot;
+        if (ReadNewSnapshot(&snapshot) > 0){
+            memcpy(destination, &snapshot.State, sizeof(DeviceStateTypeDef));
+            result = (int) sizeof(StateReportTypeDef);
+        }
+    } else if (handle != nullptr) {
+        StateReportTypeDef report;
+        result = hid_read_timeout(handle, (unsigned char*)&report, 65, stateReadTimeout());
+        while (result > 0) {
+            memcpy(destination, &report.state, sizeof(DeviceStateTypeDef));
+            int next = hid_read_timeout(handle, (unsigned char*)&report, 65, 0);
+            if (next <= 0) {
+                break;
+            }
+            result = next;
+            skipped++;
+        }
+        uint64_t now = HostClockNanoseconds();
+        ObserveReports(result > 0 ? skipped + 1 : result, now);
+        if (result > 0) {
+            PublishState(destination, now);
+        }
+    }
+    if (discarded != nullptr){
+        *discarded = skipped;
+    }
+    return result;
+}
+
+int WheelApi::readStateView(StateView *view){
+    view->reset();
+    bool readerOwned = stateReaderRunning.load(std::memory_order_acquire) || externalStateReader.load(std::memory_order_acquire);
+    if (!readerOwned && handle == nullptr){
+        return 0;
+    }
+    int slot = AcquireViewBuffer();
+    if (slot < 0){
+        return -1;
+    }
+    int result;
+    if (readerOwned){
+        TimestampedStateTypeDef snapshot;
+        if (ReadNewSnapshot(&snapshot) == 0){
+            ReleaseViewBuffer(slot);
+            return 0;
+        }
+        StateReportTypeDef *report = (StateReportTypeDef*)viewBuffers[slot];
+        report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
+        memcpy(&report->state, &snapshot.State, sizeof(DeviceStateTypeDef));
+        view->receivedAt = snapshot.Timestamp;
+        result = (int) sizeof(StateReportTypeDef);
+    } else {
+        // Filled receive buffer of the driver comes back, the pooled one is used for the next read
+        result = hid_read_timeout_swap(handle, &viewBuffers[slot], sizeof(StateReportTypeDef), stateReadTimeout());
+        uint64_t now = HostClockNanoseconds();
+        ObserveReports(result > 0 ? 1 : result, now);
+        if (result <= 0){
+            ReleaseViewBuffer(slot);
+            return result;
+        }
+        view->receivedAt = now;
+        PublishState(&((const StateReportTypeDef*)viewBuffers[slot])->state, view->receivedAt);
+    }
+    view->owner = this;
+    view->slot = slot;
+    view->report = &((const StateReportTypeDef*)viewBuffers[slot])->state;
+    return result;
+}
+
+int WheelApi::AcquireViewBuffer(){
+    uint32_t mask = viewBuffersFree.load(std::memory_order_acquire);
+    while (mask != 0){
+        int slot = 0;
+        while (!(mask & (1u << slot))){
+            slot++;
+        }
+        if (viewBuffersFree.compare_exchange_weak(mask, mask & ~(1u << slot), std::memory_order_acquire)){
+            if (viewBuffers[slot] == nullptr){
+                viewBuffers[slot] = (unsigned char*) malloc(sizeof(StateReportTypeDef));
+                if (viewBuffers[slot] == nullptr){
+                    ReleaseViewBuffer(slot);
+                    return -1;
+                }
+            }
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void WheelApi::ReleaseViewBuffer(int slot){
+    viewBuffersFree.fetch_or(1u << slot, std::memory_order_release);
+}
+
+int WheelApi::startStateReader(){
+    if (handle == nullptr){
+        return 0;
+    }
+    if (stateReaderRunning.load(std::memory_order_acquire)){
+        return 1;
+    }
+    stateReaderRunning.store(true, std::memory_order_release);
+    stateReader = std::thread(&WheelApi::StateReaderLoop, this);
+#ifdef _WIN32
+    SetThreadPriority((HANDLE) stateReader.native_handle(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+    return 1;
+}
+
+void WheelApi::stopStateReader(){
+    stateReaderRunning.store(false, std::memory_order_release);
+    if (stateReader.joinable()){
+        // Reader wakes up at least once per read timeout, STATE_READ_IDLE_TIMEOUT_MS at worst when adaptive
+        stateReader.join();
+    }
+}
+
+bool WheelApi::isStateReaderRunning() const{
+    return stateReaderRunning.load(std::memory_order_acquire);
+}
+
+int WheelApi::readStateSnapshot(DeviceStateTypeDef *destination, uint64_t *sequence){
+    TimestampedStateTypeDef snapshot;
+    int result = readStateSnapshot(&snapshot, sequence);
+    if (result > 0) {
+        memcpy(destination, &snapshot.State, sizeof(DeviceStateTypeDef));
+    }
+    return result;
+}
+
+int WheelApi::readStateSnapshot(TimestampedStateTypeDef *destination, uint64_t *sequence){
+    uint64_t published = stateSnapshot.load(destination);
+    if (sequence != nullptr){
+        *sequence = published;
+    }
+    return published > 0 ? 1 : 0;
+}
+
+int WheelApi::ReadNewSnapshot(TimestampedStateTypeDef *destination){
+    uint64_t sequence = 0;
+    if (readStateSnapshot(destination, &sequence) == 0 || sequence == lastReadSequence){
+        return 0;
+    }
+    lastReadSequence = sequence;
+    return 1;
+}
+
+int WheelApi::drainStates(TimestampedStateTypeDef *destination, int capacity){
+    if (capacity <= 0){
+        return 0;
+    }
+    return (int) stateRing.drain(destination, (size_t) capacity);
+}
+
+uint64_t WheelApi::droppedStates() const{
+    return stateRingDrops.load(std::memory_order_relaxed);
+}
+
+int WheelApi::readStats(WheelApiStatsTypeDef *destination) const{
+    TimestampedStateTypeDef newest;
+    destination->StateReports = stateSnapshot.load(&newest) - stateReportsBase.load(std::memory_order_relaxed);
+    destination->DroppedStates = stateRingDrops.load(std::memory_order_relaxed);
+    if (handle == nullptr || hid_get_stats(handle, &destination->Hid) < 0){
+        memset(&destination->Hid, 0, sizeof(destination->Hid));
+        return 0;
+    }
+    return 1;
+}
+
+void WheelApi::resetStats(){
+    TimestampedStateTypeDef newest;
+    stateReportsBase.store(stateSnapshot.load(&newest), std::memory_order_relaxed);
+    stateRingDrops.store(0, std::memory_order_relaxed);
+    if (handle != nullptr){
+        hid_reset_stats(handle);
+    }
+}
+
+void WheelApi::setExternalStateReader(bool enabled){
+    externalStateReader.store(enabled, std::memory_order_release);
+}
+
+int WheelApi::pumpState(int milliseconds){
+    if (handle == nullptr){
+        return 0;
+    }
+    StateReportTypeDef report;
+    int result = hid_read_timeout(handle, (unsigned char*)&report, 65, milliseconds);
+    uint64_t now = HostClockNanoseconds();
+    ObserveReports(result > 0 ? 1 : result, now);
+    if (result > 0) {
+        TimestampedStateTypeDef sample;
+        sample.Timestamp = now;
+        sample.State = report.state;
+        stateSnapshot.store(sample);
+        if (!stateRing.push(sample)){
+            stateRingDrops.fetch_add(1, std::memory_order_relaxed);
+        }
+        SharedStatePublisher *publisher = sharedPublisher.load(std::memory_order_acquire);
+        if (publisher != nullptr){
+            publisher->publishState(sample);
+        }
+    }
+    return result;
+}
+
+int WheelApi::setStateReadTimeout(int milliseconds){
+    if (milliseconds < 0 && milliseconds != STATE_READ_TIMEOUT_ADAPTIVE){
+        return 0;
+    }
+    stateReadTimeoutMs.store(milliseconds, std::memory_order_relaxed);
+    return 1;
+}
+
+int WheelApi::stateReadTimeout() const{
+    int milliseconds = stateReadTimeoutMs.load(std::memory_order_relaxed);
+    return milliseconds == STATE_READ_TIMEOUT_ADAPTIVE ? adaptiveTimeoutMs.load(std::memory_order_relaxed) : milliseconds;
+}
+
+uint64_t WheelApi::reportIntervalNs() const{
+    return reportInterval.load(std::memory_order_relaxed);
+}
+
+int WheelApi::getStateWaitHandle(hid_wait_handle *waitHandle){
+    if (handle == nullptr){
+        return 0;
+    }
+    if (stateReaderRunning.load(std::memory_order_acquire)){
+        return -1;
+    }
+    return hid_get_read_wait_handle(handle, waitHandle) < 0 ? -1 : 1;
+}
+
+// Called after every read with number of reports it returned, keeps interval and adaptive wait up to date
+void WheelApi::ObserveReports(int reports, uint64_t now){
+    if (reports < 0){
+        return;
+    }
+    int wait = adaptiveTimeoutMs.load(std::memory_order_relaxed);
+    if (reports == 0){
+        wait = wait * 2 < STATE_READ_IDLE_TIMEOUT_MS ? wait * 2 : STATE_READ_IDLE_TIMEOUT_MS;
+        adaptiveTimeoutMs.store(wait, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t interval = reportInterval.load(std::memory_order_relaxed);
+    // Longer gaps are pauses, not the rate the device reports at
+    if (lastReportTime != 0 && now - lastReportTime < (uint64_t) STATE_READ_IDLE_TIMEOUT_MS * 1000000ULL){
+        // Reports drained together share the elapsed time, so a catching up reader keeps the true mean
+        int64_t sample = (int64_t) ((now - lastReportTime) / (uint64_t) reports);
+        interval = (uint64_t) ((int64_t) interval + (sample - (int64_t) interval) / 8);
+        reportInterval.store(interval, std::memory_order_relaxed);
+    }
+    lastReportTime = now;
+    uint64_t stall = (interval * STATE_READ_STALL_INTERVALS + 999999ULL) / 1000000ULL;
+    wait = stall < STATE_READ_TIMEOUT_MIN_MS ? STATE_READ_TIMEOUT_MIN_MS
+         : (stall > STATE_READ_TIMEOUT_MS ? STATE_READ_TIMEOUT_MS : (int) stall);
+    adaptiveTimeoutMs.store(wait, std::memory_order_relaxed);
+}
+
+void WheelApi::StateReaderLoop(){
+    while (stateReaderRunning.load(std::memory_order_acquire)){
+        int result = pumpState(stateReadTimeout());
+        if (result < 0) {
+            // Device is gone or failing, do not spin on the error
+            std::this_thread::sleep_for(std::chrono::milliseconds(STATE_READ_TIMEOUT_MS));
+        }
+    }
+}
+
 int WheelApi::sendDirectControl(DirectControlTypeDef control){
     if (handle != nullptr){
         HidInOutReportTypeDef report = {};
-        report.ReportId = REPORT_GENERIC_INPUT_OUTPUT;
-        DataReportTypeDef *genericData = (DataReportTypeDef *) &report.Buffer;
-        genericData->ReportData = DATA_OVERRIDE_DATA;
-        memcpy(genericData->Buffer,&control,sizeof(DirectControlTypeDef));
+        CreateDirectControlReport(&report, control);
         return hid_write(handle, (const unsigned char *) &report, 65);
     }
     return 0;
 }
 
+int WheelApi::sendDirectControlAsync(DirectControlTypeDef control, hid_write_callback callback, void *context){
+    if (handle != nullptr){
+        HidInOutReportTypeDef report = {};
+        CreateDirectControlReport(&report, control);
+        return hid_write_async(handle, (const unsigned char *) &report, 65, callback, context);
+    }
+    return 0;
+}
+
+int WheelApi::completeWrites(int milliseconds){
+    if (handle != nullptr){
+        return hid_write_complete(handle, milliseconds);
+    }
+    return 0;
+}
+
+bool WheelApi::claimAsyncWrites(){
+    return !asyncWritesClaimed.exchange(true, std::memory_order_acquire);
+}
+
+void WheelApi::releaseAsyncWrites(){
+    asyncWritesClaimed.store(false, std::memory_order_release);
+}
+
 int WheelApi::sendInt8SettingReport(SettingsFieldEnum field, int8_t index, int8_t data){
     if (handle != nullptr){
         HidInOutReportTypeDef genericReport = {};
-        CreateInt8SettingsReport(&genericReport, field, index, data);
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        CreateSettingsReport(&genericReport, field, index, data);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            UpdateSettingsCache(field, (uint8_t) index, data);
+        }
+        return result;
     }
     return 0;
 }
@@ -182,8 +812,12 @@ int WheelApi::sendInt8SettingReport(SettingsFieldEnum field, int8_t index, int8_
 int WheelApi::sendInt16SettingReport(SettingsFieldEnum field, int8_t index, int16_t data){
     if (handle != nullptr){
         HidInOutReportTypeDef genericReport = {};
-        CreateUInt16SettingsReport(&genericReport, field, index, data);
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        CreateSettingsReport(&genericReport, field, index, data);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            UpdateSettingsCache(field, (uint8_t) index, data);
+        }
+        return result;
     }
     return 0;
 }
@@ -191,8 +825,12 @@ int WheelApi::sendInt16SettingReport(SettingsFieldEnum field, int8_t index, int1
 int WheelApi::sendUInt8SettingReport(SettingsFieldEnum field, int8_t index, uint8_t data){
     if (handle != nullptr){
         HidInOutReportTypeDef genericReport = {};
-        CreateUInt8SettingsReport(&genericReport, field, index, data);
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        CreateSettingsReport(&genericReport, field, index, data);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            UpdateSettingsCache(field, (uint8_t) index, data);
+        }
+        return result;
     }
     return 0;
 }
@@ -200,8 +838,12 @@ int WheelApi::sendUInt8SettingReport(SettingsFieldEnum field, int8_t index, uint
 int WheelApi::sendUInt16SettingReport(SettingsFieldEnum field, int8_t index, uint16_t data){
     if (handle != nullptr){
         HidInOutReportTypeDef genericReport = {};
-        CreateUInt16SettingsReport(&genericReport, field, index, data);
-        return hid_write(handle, (const unsigned char *) &genericReport, 65);
+        CreateSettingsReport(&genericReport, field, index, data);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            UpdateSettingsCache(field, (uint8_t) index, data);
+        }
+        return result;
     }
     return 0;
 }
@@ -209,68 +851,67 @@ int WheelApi::sendUInt16SettingReport(SettingsFieldEnum field, int8_t index, uin
 int WheelApi::sendFloatSettingReport(SettingsFieldEnum field, int8_t index, float data){
     if (handle != nullptr){
         HidInOutReportTypeDef genericReport = {};
-        CreateFloatSettingsReport(&genericReport, field, index, data);
+        CreateSettingsReport(&genericReport, field, index, data);
         return hid_write(handle, (const unsigned char *) &genericReport, 65);
     }
     return 0;
 }
 
-void WheelApi::CreateInt8SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, int8_t value) {
-    report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
-    DataReportTypeDef *genericData = (DataReportTypeDef *) &report->Buffer;
-    genericData->ReportData = DATA_SETTINGS_FIELD_DATA;
-    FieldDataTypeDef *settingsFieldData = (FieldDataTypeDef *) &genericData->Buffer;
-    settingsFieldData->FieldId = fieldId;
-    FieldValueTypeDef *settingsField = &settingsFieldData->Value;
-    settingsField->Index = index;
-    Int8ValueWrapperTypeDef *valueWrapper = (Int8ValueWrapperTypeDef *) &settingsField->Buffer;
-    valueWrapper->Value = value;
+int WheelApi::sendSettingReport(SettingsFieldEnum field, uint8_t index, int32_t value){
+    const SettingsFieldInfoTypeDef *info = FindSettingsField(field);
+    if (handle != nullptr && info != nullptr && index < info->Count){
+        HidInOutReportTypeDef genericReport;
+        EncodeSettingsReport(&genericReport, info, index, value);
+        int result = hid_write(handle, (const unsigned char *) &genericReport, 65);
+        if (result > 0) {
+            UpdateSettingsCache(field, index, value);
+        }
+        return result;
+    }
+    return 0;
 }
 
-void WheelApi::CreateInt16SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, int16_t value) {
-    report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
-    DataReportTypeDef *genericData = (DataReportTypeDef *) &report->Buffer;
-    genericData->ReportData = DATA_SETTINGS_FIELD_DATA;
-    FieldDataTypeDef *settingsFieldData = (FieldDataTypeDef *) &genericData->Buffer;
-    settingsFieldData->FieldId = fieldId;
-    FieldValueTypeDef *settingsField = &settingsFieldData->Value;
-    settingsField->Index = index;
-    Int16ValueWrapperTypeDef *valueWrapper = (Int16ValueWrapperTypeDef *) &settingsField->Buffer;
-    valueWrapper->Value = value;
+int WheelApi::sendSettingAsync(SettingsFieldEnum field, uint8_t index, int32_t value, hid_write_callback callback, void *context){
+    const SettingsFieldInfoTypeDef *info = FindSettingsField(field);
+    if (handle != nullptr && info != nullptr && index < info->Count){
+        HidInOutReportTypeDef genericReport;
+        EncodeSettingsReport(&genericReport, info, index, value);
+        int result = hid_write_async(handle, (const unsigned char *) &genericReport, 65, callback, context);
+        if (result > 0) {
+            // Optimistic, caller learns about failed transfer from callback and should invalidate the cache
+            UpdateSettingsCache(field, index, value);
+        }
+        return result;
+    }
+    return 0;
 }
 
-void WheelApi::CreateUInt8SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, uint8_t value) {
-    report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
-    DataReportTypeDef *genericData = (DataReportTypeDef *) &report->Buffer;
-    genericData->ReportData = DATA_SETTINGS_FIELD_DATA;
-    FieldDataTypeDef *settingsFieldData = (FieldDataTypeDef *) &genericData->Buffer;
-    settingsFieldData->FieldId = fieldId;
-    FieldValueTypeDef *settingsField = &settingsFieldData->Value;
-    settingsField->Index = index;
-    UInt8ValueWrapperTypeDef *valueWrapper = (UInt8ValueWrapperTypeDef *) &settingsField->Buffer;
-    valueWrapper->Value = value;
+int WheelApi::sendSettingFrameAsync(const HidInOutReportTypeDef *frame, SettingsFieldEnum field, uint8_t index, int32_t value,
+                                    hid_write_callback callback, void *context){
+    if (handle == nullptr){
+        return 0;
+    }
+    int result = hid_write_async(handle, (const unsigned char *) frame, sizeof(HidInOutReportTypeDef), callback, context);
+    if (result > 0) {
+        UpdateSettingsCache(field, index, value);
+    }
+    return result;
 }
 
-void WheelApi::CreateUInt16SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, uint16_t value) {
-    report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
-    DataReportTypeDef *genericData = (DataReportTypeDef *) &report->Buffer;
-    genericData->ReportData = DATA_SETTINGS_FIELD_DATA;
-    FieldDataTypeDef *settingsFieldData = (FieldDataTypeDef *) &genericData->Buffer;
-    settingsFieldData->FieldId = fieldId;
-    FieldValueTypeDef *settingsField = &settingsFieldData->Value;
-    settingsField->Index = index;
-    UInt16ValueWrapperTypeDef *valueWrapper = (UInt16ValueWrapperTypeDef *) &settingsField->Buffer;
-    valueWrapper->Value = value;
+int WheelApi::sendSettingFrame(const HidInOutReportTypeDef *frame, SettingsFieldEnum field, uint8_t index, int32_t value){
+    if (handle == nullptr){
+        return 0;
+    }
+    int result = hid_write(handle, (const unsigned char *) frame, sizeof(HidInOutReportTypeDef));
+    if (result > 0) {
+        UpdateSettingsCache(field, index, value);
+    }
+    return result;
 }
 
-void WheelApi::CreateFloatSettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, float value) {
+void WheelApi::CreateDirectControlReport(HidInOutReportTypeDef *report, DirectControlTypeDef control) {
     report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
     DataReportTypeDef *genericData = (DataReportTypeDef *) &report->Buffer;
-    genericData->ReportData = DATA_SETTINGS_FIELD_DATA;
-    FieldDataTypeDef *settingsFieldData = (FieldDataTypeDef *) &genericData->Buffer;
-    settingsFieldData->FieldId = fieldId;
-    FieldValueTypeDef *settingsField = &settingsFieldData->Value;
-    settingsField->Index = index;
-    FloatValueWrapperTypeDef *valueWrapper = (FloatValueWrapperTypeDef *) &settingsField->Buffer;
-    valueWrapper->Value = value;
+    genericData->ReportData = DATA_OVERRIDE_DATA;
+    memcpy(genericData->Buffer, &control, sizeof(DirectControlTypeDef));
 }
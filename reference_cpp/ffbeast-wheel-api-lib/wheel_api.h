@@ -3,11 +3,34 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
 #include <hidapi.h>
+#include "seqlock.h"
+#include "spsc_ring.h"
 
 #define USB_VID         1115
 #define WHEEL_PID_FS    22999
 
+#define STATE_READ_TIMEOUT_MS   100 // Default wait of reads, see setStateReadTimeout
+#define STATE_READ_TIMEOUT_ADAPTIVE     (-2) // Wait derived from report interval, see setStateReadTimeout
+#define STATE_READ_TIMEOUT_MIN_MS       2 // Adaptive wait while reports flow, lower bound
+#define STATE_READ_STALL_INTERVALS      8 // Adaptive wait while reports flow, in report intervals
+#define STATE_READ_IDLE_TIMEOUT_MS      250 // Adaptive wait once reports stopped, upper bound
+#define STATE_REPORT_INTERVAL_NS        1000000ULL // Assumed report interval until one was measured
+#define STATE_RING_CAPACITY     256 // Power of two, about 256 ms of history at 1 kHz report rate
+#define STATE_INPUT_BUFFERS     64 // Default depth of driver side report queue, 64 ms at 1 kHz report rate
+#define STATE_VIEW_POOL_SIZE    8 // Receive buffers shared by StateView instances, at most 32
+
+// Valid groups of settings cache
+#define SETTINGS_CACHE_EFFECT   0x01
+#define SETTINGS_CACHE_HARDWARE 0x02
+#define SETTINGS_CACHE_GPIO     0x04
+#define SETTINGS_CACHE_ADC      0x08
+#define SETTINGS_CACHE_ALL      0x0F
+
 enum {
     INTERFACE_VENDOR = 0,
     INTERFACE_JOYSTICK = 1
@@ -61,6 +84,10 @@ typedef enum SettingsFieldEnum {
     SETTINGS_FIELD_INTEGRATED_SPRING_STRENGTH = 43,
 } SettingsFieldEnum;
 
+// Compile time layout of every field, specialized in settings_fields.h
+template <SettingsFieldEnum Field>
+struct SettingsFieldTraits;
+
 typedef enum PinModeEnum {
     PIN_MODE_NONE = 0,
     PIN_MODE_GPIO = 1,
@@ -205,6 +232,16 @@ typedef struct __attribute__((packed)) {
     uint8_t _padding[17]; // TODO:IMPORTANT! Keep size 64b. Report size must be same size as in descriptor otherwise Windows will drop the packet as corrupted
 } GpioExtensionSettingsTypeDef;
 
+/**
+ * All settings groups reported by device, same grouping as DeviceSettings on TS side.
+ * */
+typedef struct {
+    EffectSettingsTypeDef Effect;
+    HardwareSettingsTypeDef Hardware;
+    GpioExtensionSettingsTypeDef Gpio;
+    AdcExtensionSettingsTypeDef Adc;
+} DeviceSettingsTypeDef;
+
 /**
  * USB report that represent direct control initiated by host side.
  * Device will be constantly listening for this reports on vendor interface.
@@ -272,6 +309,24 @@ typedef struct __attribute__((packed)) {
 
 } DeviceStateTypeDef;
 
+/**
+ * Device state stamped on host side at the moment read of the report has completed.
+ * */
+typedef struct {
+    uint64_t Timestamp; // Monotonic host time in nanoseconds, see HostClockNanoseconds
+    DeviceStateTypeDef State;
+} TimestampedStateTypeDef;
+
+/**
+ * Hot path counters, see WheelApi::readStats.
+ * Hid counters belong to the open handle and start over on every connect.
+ * */
+typedef struct {
+    struct hid_device_stats Hid; // Every hid_write, hid_read_timeout and hid_get_feature_report on the handle
+    uint64_t StateReports; // Reports published by background or external reader
+    uint64_t DroppedStates; // Same as droppedStates
+} WheelApiStatsTypeDef;
+
 /**
  * USB report for all generic communication on vendor interface.
  * */
@@ -340,12 +395,73 @@ typedef struct __attribute__((packed)) {
 } Int16ValueWrapperTypeDef;
 
 
+/**
+ * Builds generic settings report carrying single value, wire type is the type of value.
+ * */
+template <typename T>
+inline void CreateSettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, T value) {
+    memset(report, 0, sizeof(HidInOutReportTypeDef));
+    report->ReportId = REPORT_GENERIC_INPUT_OUTPUT;
+    DataReportTypeDef *genericData = (DataReportTypeDef *) &report->Buffer;
+    genericData->ReportData = DATA_SETTINGS_FIELD_DATA;
+    FieldDataTypeDef *settingsFieldData = (FieldDataTypeDef *) &genericData->Buffer;
+    settingsFieldData->FieldId = fieldId;
+    FieldValueTypeDef *settingsField = &settingsFieldData->Value;
+    settingsField->Index = index;
+    memcpy(&settingsField->Buffer, &value, sizeof(T));
+}
+
+class WheelApi;
+
+/**
+ * Read only view of a state report placed straight in a pooled receive buffer of WheelApi, see readStateView.
+ * Buffer goes back to the pool when the view is destroyed or reset. Views are movable, not copyable,
+ * may be released from any thread and must not outlive the WheelApi they came from.
+ * */
+class StateView
+{
+public:
+    StateView() = default;
+    ~StateView();
+    StateView(StateView &&other);
+    StateView &operator=(StateView &&other);
+    StateView(const StateView &) = delete;
+    StateView &operator=(const StateView &) = delete;
+
+    bool isValid() const;
+    // Only meaningful while isValid
+    const DeviceStateTypeDef &state() const;
+    uint64_t timestamp() const;
+    void reset();
+
+private:
+    friend class WheelApi;
+    WheelApi *owner = nullptr;
+    int slot = -1;
+    const DeviceStateTypeDef *report = nullptr;
+    uint64_t receivedAt = 0;
+};
+
+class SharedStatePublisher;
+
 class WheelApi
 {
 public:
     WheelApi();
+    ~WheelApi();
 
+    // Returns 1 right away when already connected, 0 when no wheel could be opened
     int connect();
+    // Opens a specific vendor interface, used when several wheels are attached to one host.
+    // An open device is disconnected first.
+    int connectPath(const char *path);
+    // Stops background reader and closes the device, cached device path is kept for the next connect
+    void disconnect();
+    bool isConnected() const;
+    // Path of the last successfully opened device, empty before first connect
+    const char *getDevicePath() const;
+    // Raw device handle for external event loops, nullptr when not connected
+    hid_device *getHandle() const;
 
     int rebootController();
     int switchtoDfu();
@@ -356,25 +472,204 @@ public:
     int readHardwareSettings(HardwareSettingsTypeDef *destination);
     int readGpioExtensionSettings(GpioExtensionSettingsTypeDef *destination);
     int readAdcExtensionSettings(AdcExtensionSettingsTypeDef *destination);
-
+    int readFirmwareLicense(FirmwareLicenseTypeDef *destination);
+
+    // Reads every settings group and optionally the license with all feature requests in flight together.
+    // Returns 1 when all of them were read, 0 otherwise. Settings cache is refreshed as a side effect.
+    int readAllSettings(DeviceSettingsTypeDef *destination, FirmwareLicenseTypeDef *license = nullptr);
+
+    /**
+     * Settings cache. Filled on connect and by every successful read*Settings call, updated locally
+     * whenever send*SettingReport succeeds and dropped on reboot. readCached* never touches the bus and
+     * returns 0 when the group is not cached, refreshSettingsCache re-validates all groups from device.
+     * */
+    int refreshSettingsCache();
+    void invalidateSettingsCache();
+    bool isSettingsCacheValid() const;
+    int readCachedSettings(DeviceSettingsTypeDef *destination);
+    int readCachedEffectSettings(EffectSettingsTypeDef *destination);
+    int readCachedHardwareSettings(HardwareSettingsTypeDef *destination);
+    int readCachedGpioExtensionSettings(GpioExtensionSettingsTypeDef *destination);
+    int readCachedAdcExtensionSettings(AdcExtensionSettingsTypeDef *destination);
+
+    /**
+     * Shared memory fan out, see shared_state.h. Every state report read by any read path and every change
+     * of the settings cache is copied to the publisher, so other processes can follow the wheel without touching
+     * the device. Current cache is published on attach, so is the newest snapshot unless a background or external
+     * reader runs, which then publishes its next report itself: state is only ever published by the thread
+     * owning reads. Without a reader call this from the thread that reads, not concurrently with
+     * startStateReader or setExternalStateReader. Publisher must stay open while attached.
+     * */
+    void setSharedPublisher(SharedStatePublisher *publisher);
+
+    // While a background or external reader owns reads, returns the newest snapshot only once, 0 until
+    // the next report is published. Not for concurrent use with readLatestState or readStateView.
     int readState(DeviceStateTypeDef *destination);
 
+    /**
+     * How long readState, readLatestState, readStateView and the background reader wait for a report, 0 polls.
+     * STATE_READ_TIMEOUT_ADAPTIVE waits STATE_READ_STALL_INTERVALS of the measured report interval while reports
+     * flow, so a stalled wheel is noticed within 8 ms at 1 kHz, and doubles the wait after every empty read up to
+     * STATE_READ_IDLE_TIMEOUT_MS, so an idle wheel wakes the reader only a few times per second. A read returns as
+     * soon as a report arrives whatever the timeout, so the first report after a pause is never delayed.
+     * Stopping the background reader takes up to one wait. Returns 1, 0 for a negative value other than adaptive.
+     * */
+    int setStateReadTimeout(int milliseconds);
+    // Wait the next read uses, resolved from the adaptive state when adaptive
+    int stateReadTimeout() const;
+    // Mean time between state reports seen by any read path, STATE_REPORT_INTERVAL_NS before the first two
+    uint64_t reportIntervalNs() const;
+
+    /**
+     * Event driven reads, for loops which wait on their own events as well. Handle is an event for
+     * WaitForMultipleObjects on Windows and a descriptor for poll or epoll on Linux, see hid_get_read_wait_handle.
+     * Get it again before every wait (on Windows that starts the read the event tracks), once it is ready readState
+     * with a timeout of 0 set, or pumpState(0), returns the report without blocking.
+     * Returns 1, 0 when not connected and -1 while the background reader owns reads or when driver fails.
+     * */
+    int getStateWaitHandle(hid_wait_handle *waitHandle);
+
+    /**
+     * Depth of the driver side queue of state reports, kept across reconnects. Deep queue lets readState
+     * and the background reader catch up without loss after being preempted, shallow one bounds the age of
+     * the oldest report. Returns 1 when applied, 0 when stored for next connect and -1 when count is not
+     * positive or rejected by driver.
+     * */
+    int setInputBufferCount(int count);
+    // False when driver rejected the stored depth on last connect, queue then has the driver default depth
+    bool isInputBufferCountApplied() const;
+    // Pulls every queued report in one pass and returns only the newest, waits up to STATE_READ_TIMEOUT_MS
+    // when nothing is queued. Optional discarded receives number of older reports skipped.
+    int readLatestState(DeviceStateTypeDef *destination, int *discarded = nullptr);
+    // Reads next report into a pooled buffer without copying it, view is reset first.
+    // Returns same as readState, -1 when every pooled buffer is held by a view. While a reader owns the
+    // device the newest snapshot is placed in the pooled buffer instead.
+    int readStateView(StateView *view);
+
+    /**
+     * Background reader mode. Dedicated high priority thread owns all reads from vendor interface
+     * and publishes newest state, readState and readStateSnapshot never touch the OS while it runs.
+     * Writes and feature reports are still allowed from other threads.
+     * */
+    int startStateReader();
+    void stopStateReader();
+    bool isStateReaderRunning() const;
+
+    /**
+     * External reader mode. Some other loop (see WheelManager) owns the reads and calls pumpState,
+     * readState then serves the snapshot exactly as with the background reader.
+     * pumpState reads at most one report waiting up to milliseconds and publishes it to snapshot and ring.
+     * */
+    void setExternalStateReader(bool enabled);
+    int pumpState(int milliseconds);
+
+    // Copies newest state published by background reader. Returns 1 when state is available, 0 otherwise.
+    // Optional sequence receives number of reports received so far, so caller can detect new data.
+    int readStateSnapshot(DeviceStateTypeDef *destination, uint64_t *sequence = nullptr);
+    int readStateSnapshot(TimestampedStateTypeDef *destination, uint64_t *sequence = nullptr);
+
+    // Moves every report queued by background reader since previous call into destination, oldest first.
+    // Returns number of copied entries. Must be called from a single consumer thread, never allocates.
+    int drainStates(TimestampedStateTypeDef *destination, int capacity);
+    // Number of reports lost because consumer did not drain the ring in time
+    uint64_t droppedStates() const;
+
+    // Copies hot path counters, no lock is taken. Returns 1 when connected, 0 when Hid counters are zero
+    // because there is no handle.
+    int readStats(WheelApiStatsTypeDef *destination) const;
+    void resetStats();
+
     int sendDirectControl(DirectControlTypeDef control);
 
+    /**
+     * Queues direct control report and returns right after it was handed to the driver.
+     * Up to HID_WRITE_SLOTS reports can be in flight to cover the USB polling interval.
+     * Optional callback is invoked with the write result from inside sendDirectControlAsync or completeWrites.
+     * */
+    int sendDirectControlAsync(DirectControlTypeDef control, hid_write_callback callback = nullptr, void *context = nullptr);
+    // Reaps finished async writes, waiting up to milliseconds (-1 blocks). Returns number of writes still in flight.
+    int completeWrites(int milliseconds);
+
+    /**
+     * Async writes of a device share one queue which completeWrites reaps in order, callbacks included, so only one
+     * sender may use it at a time. Long running senders (ForceScheduler) claim it while they run, batches
+     * (SettingsTransaction) for their commit and fall back to blocking writes when someone else holds it.
+     * Returns true when claimed, false when another sender owns the queue.
+     * */
+    bool claimAsyncWrites();
+    void releaseAsyncWrites();
+
     int sendInt8SettingReport(SettingsFieldEnum, int8_t index, int8_t data);
     int sendInt16SettingReport( SettingsFieldEnum, int8_t index, int16_t data);
     int sendUInt8SettingReport(SettingsFieldEnum, int8_t index, uint8_t data);
     int sendUInt16SettingReport(SettingsFieldEnum, int8_t index, uint16_t data);
     int sendFloatSettingReport(SettingsFieldEnum, int8_t index, float data);
 
+    /**
+     * Type checked settings write, wire type, index range and bounds of Field come from SETTINGS_FIELD_LIST
+     * at compile time. Value is clamped to bounds of the field, returns 0 for index out of range.
+     * Defined in settings_fields.h which has to be included to use it.
+     * */
+    template <SettingsFieldEnum Field>
+    int sendSetting(typename SettingsFieldTraits<Field>::ValueType value, uint8_t index = 0);
+
+    // Blocking write of a settings report, wire type is taken from field table.
+    // Returns 0 for unknown field or index out of range, otherwise same as sendDirectControl.
+    int sendSettingReport(SettingsFieldEnum field, uint8_t index, int32_t value);
+    // Queues settings report without waiting for the transfer, wire type is taken from field table.
+    // Returns 0 for unknown field or index out of range, otherwise same as sendDirectControlAsync.
+    int sendSettingAsync(SettingsFieldEnum field, uint8_t index, int32_t value, hid_write_callback callback = nullptr, void *context = nullptr);
+    // Queues a report prebuilt with EncodeSettingsReport for field, index and value, cache is updated with value the
+    // same way. Nothing is encoded or checked here, see ProfileStore which validates its frames once on open.
+    int sendSettingFrameAsync(const HidInOutReportTypeDef *frame, SettingsFieldEnum field, uint8_t index, int32_t value,
+                              hid_write_callback callback = nullptr, void *context = nullptr);
+    // Blocking variant, for when another sender owns the async queue
+    int sendSettingFrame(const HidInOutReportTypeDef *frame, SettingsFieldEnum field, uint8_t index, int32_t value);
+
 private:
-    hid_device *handle = nullptr;
+    friend class StateView;
 
-    void CreateInt8SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, int8_t value);
-    void CreateInt16SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, int16_t value);
-    void CreateUInt8SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, uint8_t value);
-    void CreateUInt16SettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, uint16_t value);
-    void CreateFloatSettingsReport(HidInOutReportTypeDef *report, uint8_t fieldId, uint8_t index, float value);
+    hid_device *handle = nullptr;
+    std::string devicePath;
+    int inputBufferCount = STATE_INPUT_BUFFERS;
+    uint64_t lastReadSequence = 0; // Snapshot sequence last returned by readState and friends
+    bool inputBufferCountApplied = false;
+
+    std::thread stateReader;
+    std::atomic<bool> stateReaderRunning{false};
+    std::atomic<bool> externalStateReader{false};
+    SeqLock<TimestampedStateTypeDef> stateSnapshot;
+    SpscRing<TimestampedStateTypeDef, STATE_RING_CAPACITY> stateRing;
+    std::atomic<uint64_t> stateRingDrops{0};
+    std::atomic<uint64_t> stateReportsBase{0}; // Snapshot sequence at last resetStats
+
+    std::atomic<int> stateReadTimeoutMs{STATE_READ_TIMEOUT_MS};
+    std::atomic<int> adaptiveTimeoutMs{STATE_READ_TIMEOUT_MS};
+    std::atomic<uint64_t> reportInterval{STATE_REPORT_INTERVAL_NS};
+    uint64_t lastReportTime = 0; // Touched only by the thread which owns reads
+
+    unsigned char *viewBuffers[STATE_VIEW_POOL_SIZE] = {};
+    std::atomic<uint32_t> viewBuffersFree{(1u << STATE_VIEW_POOL_SIZE) - 1};
+
+    DeviceSettingsTypeDef settingsCache = {};
+    uint8_t settingsCacheValid = 0;
+    std::atomic<SharedStatePublisher*> sharedPublisher{nullptr};
+    std::atomic<bool> asyncWritesClaimed{false};
+
+    int AcquireViewBuffer();
+    void ReleaseViewBuffer(int slot);
+    void ApplyInputBufferCount();
+    int ReadNewSnapshot(TimestampedStateTypeDef *destination);
+
+    void UpdateSettingsCache(SettingsFieldEnum field, uint8_t index, int32_t value);
+    void PublishSettingsCache();
+    void PublishState(const DeviceStateTypeDef *state, uint64_t timestamp);
+
+    void ObserveReports(int reports, uint64_t now);
+
+    void StateReaderLoop();
+
+    void CreateDirectControlReport(HidInOutReportTypeDef *report, DirectControlTypeDef control);
 };
 
 
@@ -0,0 +1,180 @@
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "wheel_manager.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+WheelManager::WheelManager() {
+    hid_init();
+}
+
+WheelManager::~WheelManager() {
+    closeAll();
+}
+
+int WheelManager::enumerate(){
+    if (running.load(std::memory_order_acquire)){
+        return -1;
+    }
+    RecoverFailedWheels();
+    struct hid_device_info *devs, *cur_dev;
+    devs = hid_enumerate_usb_interface(USB_VID, WHEEL_PID_FS, INTERFACE_VENDOR);
+    for (cur_dev = devs; cur_dev != nullptr && wheelCount < WHEEL_MANAGER_MAX_WHEELS; cur_dev = cur_dev->next) {
+        if (cur_dev->interface_number != INTERFACE_VENDOR || IsOpen(cur_dev->path)){
+            continue;
+        }
+        WheelApi *api = new WheelApi();
+        FirmwareLicenseTypeDef license;
+        if (api->connectPath(cur_dev->path) <= 0 || api->readFirmwareLicense(&license) <= 0){
+            delete api;
+            continue;
+        }
+        // Same wheel can show up twice while Windows is still tearing down a stale interface
+        uint32_t deviceId[3];
+        memcpy(deviceId, license.DeviceId, sizeof(deviceId));
+        if (findWheel(deviceId) != nullptr){
+            delete api;
+            continue;
+        }
+        api->setExternalStateReader(true);
+        wheels[wheelCount].Api = api;
+        wheels[wheelCount].License = license;
+        wheels[wheelCount].Failed = false;
+        wheelCount++;
+    }
+    hid_free_enumeration(devs);
+    return wheelCount;
+}
+
+void WheelManager::closeAll(){
+    stop();
+    for (int i = 0; i < wheelCount; ++i) {
+        delete wheels[i].Api;
+        wheels[i].Api = nullptr;
+    }
+    wheelCount = 0;
+}
+
+int WheelManager::count() const{
+    return wheelCount;
+}
+
+WheelApi *WheelManager::getWheel(int index){
+    if (index < 0 || index >= wheelCount){
+        return nullptr;
+    }
+    return wheels[index].Api;
+}
+
+WheelApi *WheelManager::findWheel(const uint32_t deviceId[3]){
+    for (int i = 0; i < wheelCount; ++i) {
+        if (memcmp(wheels[i].License.DeviceId, deviceId, sizeof(wheels[i].License.DeviceId)) == 0){
+            return wheels[i].Api;
+        }
+    }
+    return nullptr;
+}
+
+int WheelManager::readLicense(int index, FirmwareLicenseTypeDef *destination){
+    if (index < 0 || index >= wheelCount){
+        return 0;
+    }
+    memcpy(destination, &wheels[index].License, sizeof(FirmwareLicenseTypeDef));
+    return 1;
+}
+
+int WheelManager::start(){
+    if (wheelCount == 0){
+        return 0;
+    }
+    if (running.load(std::memory_order_acquire)){
+        return 1;
+    }
+    running.store(true, std::memory_order_release);
+    ioThread = std::thread(&WheelManager::IoLoop, this);
+#ifdef _WIN32
+    SetThreadPriority((HANDLE) ioThread.native_handle(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+    return 1;
+}
+
+void WheelManager::stop(){
+    running.store(false, std::memory_order_release);
+    if (ioThread.joinable()){
+        // Loop wakes up at least every STATE_READ_TIMEOUT_MS
+        ioThread.join();
+    }
+}
+
+bool WheelManager::isRunning() const{
+    return running.load(std::memory_order_acquire);
+}
+
+bool WheelManager::IsOpen(const char *path) const{
+    for (int i = 0; i < wheelCount; ++i) {
+        if (strcmp(wheels[i].Api->getDevicePath(), path) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+void WheelManager::RecoverFailedWheels(){
+    int kept = 0;
+    for (int i = 0; i < wheelCount; ++i) {
+        if (wheels[i].Failed){
+            // Reopen at the old path, it must still be the same wheel to keep its index and WheelApi
+            std::string path = wheels[i].Api->getDevicePath();
+            FirmwareLicenseTypeDef license;
+            if (wheels[i].Api->connectPath(path.c_str()) > 0 && wheels[i].Api->readFirmwareLicense(&license) > 0 &&
+                memcmp(license.DeviceId, wheels[i].License.DeviceId, sizeof(license.DeviceId)) == 0){
+                wheels[i].Failed = false;
+            } else {
+                // Dropped, so a replug at any path is picked up again by enumeration
+                delete wheels[i].Api;
+                wheels[i].Api = nullptr;
+                continue;
+            }
+        }
+        wheels[kept++] = wheels[i];
+    }
+    for (int i = kept; i < wheelCount; ++i) {
+        wheels[i].Api = nullptr;
+    }
+    wheelCount = kept;
+}
+
+void WheelManager::IoLoop(){
+    hid_device *handles[WHEEL_MANAGER_MAX_WHEELS];
+    int owners[WHEEL_MANAGER_MAX_WHEELS];
+    while (running.load(std::memory_order_acquire)){
+        int waiting = 0;
+        for (int i = 0; i < wheelCount; ++i) {
+            if (wheels[i].Failed){
+                continue;
+            }
+            // Collect everything already completed, loop ends with a fresh read pending on the wheel
+            int result;
+            while ((result = wheels[i].Api->pumpState(0)) > 0) {
+            }
+            if (result < 0){
+                wheels[i].Failed = true;
+                continue;
+            }
+            handles[waiting] = wheels[i].Api->getHandle();
+            owners[waiting] = i;
+            waiting++;
+        }
+        if (waiting == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(STATE_READ_TIMEOUT_MS));
+            continue;
+        }
+        int ready = hid_wait_any(handles, waiting, STATE_READ_TIMEOUT_MS);
+        if (ready >= 0 && wheels[owners[ready]].Api->pumpState(0) < 0){
+            wheels[owners[ready]].Failed = true;
+        }
+    }
+}
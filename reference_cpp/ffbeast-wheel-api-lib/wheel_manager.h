@@ -0,0 +1,57 @@
+#ifndef WHEEL_MANAGER_H
+#define WHEEL_MANAGER_H
+
+#include <atomic>
+#include <thread>
+#include "wheel_api.h"
+
+#define WHEEL_MANAGER_MAX_WHEELS 16
+
+/**
+ * Owns one WheelApi per attached wheel and services state reads of all of them from a single I/O thread.
+ * Every wheel keeps a read pending, the thread sleeps in hid_wait_any until any of them completes
+ * and publishes the report to the state snapshot and ring of that wheel.
+ * Wheels are identified by DeviceId from FirmwareLicenseTypeDef, index order is enumeration order.
+ * */
+class WheelManager
+{
+public:
+    WheelManager();
+    ~WheelManager();
+
+    // Opens every vendor interface not opened yet, returns number of managed wheels or -1 while I/O loop runs.
+    // Failed wheels are reopened first, one which does not come back at its path is released and later
+    // wheels move down one index, so pointers from getWheel and findWheel to it become invalid.
+    int enumerate();
+    // Stops I/O loop, closes and releases every wheel
+    void closeAll();
+
+    int count() const;
+    // Returns nullptr when index is out of range
+    WheelApi *getWheel(int index);
+    WheelApi *findWheel(const uint32_t deviceId[3]);
+    int readLicense(int index, FirmwareLicenseTypeDef *destination);
+
+    int start();
+    void stop();
+    bool isRunning() const;
+
+private:
+    typedef struct {
+        WheelApi *Api;
+        FirmwareLicenseTypeDef License;
+        bool Failed; // Read failed, wheel is left out of the wait set until next enumerate reopens it
+    } ManagedWheelTypeDef;
+
+    ManagedWheelTypeDef wheels[WHEEL_MANAGER_MAX_WHEELS] = {};
+    int wheelCount = 0;
+
+    std::thread ioThread;
+    std::atomic<bool> running{false};
+
+    bool IsOpen(const char *path) const;
+    void RecoverFailedWheels();
+    void IoLoop();
+};
+
+#endif // WHEEL_MANAGER_H
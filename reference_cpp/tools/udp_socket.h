@@ -0,0 +1,136 @@
+#ifndef UDP_SOCKET_H
+#define UDP_SOCKET_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+#define SOCKET_INVALID INVALID_SOCKET
+#else
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define SOCKET_INVALID (-1)
+#endif
+
+/**
+ * Thin layer over Winsock and BSD sockets, just enough for the streaming tools. IPv4 only.
+ * */
+
+inline int SocketStartup(){
+#ifdef _WIN32
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0 ? 1 : -1;
+#else
+    return 1;
+#endif
+}
+
+inline void SocketCleanup(){
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+inline void SocketClose(SocketHandle socket){
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+// Returns 1, -1 when host is not a dotted IPv4 address
+inline int SocketAddress(const char *host, uint16_t port, struct sockaddr_in *address){
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    if (host == nullptr){
+        address->sin_addr.s_addr = htonl(INADDR_ANY);
+        return 1;
+    }
+    return inet_pton(AF_INET, host, &address->sin_addr) == 1 ? 1 : -1;
+}
+
+// UDP socket bound to port on every interface, 0 leaves port to the system
+inline SocketHandle SocketOpenUdp(uint16_t port){
+    SocketHandle handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (handle == SOCKET_INVALID){
+        return SOCKET_INVALID;
+    }
+    int reuse = 1;
+    setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char *) &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    SocketAddress(nullptr, port, &address);
+    if (bind(handle, (const struct sockaddr *) &address, sizeof(address)) != 0){
+        SocketClose(handle);
+        return SOCKET_INVALID;
+    }
+    return handle;
+}
+
+inline int SocketSetReceiveTimeout(SocketHandle handle, int milliseconds){
+#ifdef _WIN32
+    DWORD timeout = (DWORD) milliseconds;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+    return setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof(timeout)) == 0 ? 1 : -1;
+}
+
+// Multicast stays on the local network segment unless ttl is raised
+inline int SocketSetMulticastSender(SocketHandle handle, const char *interfaceAddress, int ttl){
+    unsigned char hops = (unsigned char) ttl;
+    if (setsockopt(handle, IPPROTO_IP, IP_MULTICAST_TTL, (const char *) &hops, sizeof(hops)) != 0){
+        return -1;
+    }
+    if (interfaceAddress != nullptr){
+        struct in_addr address;
+        if (inet_pton(AF_INET, interfaceAddress, &address) != 1 ||
+            setsockopt(handle, IPPROTO_IP, IP_MULTICAST_IF, (const char *) &address, sizeof(address)) != 0){
+            return -1;
+        }
+    }
+    return 1;
+}
+
+inline int SocketJoinGroup(SocketHandle handle, const char *group, const char *interfaceAddress){
+    struct ip_mreq request;
+    if (inet_pton(AF_INET, group, &request.imr_multiaddr) != 1){
+        return -1;
+    }
+    request.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (interfaceAddress != nullptr && inet_pton(AF_INET, interfaceAddress, &request.imr_interface) != 1){
+        return -1;
+    }
+    return setsockopt(handle, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char *) &request, sizeof(request)) == 0 ? 1 : -1;
+}
+
+inline int SocketSend(SocketHandle handle, const struct sockaddr_in *address, const uint8_t *data, size_t length){
+    return (int) sendto(handle, (const char *) data, (int) length, 0, (const struct sockaddr *) address, sizeof(*address));
+}
+
+// Returns bytes received, 0 on timeout, -1 on error
+inline int SocketReceive(SocketHandle handle, uint8_t *data, size_t capacity, struct sockaddr_in *from){
+    socklen_t length = sizeof(*from);
+    int result = (int) recvfrom(handle, (char *) data, (int) capacity, 0, (struct sockaddr *) from, &length);
+    if (result < 0){
+#ifdef _WIN32
+        return WSAGetLastError() == WSAETIMEDOUT ? 0 : -1;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+#endif
+    }
+    return result;
+}
+
+#endif // UDP_SOCKET_H
@@ -0,0 +1,281 @@
+/**
+ * Owns the wheel and shares it over the local network. Every state report is multicast as a keyframe or delta
+ * packet of state_stream.h, so any number of viewers, dashboards or loggers can follow the wheel without opening
+ * the device. One client may drive the wheel: control packets are accepted only from the authorized address with
+ * the right token, only newest sequence is applied and values go through CoalescingSender, so a burst of packets
+ * never queues stale forces. When the client goes quiet for CONTROL_LEASE_MS forces are released.
+ * Sequence has to advance for as long as the daemon runs, also across leases, so a captured packet can never be
+ * replayed to apply its force again, clients seed it from the wall clock to stay ahead after a restart.
+ * The token travels in plaintext. It keeps other hosts and stray clients off the wheel on a trusted network,
+ * it is no protection against anyone who can see the traffic.
+ *
+ * Build (Windows): g++ -O2 -std=c++17 -I../ffbeast-wheel-api-lib wheel_stream_daemon.cpp ../ffbeast-wheel-api-lib/wheel_api.cpp
+ *     ../ffbeast-wheel-api-lib/settings_fields.cpp ../ffbeast-wheel-api-lib/coalescing_sender.cpp
+ *     ../ffbeast-wheel-api-lib/state_stream.cpp ../ffbeast-wheel-api-lib/hidapi.c -lsetupapi -lwinmm -lws2_32
+ * Build (Linux): same with hidapi_linux.c and -ludev -lpthread
+ * Usage: wheel_stream_daemon [-g group] [-p state port] [-c control port] [-i interface] [-a client address] [-t token]
+ *     Control is disabled unless -a is given, it needs a non zero token then.
+ * */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "wheel_api.h"
+#include "coalescing_sender.h"
+#include "state_stream.h"
+#include "host_clock.h"
+#include "udp_socket.h"
+
+#define CONTROL_LEASE_MS        250 // Forces are released when authorized client sends nothing for this long
+#define CONTROL_POLL_MS         50
+#define RECONNECT_INTERVAL_MS   1000
+#define STATS_INTERVAL_NS       1000000000ULL
+#define DRAIN_BATCH             32
+
+typedef struct {
+    const char *Group;
+    uint16_t StatePort;
+    uint16_t ControlPort;
+    const char *Interface;
+    const char *Client;
+    uint64_t Token;
+} DaemonOptionsTypeDef;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void OnSignal(int){
+    stopRequested = 1;
+}
+
+static int ParseOptions(int argc, char **argv, DaemonOptionsTypeDef *options){
+    options->Group = STREAM_DEFAULT_GROUP;
+    options->StatePort = STREAM_DEFAULT_STATE_PORT;
+    options->ControlPort = STREAM_DEFAULT_CONTROL_PORT;
+    options->Interface = nullptr;
+    options->Client = nullptr;
+    options->Token = 0;
+    for (int i = 1; i < argc; i++){
+        if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0 || i + 1 >= argc){
+            return -1;
+        }
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]){
+            case 'g': options->Group = value; break;
+            case 'p': options->StatePort = (uint16_t) atoi(value); break;
+            case 'c': options->ControlPort = (uint16_t) atoi(value); break;
+            case 'i': options->Interface = value; break;
+            case 'a': options->Client = value; break;
+            case 't': options->Token = strtoull(value, nullptr, 0); break;
+            default: return -1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Receives control packets and forwards accepted values to the sender. Runs on its own thread so a slow or
+ * flooding client never delays state packets.
+ * */
+class ControlReceiver
+{
+public:
+    ControlReceiver(CoalescingSender *sender, const DaemonOptionsTypeDef *options) : sender(sender), options(options){
+    }
+
+    int start(){
+        if (SocketAddress(options->Client, 0, &client) <= 0){
+            fprintf(stderr, "bad client address %s\n", options->Client);
+            return -1;
+        }
+        handle = SocketOpenUdp(options->ControlPort);
+        if (handle == SOCKET_INVALID || SocketSetReceiveTimeout(handle, CONTROL_POLL_MS) <= 0){
+            fprintf(stderr, "cannot open control port %u\n", options->ControlPort);
+            return -1;
+        }
+        running.store(true, std::memory_order_release);
+        receiver = std::thread(&ControlReceiver::ReceiveLoop, this);
+        return 1;
+    }
+
+    void stop(){
+        running.store(false, std::memory_order_release);
+        if (receiver.joinable()){
+            receiver.join();
+        }
+        if (handle != SOCKET_INVALID){
+            SocketClose(handle);
+            handle = SOCKET_INVALID;
+        }
+    }
+
+    uint64_t acceptedCount() const{
+        return accepted.load(std::memory_order_relaxed);
+    }
+
+    uint64_t rejectedCount() const{
+        return rejected.load(std::memory_order_relaxed);
+    }
+
+private:
+    CoalescingSender *sender;
+    const DaemonOptionsTypeDef *options;
+    SocketHandle handle = SOCKET_INVALID;
+    struct sockaddr_in client;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> rejected{0};
+    std::thread receiver;
+
+    void ReceiveLoop(){
+        uint8_t packet[STREAM_MAX_PACKET];
+        uint32_t lastSequence = 0;
+        bool haveSequence = false;
+        uint64_t leaseEnd = 0;
+        bool leased = false;
+        while (running.load(std::memory_order_acquire)){
+            struct sockaddr_in from;
+            int length = SocketReceive(handle, packet, sizeof(packet), &from);
+            uint64_t now = HostClockNanoseconds();
+            StreamControlTypeDef control;
+            if (length > 0 && IsAuthorized(&from, packet, (size_t) length, &control)){
+                // Never accepted twice, lease or not, so an old captured packet cannot reapply its force
+                if (!haveSequence || (int32_t) (control.Sequence - lastSequence) > 0){
+                    lastSequence = control.Sequence;
+                    haveSequence = true;
+                    leaseEnd = now + CONTROL_LEASE_MS * 1000000ULL;
+                    leased = true;
+                    sender->submit(control.Control);
+                    accepted.fetch_add(1, std::memory_order_relaxed);
+                }
+            } else if (length > 0){
+                rejected.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (leased && now >= leaseEnd){
+                DirectControlTypeDef release = {};
+                sender->submit(release);
+                leased = false;
+            }
+        }
+    }
+
+    bool IsAuthorized(const struct sockaddr_in *from, const uint8_t *packet, size_t length, StreamControlTypeDef *control){
+        return from->sin_addr.s_addr == client.sin_addr.s_addr && DecodeStreamControl(packet, length, control) > 0 &&
+               control->Token == options->Token;
+    }
+};
+
+static int Connect(WheelApi *api, CoalescingSender *sender){
+    if (api->connect() <= 0){
+        return 0;
+    }
+    api->setExternalStateReader(true);
+    sender->start();
+    printf("connected %s\n", api->getDevicePath());
+    return 1;
+}
+
+static void Disconnect(WheelApi *api, CoalescingSender *sender){
+    sender->stop();
+    api->disconnect();
+}
+
+int main(int argc, char **argv){
+    DaemonOptionsTypeDef options;
+    if (ParseOptions(argc, argv, &options) <= 0){
+        fprintf(stderr, "usage: %s [-g group] [-p state port] [-c control port] [-i interface] [-a client address] [-t token]\n",
+                argv[0]);
+        return 1;
+    }
+    if (options.Client != nullptr && options.Token == 0){
+        fprintf(stderr, "control from %s needs a non zero token (-t)\n", options.Client);
+        return 1;
+    }
+    if (SocketStartup() <= 0){
+        fprintf(stderr, "socket startup failed\n");
+        return 1;
+    }
+    struct sockaddr_in group;
+    SocketHandle stateSocket = SocketOpenUdp(0);
+    if (SocketAddress(options.Group, options.StatePort, &group) <= 0 || stateSocket == SOCKET_INVALID ||
+        SocketSetMulticastSender(stateSocket, options.Interface, 1) <= 0){
+        fprintf(stderr, "cannot send to %s:%u\n", options.Group, options.StatePort);
+        SocketCleanup();
+        return 1;
+    }
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    WheelApi api;
+    CoalescingSender sender(&api);
+    ControlReceiver control(&sender, &options);
+    if (options.Client != nullptr && control.start() <= 0){
+        SocketClose(stateSocket);
+        SocketCleanup();
+        return 1;
+    }
+    printf("streaming to %s:%u, control %s\n", options.Group, options.StatePort,
+           options.Client != nullptr ? options.Client : "disabled");
+
+    StateStreamEncoder encoder;
+    TimestampedStateTypeDef samples[DRAIN_BATCH];
+    uint8_t packet[STREAM_MAX_PACKET];
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t sendErrors = 0;
+    uint64_t statsTime = HostClockNanoseconds();
+    bool connected = false;
+
+    while (!stopRequested){
+        if (!connected){
+            connected = Connect(&api, &sender) > 0;
+            if (!connected){
+                std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_INTERVAL_MS));
+                continue;
+            }
+            // Viewers must not apply deltas across a reconnect
+            encoder.requestKeyframe();
+        }
+
+        if (api.pumpState(STATE_READ_TIMEOUT_MS) < 0){
+            printf("device lost, reconnecting\n");
+            Disconnect(&api, &sender);
+            connected = false;
+            continue;
+        }
+        int count = api.drainStates(samples, DRAIN_BATCH);
+        for (int i = 0; i < count; i++){
+            size_t length = encoder.encode(&samples[i], packet, sizeof(packet));
+            if (SocketSend(stateSocket, &group, packet, length) == (int) length){
+                packets++;
+                bytes += length;
+            } else {
+                sendErrors++;
+            }
+        }
+
+        uint64_t now = HostClockNanoseconds();
+        if (now - statsTime >= STATS_INTERVAL_NS){
+            printf("packets %llu  %.2f bytes each  send errors %llu  control accepted %llu rejected %llu  dropped states %llu\n",
+                   (unsigned long long) packets, packets ? (double) bytes / (double) packets : 0.0,
+                   (unsigned long long) sendErrors, (unsigned long long) control.acceptedCount(),
+                   (unsigned long long) control.rejectedCount(), (unsigned long long) api.droppedStates());
+            statsTime = now;
+        }
+    }
+
+    control.stop();
+    if (connected){
+        // Leave the wheel without force
+        sender.stop();
+        DirectControlTypeDef release = {};
+        api.sendDirectControl(release);
+        api.disconnect();
+    }
+    SocketClose(stateSocket);
+    SocketCleanup();
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * Follows the state stream of wheel_stream_daemon and prints position, torque and stream health ten times a second.
+ * With -s the viewer also drives the wheel: it sends a constant force at 100 Hz to the daemon, which must have been
+ * started with -a set to this host and the same token.
+ *
+ * Build (Windows): g++ -O2 -std=c++17 -I../ffbeast-wheel-api-lib wheel_stream_viewer.cpp
+ *     ../ffbeast-wheel-api-lib/state_stream.cpp -lws2_32
+ * Build (Linux): same without -lws2_32
+ * Usage: wheel_stream_viewer [-g group] [-p state port] [-i interface] [-s daemon address] [-c control port]
+ *     [-t token] [-f constant force]
+ * */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "state_stream.h"
+#include "host_clock.h"
+#include "udp_socket.h"
+
+#define PRINT_INTERVAL_NS       100000000ULL
+#define CONTROL_INTERVAL_NS     10000000ULL
+#define RECEIVE_TIMEOUT_MS      10 // Bounds control send jitter when the stream is idle
+
+typedef struct {
+    const char *Group;
+    uint16_t StatePort;
+    uint16_t ControlPort;
+    const char *Interface;
+    const char *Daemon;
+    uint64_t Token;
+    int16_t Force;
+} ViewerOptionsTypeDef;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void OnSignal(int){
+    stopRequested = 1;
+}
+
+static int ParseOptions(int argc, char **argv, ViewerOptionsTypeDef *options){
+    options->Group = STREAM_DEFAULT_GROUP;
+    options->StatePort = STREAM_DEFAULT_STATE_PORT;
+    options->ControlPort = STREAM_DEFAULT_CONTROL_PORT;
+    options->Interface = nullptr;
+    options->Daemon = nullptr;
+    options->Token = 0;
+    options->Force = 0;
+    for (int i = 1; i < argc; i++){
+        if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0 || i + 1 >= argc){
+            return -1;
+        }
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]){
+            case 'g': options->Group = value; break;
+            case 'p': options->StatePort = (uint16_t) atoi(value); break;
+            case 'c': options->ControlPort = (uint16_t) atoi(value); break;
+            case 'i': options->Interface = value; break;
+            case 's': options->Daemon = value; break;
+            case 't': options->Token = strtoull(value, nullptr, 0); break;
+            case 'f': options->Force = (int16_t) atoi(value); break;
+            default: return -1;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv){
+    ViewerOptionsTypeDef options;
+    if (ParseOptions(argc, argv, &options) <= 0){
+        fprintf(stderr, "usage: %s [-g group] [-p state port] [-i interface] [-s daemon address] [-c control port]"
+                        " [-t token] [-f constant force]\n", argv[0]);
+        return 1;
+    }
+    if (SocketStartup() <= 0){
+        fprintf(stderr, "socket startup failed\n");
+        return 1;
+    }
+    SocketHandle stateSocket = SocketOpenUdp(options.StatePort);
+    if (stateSocket == SOCKET_INVALID || SocketJoinGroup(stateSocket, options.Group, options.Interface) <= 0 ||
+        SocketSetReceiveTimeout(stateSocket, RECEIVE_TIMEOUT_MS) <= 0){
+        fprintf(stderr, "cannot join %s:%u\n", options.Group, options.StatePort);
+        SocketCleanup();
+        return 1;
+    }
+    struct sockaddr_in daemon;
+    if (options.Daemon != nullptr && SocketAddress(options.Daemon, options.ControlPort, &daemon) <= 0){
+        fprintf(stderr, "bad daemon address %s\n", options.Daemon);
+        SocketClose(stateSocket);
+        SocketCleanup();
+        return 1;
+    }
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    StateStreamDecoder decoder;
+    TimestampedStateTypeDef sample = {};
+    StreamControlTypeDef control = {};
+    control.Token = options.Token;
+    // Daemon accepts only advancing sequences for its whole run, milliseconds of wall clock stay ahead of the
+    // 100 Hz count of any earlier run of the viewer
+    control.Sequence = (uint32_t) ((uint64_t) time(nullptr) * 1000);
+    control.Control.ConstantForce = options.Force;
+    uint8_t packet[STREAM_MAX_PACKET];
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t malformed = 0;
+    uint64_t printTime = HostClockNanoseconds();
+    uint64_t controlTime = printTime;
+
+    while (!stopRequested){
+        struct sockaddr_in from;
+        int length = SocketReceive(stateSocket, packet, sizeof(packet), &from);
+        if (length > 0){
+            packets++;
+            bytes += (uint64_t) length;
+            malformed += decoder.decode(packet, (size_t) length, &sample) < 0;
+        }
+
+        uint64_t now = HostClockNanoseconds();
+        if (options.Daemon != nullptr && now - controlTime >= CONTROL_INTERVAL_NS){
+            control.Sequence++;
+            size_t size = EncodeStreamControl(&control, packet, sizeof(packet));
+            SocketSend(stateSocket, &daemon, packet, size);
+            controlTime = now;
+        }
+        if (now - printTime >= PRINT_INTERVAL_NS){
+            printf("\rposition %6d  torque %6d  %s  packets %llu  %.2f bytes each  lost %llu  skipped %llu  bad %llu   ",
+                   sample.State.Position, sample.State.Torque, decoder.isSynchronized() ? "synced " : "waiting",
+                   (unsigned long long) packets, packets ? (double) bytes / (double) packets : 0.0,
+                   (unsigned long long) decoder.lostPackets(), (unsigned long long) decoder.skippedPackets(),
+                   (unsigned long long) malformed);
+            fflush(stdout);
+            printTime = now;
+        }
+    }
+
+    printf("\n");
+    SocketClose(stateSocket);
+    SocketCleanup();
+    return 0;
+}